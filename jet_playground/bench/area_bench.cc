@@ -0,0 +1,87 @@
+// benchmark of the per-event clustering cost for each jet
+// area mode ( none, voronoi, active with reused ghosts ),
+// using synthetic pp-like events so that no input data is needed
+
+#include "jet_config.hh"
+#include "synthetic_event.hh"
+
+#include "fastjet/ClusterSequence.hh"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+int main( int argc, const char** argv ) {
+
+  /**  Command line arguments
+       1: number of events ( default 2000 )
+       2: mean soft multiplicity per event ( default 20 )
+       3: jet algorithm ( default antikt )
+       4: resolution parameter ( default 0.4 )
+   */
+  unsigned n_events       = 2000;
+  double multiplicity     = 20.0;
+  std::string algorithm   = "antikt";
+  double resolution       = 0.4;
+
+  if ( argc > 1 ) n_events = std::stoi( argv[1] );
+  if ( argc > 2 ) multiplicity = std::stof( argv[2] );
+  if ( argc > 3 ) algorithm = argv[3];
+  if ( argc > 4 ) resolution = std::stof( argv[4] );
+
+  /** generate the events up front so only the clustering is timed -
+      every mode sees the same events
+   */
+  synthetic_event generator;
+  std::vector<std::vector<fastjet::PseudoJet> > pythia_events( n_events );
+  std::vector<std::vector<fastjet::PseudoJet> > geant_events( n_events );
+  for ( unsigned i = 0; i < n_events; ++i ) {
+    generator.generate( pythia_events[i], multiplicity );
+    generator.smear( pythia_events[i], geant_events[i] );
+  }
+
+  const std::string modes[3] = { "none", "voronoi", "active" };
+
+  std::cout << "events: " << n_events << " mean multiplicity: " << multiplicity
+            << " algorithm: " << algorithm << " R: " << resolution << std::endl;
+
+  for ( unsigned m = 0; m < 3; ++m ) {
+    jet_config config( algorithm, resolution, false, false, parse_area_mode( modes[m] ) );
+
+    unsigned long n_geant = 0, n_pythia = 0;
+    double geant_area = 0.0, pythia_area = 0.0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < n_events; ++i ) {
+      // cluster both the geant & pythia side, like event::process_analysis
+      std::vector<fastjet::PseudoJet> geant = config.track_selector( geant_events[i] );
+      std::vector<fastjet::PseudoJet> pythia = config.track_selector( pythia_events[i] );
+
+      std::unique_ptr<fastjet::ClusterSequence> cluster_geant( config.cluster( geant ) );
+      std::unique_ptr<fastjet::ClusterSequence> cluster_pythia( config.cluster( pythia ) );
+
+      std::vector<fastjet::PseudoJet> geant_jets = config.jet_selector( cluster_geant->inclusive_jets() );
+      std::vector<fastjet::PseudoJet> pythia_jets = config.jet_selector( cluster_pythia->inclusive_jets() );
+
+      n_geant += geant_jets.size();
+      n_pythia += pythia_jets.size();
+      for ( unsigned j = 0; j < geant_jets.size(); ++j )
+        if ( geant_jets[j].has_area() ) geant_area += geant_jets[j].area();
+      for ( unsigned j = 0; j < pythia_jets.size(); ++j )
+        if ( pythia_jets[j].has_area() ) pythia_area += pythia_jets[j].area();
+    }
+
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    std::cout << "area mode: " << modes[m] << " ghosts: " << ( config.ghosts ? config.ghosts->size() : 0 )
+              << " time/event: " << 1e6 * seconds / n_events << " us"
+              << " jets/event: " << double( n_geant + n_pythia ) / n_events
+              << " mean geant jet area: " << ( n_geant > 0 ? geant_area / n_geant : 0.0 )
+              << " mean pythia jet area: " << ( n_pythia > 0 ? pythia_area / n_pythia : 0.0 ) << std::endl;
+  }
+
+  return 0;
+}
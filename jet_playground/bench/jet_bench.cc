@@ -0,0 +1,424 @@
+// the jetfinding benchmark suite: times every stage of the per-event
+// hot path - the pseudojet conversion, the selectors ( copying & into
+// reused vectors ), clustering in each area mode and with the
+// small_n_clusterer, and constituent selection - on synthetic pp-like
+// events over a range of multiplicities. Jet selection, matching
+// ( inclusive & leading jet ), the jet features and tree filling ( both
+// output schemas ) are timed in event::process_event itself: the events
+// are written to an event cache, which a real event reads. The results
+// are written as JSON, so that runs of different versions can be diffed
+
+#include "event.hh"
+#include "jet_config.hh"
+#include "jet_matcher.hh"
+#include "small_n_clusterer.hh"
+#include "event_cache.hh"
+#include "alloc_counter.hh"
+#include "synthetic_event.hh"
+
+#include "TTree.h"
+#include "TStarJetVectorContainer.h"
+#include "TStarJetVector.h"
+
+#include "fastjet/ClusterSequence.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** one measurement: the best time per event over all repeats, and the
+    heap allocations per event in the last ( steady state ) repeat - -1
+    where they aren't counted
+ */
+struct bench_result {
+  std::string name;
+  double multiplicity;
+  double particles;
+  double us_per_event;
+  double allocs_per_event;
+};
+
+/** runs setup, then body for every event, repeats times - only the body
+    loop is timed
+ */
+bench_result time_stage( const std::string& name, double multiplicity, double particles,
+                         unsigned n_events, unsigned repeats,
+                         std::function<void()> setup, std::function<void( unsigned )> body );
+
+/** runs the events of ev's cache through read_entry() & process_event(),
+    repeats times, emptying its trees before every repeat. Records the
+    whole event as event_<name>, and the select, match & fill stages from
+    the event's own run_stats as <stage>_<name>
+ */
+void time_event( const std::string& name, event& ev, double multiplicity, double particles,
+                 unsigned n_events, unsigned repeats, std::vector<bench_result>& results );
+
+/** writes the synthetic events to an event cache at path, as a
+    skim would, with the event number as the event id
+ */
+bool write_cache( const std::string& path, const std::vector<std::vector<fastjet::PseudoJet> >& geant_events,
+                  const std::vector<std::vector<fastjet::PseudoJet> >& pythia_events );
+
+/** parses a comma separated list of multiplicities */
+std::vector<double> parse_list( const std::string& list );
+
+/** writes the results as a JSON document */
+void write_json( std::ostream& out, const std::string& label, unsigned n_events, unsigned repeats,
+                 const jet_config& config, const std::vector<bench_result>& results );
+
+int main( int argc, const char** argv ) {
+
+  /** options are --key value pairs -
+       --events:         events per multiplicity ( default 1000 )
+       --multiplicities: mean soft multiplicities to scan ( default 10,20,50,100 )
+       --repeats:        each stage is run this many times, and the best
+                         time is kept ( default 3 )
+       --algorithm:      jet algorithm ( default antikt )
+       --radius:         resolution parameter ( default 0.4 )
+       --label:          recorded in the output, to tell runs apart
+       --json:           file to write the results to ( default: stdout only )
+       --cache:          where the synthetic event cache is written, and
+                         removed again ( default jet_bench_events.cache )
+   */
+  unsigned n_events                 = 1000;
+  std::vector<double> multiplicities = { 10, 20, 50, 100 };
+  unsigned repeats                  = 3;
+  std::string algorithm             = "antikt";
+  double radius                     = 0.4;
+  std::string label                 = "";
+  std::string json_file             = "";
+  std::string cache_file            = "jet_bench_events.cache";
+
+  for ( int i = 1; i + 1 < argc; i += 2 ) {
+    std::string key = argv[i];
+    std::string value = argv[i+1];
+    if ( key == "--events" )              n_events = std::stoi( value );
+    else if ( key == "--multiplicities" ) multiplicities = parse_list( value );
+    else if ( key == "--repeats" )        repeats = std::max( 1, std::stoi( value ) );
+    else if ( key == "--algorithm" )      algorithm = value;
+    else if ( key == "--radius" )         radius = std::stod( value );
+    else if ( key == "--label" )          label = value;
+    else if ( key == "--json" )           json_file = value;
+    else if ( key == "--cache" )          cache_file = value;
+    else { std::cerr << "unknown option: " << key << std::endl; return -1; }
+  }
+  if ( argc % 2 == 0 ) { std::cerr << "options are --key value pairs" << std::endl; return -1; }
+
+  const std::string mode_names[3] = { "none", "voronoi", "active" };
+  std::vector<jet_config> configs;
+  for ( unsigned m = 0; m < 3; ++m )
+    configs.push_back( jet_config( algorithm, radius, false, false, parse_area_mode( mode_names[m] ) ) );
+  const jet_config& config = configs.back();
+
+  std::vector<bench_result> results;
+
+  for ( unsigned k = 0; k < multiplicities.size(); ++k ) {
+    double multiplicity = multiplicities[k];
+
+    /** the input is generated up front, with the same seed for every
+        multiplicity, so that only the stage itself is timed
+     */
+    synthetic_event generator;
+    std::vector<std::vector<fastjet::PseudoJet> > pythia_events( n_events );
+    std::vector<std::vector<fastjet::PseudoJet> > geant_events( n_events );
+    double n_particles = 0;
+    for ( unsigned i = 0; i < n_events; ++i ) {
+      generator.generate( pythia_events[i], multiplicity );
+      generator.smear( pythia_events[i], geant_events[i] );
+      n_particles += geant_events[i].size();
+    }
+    n_particles /= n_events;
+
+    /** the geant side as the reader hands it to us: a container
+        of TStarJetVectors, with the charge set
+     */
+    std::vector<std::unique_ptr<TStarJetVectorContainer<TStarJetVector> > > containers;
+    for ( unsigned i = 0; i < n_events; ++i ) {
+      containers.push_back( std::unique_ptr<TStarJetVectorContainer<TStarJetVector> >( new TStarJetVectorContainer<TStarJetVector>() ) );
+      for ( unsigned j = 0; j < geant_events[i].size(); ++j ) {
+        const fastjet::PseudoJet& particle = geant_events[i][j];
+        TStarJetVector track;
+        track.SetPxPyPzE( particle.px(), particle.py(), particle.pz(), particle.E() );
+        track.SetCharge( particle.user_index() );
+        containers[i]->Add( &track );
+      }
+    }
+
+    // ---- conversion: the original copy-everything path, and the
+    // ---- single pass into a reused buffer with the cuts applied
+    std::vector<fastjet::PseudoJet> buffer;
+    unsigned long long sink = 0;
+    results.push_back( time_stage( "convert_generate", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){ sink += geant_reader::generate_pseudojets( containers[i].get() ).size(); } ) );
+    results.push_back( time_stage( "convert_fill", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){ geant_reader::fill_pseudojets( containers[i].get(), buffer, config.cuts ); sink += buffer.size(); } ) );
+
+    // ---- selectors: the constituent cut as a fastjet selector ( what
+    // ---- the conversion used to be followed by ), and the jet selector
+    results.push_back( time_stage( "track_selector", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){ sink += config.track_selector( geant_events[i] ).size(); } ) );
+
+    std::vector<std::unique_ptr<fastjet::ClusterSequence> > sequences( n_events );
+    std::vector<std::vector<fastjet::PseudoJet> > inclusive( n_events );
+    for ( unsigned i = 0; i < n_events; ++i ) {
+      sequences[i].reset( configs[0].cluster( geant_events[i] ) );
+      inclusive[i] = sequences[i]->inclusive_jets();
+    }
+    results.push_back( time_stage( "jet_selector", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){ sink += fastjet::sorted_by_pt( config.jet_selector( inclusive[i] ) ).size(); } ) );
+    
+    // the same selection into a reused vector, sorted in place,
+    // like event::process_analysis
+    std::vector<fastjet::PseudoJet> selected;
+    results.push_back( time_stage( "jet_selector_reuse", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){
+        config.select_jets( inclusive[i], selected );
+        sort_by_pt( selected );
+        sink += selected.size();
+      } ) );
+
+    // ---- clustering of both sides, like event::process_analysis
+    for ( unsigned m = 0; m < configs.size(); ++m ) {
+      const jet_config& mode = configs[m];
+      results.push_back( time_stage( "cluster_" + mode_names[m], multiplicity, n_particles, n_events, repeats,
+        [](){},
+        [&]( unsigned i ){
+          std::unique_ptr<fastjet::ClusterSequence> cluster_geant( mode.cluster( geant_events[i] ) );
+          std::unique_ptr<fastjet::ClusterSequence> cluster_pythia( mode.cluster( pythia_events[i] ) );
+          sink += cluster_geant->inclusive_jets().size() + cluster_pythia->inclusive_jets().size();
+        } ) );
+    }
+
+    // ---- the built-in small-N clustering, against cluster_none
+    small_n_clusterer clusterer;
+    std::vector<fastjet::PseudoJet> small_n_jets;
+    results.push_back( time_stage( "cluster_small_n", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){
+        clusterer.cluster( configs[0].jet_def, geant_events[i], small_n_jets );
+        sink += small_n_jets.size();
+        clusterer.cluster( configs[0].jet_def, pythia_events[i], small_n_jets );
+        sink += small_n_jets.size();
+      } ) );
+
+    /** the selected jets of both sides with active areas, their cluster
+        sequences, which have to outlive the constituent lookups, and the
+        matched pairs
+     */
+    std::vector<std::unique_ptr<fastjet::ClusterSequence> > geant_sequences( n_events ), pythia_sequences( n_events );
+    std::vector<std::vector<fastjet::PseudoJet> > matched_geant_jets( n_events ), matched_pythia_jets( n_events );
+    jet_matcher matcher( config.jet_def.R(), config.match );
+    std::vector<std::pair<unsigned, unsigned> > matches;
+    for ( unsigned i = 0; i < n_events; ++i ) {
+      geant_sequences[i].reset( config.cluster( geant_events[i] ) );
+      pythia_sequences[i].reset( config.cluster( pythia_events[i] ) );
+      std::vector<fastjet::PseudoJet> geant_jets = fastjet::sorted_by_pt( config.jet_selector( geant_sequences[i]->inclusive_jets() ) );
+      std::vector<fastjet::PseudoJet> pythia_jets = fastjet::sorted_by_pt( config.jet_selector( pythia_sequences[i]->inclusive_jets() ) );
+      matcher.match( pythia_jets, geant_jets, matches );
+      for ( unsigned j = 0; j < matches.size(); ++j ) {
+        matched_pythia_jets[i].push_back( pythia_jets[matches[j].first] );
+        matched_geant_jets[i].push_back( geant_jets[matches[j].second] );
+      }
+    }
+
+    // ---- the selected constituents of every matched pair: the copying
+    // ---- track selector, and select_constituents into reused vectors
+    results.push_back( time_stage( "constituents", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){
+        for ( unsigned j = 0; j < matched_geant_jets[i].size(); ++j )
+          sink += config.track_selector( matched_geant_jets[i][j].constituents() ).size() +
+                  config.track_selector( matched_pythia_jets[i][j].constituents() ).size();
+      } ) );
+    std::vector<fastjet::PseudoJet> scratch, dconst_selected, pconst_selected;
+    results.push_back( time_stage( "constituents_reuse", multiplicity, n_particles, n_events, repeats,
+      [](){},
+      [&]( unsigned i ){
+        for ( unsigned j = 0; j < matched_geant_jets[i].size(); ++j ) {
+          config.select_constituents( matched_geant_jets[i][j], scratch, dconst_selected );
+          config.select_constituents( matched_pythia_jets[i][j], scratch, pconst_selected );
+          sink += dconst_selected.size() + pconst_selected.size();
+        }
+      } ) );
+
+    // ---- selection, matching, the features & tree filling, through
+    // ---- event::process_event on the same events, read from a cache,
+    // ---- into in-memory trees: both output schemas, the flat schema
+    // ---- with the features, and the leading jet mode
+    if ( !write_cache( cache_file, geant_events, pythia_events ) ) {
+      std::cerr << "Error: can't write the event cache " << cache_file << std::endl;
+      return -1;
+    }
+    struct event_run { const char* name; bool inclusive; output_schema schema; bool features; };
+    const event_run runs[4] = { { "object", true, schema_object, false },
+                                { "flat", true, schema_flat, false },
+                                { "flat_features", true, schema_flat, true },
+                                { "leading", false, schema_object, false } };
+    for ( unsigned r = 0; r < 4; ++r ) {
+      event ev;
+      ev.set_cache( cache_file );
+      ev.add_config( jet_config( algorithm, radius, runs[r].inclusive, false, area_active ) );
+      ev.set_output_schema( runs[r].schema );
+      ev.set_features( runs[r].features );
+      ev.init_tree();
+      if ( !ev.cached() ) { std::cerr << "Error: can't read the event cache " << cache_file << std::endl; return -1; }
+      time_event( runs[r].name, ev, multiplicity, n_particles, n_events, repeats, results );
+    }
+    std::remove( cache_file.c_str() );
+
+    // keeps the conversions & selections from being optimized away
+    if ( sink == 0 ) std::cerr << "warning: no particles or jets were produced" << std::endl;
+  }
+
+  std::cout << std::left << std::setw( 24 ) << "stage" << std::setw( 14 ) << "multiplicity"
+            << std::setw( 12 ) << "particles" << std::setw( 14 ) << "us/event" << "allocs/event" << std::endl;
+  for ( unsigned i = 0; i < results.size(); ++i ) {
+    std::cout << std::left << std::setw( 24 ) << results[i].name << std::setw( 14 ) << results[i].multiplicity
+              << std::setw( 12 ) << results[i].particles << std::setw( 14 ) << results[i].us_per_event;
+    if ( results[i].allocs_per_event < 0 ) std::cout << "-" << std::endl;
+    else                                   std::cout << results[i].allocs_per_event << std::endl;
+  }
+
+  if ( !json_file.empty() ) {
+    std::ofstream out( json_file );
+    if ( !out ) { std::cerr << "Error: can't write " << json_file << std::endl; return -1; }
+    write_json( out, label, n_events, repeats, config, results );
+  }
+
+  return 0;
+}
+
+bench_result time_stage( const std::string& name, double multiplicity, double particles,
+                         unsigned n_events, unsigned repeats,
+                         std::function<void()> setup, std::function<void( unsigned )> body ) {
+  bench_result result;
+  result.name = name;
+  result.multiplicity = multiplicity;
+  result.particles = particles;
+  result.us_per_event = 0;
+  result.allocs_per_event = 0;
+
+  double best = -1;
+  for ( unsigned r = 0; r < repeats; ++r ) {
+    setup();
+    unsigned long long allocations = alloc_counter::count();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( unsigned i = 0; i < n_events; ++i )
+      body( i );
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    result.allocs_per_event = double( alloc_counter::count() - allocations ) / n_events;
+    if ( best < 0 || seconds < best ) best = seconds;
+  }
+  result.us_per_event = 1e6 * best / n_events;
+  return result;
+}
+
+void time_event( const std::string& name, event& ev, double multiplicity, double particles,
+                 unsigned n_events, unsigned repeats, std::vector<bench_result>& results ) {
+  const run_stats::stage stages[3] = { run_stats::select, run_stats::match, run_stats::fill };
+
+  bench_result total = { "event_" + name, multiplicity, particles, 0, 0 };
+  std::vector<bench_result> stage_results;
+  for ( unsigned s = 0; s < 3; ++s ) {
+    bench_result result = { std::string( run_stats::stage_name( stages[s] ) ) + "_" + name, multiplicity, particles, 0, -1 };
+    stage_results.push_back( result );
+  }
+
+  double best = -1;
+  std::vector<double> best_stage( 3, -1 );
+  for ( unsigned r = 0; r < repeats; ++r ) {
+    ev.get_train_tree()->Reset();
+    if ( ev.get_event_tree() != nullptr ) ev.get_event_tree()->Reset();
+
+    unsigned long long stage_ns[3];
+    for ( unsigned s = 0; s < 3; ++s )
+      stage_ns[s] = ev.stats().time( stages[s] );
+    unsigned long long allocations = alloc_counter::count();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( unsigned i = 0; i < n_events; ++i )
+      if ( ev.read_entry( i ) == 1 ) ev.process_event();
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    total.allocs_per_event = double( alloc_counter::count() - allocations ) / n_events;
+    if ( best < 0 || seconds < best ) best = seconds;
+
+    for ( unsigned s = 0; s < 3; ++s ) {
+      double stage_seconds = ( ev.stats().time( stages[s] ) - stage_ns[s] ) / 1.0e9;
+      if ( best_stage[s] < 0 || stage_seconds < best_stage[s] ) best_stage[s] = stage_seconds;
+    }
+  }
+
+  total.us_per_event = 1e6 * best / n_events;
+  results.push_back( total );
+  for ( unsigned s = 0; s < 3; ++s ) {
+    stage_results[s].us_per_event = 1e6 * best_stage[s] / n_events;
+    results.push_back( stage_results[s] );
+  }
+}
+
+bool write_cache( const std::string& path, const std::vector<std::vector<fastjet::PseudoJet> >& geant_events,
+                  const std::vector<std::vector<fastjet::PseudoJet> >& pythia_events ) {
+  event_cache_writer writer;
+  if ( !writer.open( path ) ) return false;
+
+  std::vector<cache_particle> geant, pythia;
+  const std::vector<std::vector<fastjet::PseudoJet> >* events[2] = { &geant_events, &pythia_events };
+  std::vector<cache_particle>* particles[2] = { &geant, &pythia };
+  for ( unsigned i = 0; i < geant_events.size(); ++i ) {
+    for ( unsigned side = 0; side < 2; ++side ) {
+      particles[side]->clear();
+      const std::vector<fastjet::PseudoJet>& event = ( *events[side] )[i];
+      for ( unsigned j = 0; j < event.size(); ++j ) {
+        cache_particle particle = { float( event[j].px() ), float( event[j].py() ), float( event[j].pz() ),
+                                    float( event[j].E() ), int32_t( event[j].user_index() ) };
+        particles[side]->push_back( particle );
+      }
+    }
+    cache_event header = { 1, int32_t( i ), int32_t( geant.size() ), 0.0f, 1.0, 0, 0 };
+    writer.add( header, geant, pythia );
+  }
+  return writer.close();
+}
+
+std::vector<double> parse_list( const std::string& list ) {
+  std::vector<double> values;
+  std::stringstream stream( list );
+  std::string value;
+  while ( std::getline( stream, value, ',' ) )
+    if ( !value.empty() ) values.push_back( std::stod( value ) );
+  return values;
+}
+
+void write_json( std::ostream& out, const std::string& label, unsigned n_events, unsigned repeats,
+                 const jet_config& config, const std::vector<bench_result>& results ) {
+  out << "{\n";
+  out << "  \"label\": \"" << label << "\",\n";
+  out << "  \"events\": " << n_events << ",\n";
+  out << "  \"repeats\": " << repeats << ",\n";
+  out << "  \"algorithm\": \"" << config.algorithm << "\",\n";
+  out << "  \"radius\": " << config.resolution << ",\n";
+  out << "  \"results\": [\n";
+  for ( unsigned i = 0; i < results.size(); ++i ) {
+    out << "    { \"name\": \"" << results[i].name << "\", \"multiplicity\": " << results[i].multiplicity
+        << ", \"particles\": " << results[i].particles << ", \"us_per_event\": " << results[i].us_per_event
+        << ", \"allocs_per_event\": ";
+    if ( results[i].allocs_per_event < 0 ) out << "null";
+    else                                   out << results[i].allocs_per_event;
+    out << " }"
+        << ( i + 1 < results.size() ? "," : "" ) << "\n";
+  }
+  out << "  ]\n";
+  out << "}\n";
+}
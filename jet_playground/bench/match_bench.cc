@@ -0,0 +1,139 @@
+// benchmark of geant to pythia jet matching with many jets
+// per event ( inclusive mode ). Compares the original
+// SelectorCircle + std::find matching against the grid indexed
+// jet_matcher, in both greedy and bidirectional mode
+
+#include "jet_matcher.hh"
+
+#include "fastjet/PseudoJet.hh"
+#include "fastjet/Selector.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/** the original event::match_jets implementation, kept here as the reference */
+void legacy_match( const std::vector<fastjet::PseudoJet>& pythia_jets, const std::vector<fastjet::PseudoJet>& geant_jets,
+                   double radius, std::vector<fastjet::PseudoJet>& matched_geant,
+                   std::vector<fastjet::PseudoJet>& matched_pythia ) {
+  matched_geant.clear();
+  matched_pythia.clear();
+  for ( unsigned i = 0; i < pythia_jets.size(); ++i ) {
+    fastjet::PseudoJet pythia_jet = pythia_jets[i];
+    fastjet::Selector radial_selector = fastjet::SelectorCircle( radius );
+    radial_selector.set_reference( pythia_jet );
+    std::vector<fastjet::PseudoJet> matched = radial_selector( geant_jets );
+
+    for ( unsigned j = 0; j < matched.size(); ++j ) {
+      std::ptrdiff_t idx = std::find( matched_geant.begin(), matched_geant.end(), matched[j]  ) - matched_geant.begin();
+      if ( idx < int ( matched_geant.size() ) ) {
+        matched.erase( std::find( matched.begin(), matched.end(), matched_geant[idx]  ) );
+      }
+    }
+
+    if ( matched.size() == 0 ) continue;
+
+    matched_geant.push_back( matched[0] );
+    matched_pythia.push_back( pythia_jet );
+  }
+}
+
+/** builds a pt ordered list of n jets at random positions in the acceptance */
+void random_jets( std::mt19937& rng, unsigned n, std::vector<fastjet::PseudoJet>& jets ) {
+  std::uniform_real_distribution<double> eta( -0.6, 0.6 );
+  std::uniform_real_distribution<double> phi( 0.0, 2.0 * 3.141592653589793 );
+  std::exponential_distribution<double> pt( 1.0 / 3.0 );
+  jets.clear();
+  for ( unsigned i = 0; i < n; ++i ) {
+    fastjet::PseudoJet jet;
+    jet.reset_PtYPhiM( 1.0 + pt( rng ), eta( rng ), phi( rng ) );
+    jets.push_back( jet );
+  }
+  jets = fastjet::sorted_by_pt( jets );
+}
+
+/** detector version of a jet list: each jet is kept with some
+    efficiency, shifted slightly in eta-phi and smeared in pt
+ */
+void smear_jets( std::mt19937& rng, const std::vector<fastjet::PseudoJet>& truth,
+                 std::vector<fastjet::PseudoJet>& detector ) {
+  std::uniform_real_distribution<double> accept( 0.0, 1.0 );
+  std::normal_distribution<double> shift( 0.0, 0.1 );
+  std::normal_distribution<double> scale( 0.9, 0.15 );
+  detector.clear();
+  for ( unsigned i = 0; i < truth.size(); ++i ) {
+    if ( accept( rng ) > 0.9 ) continue;
+    fastjet::PseudoJet jet;
+    jet.reset_PtYPhiM( std::max( 0.5, truth[i].pt() * scale( rng ) ), truth[i].rap() + shift( rng ),
+                       truth[i].phi() + shift( rng ) );
+    detector.push_back( jet );
+  }
+  detector = fastjet::sorted_by_pt( detector );
+}
+
+int main( int argc, const char** argv ) {
+
+  /**  Command line arguments
+       1: number of events ( default 2000 )
+       2: number of pythia jets per event ( default 40 )
+       3: matching radius ( default 0.4 )
+   */
+  unsigned n_events = 2000;
+  unsigned n_jets   = 40;
+  double radius     = 0.4;
+
+  if ( argc > 1 ) n_events = std::stoi( argv[1] );
+  if ( argc > 2 ) n_jets = std::stoi( argv[2] );
+  if ( argc > 3 ) radius = std::stof( argv[3] );
+
+  std::mt19937 rng( 42 );
+  std::vector<std::vector<fastjet::PseudoJet> > pythia_events( n_events );
+  std::vector<std::vector<fastjet::PseudoJet> > geant_events( n_events );
+  for ( unsigned i = 0; i < n_events; ++i ) {
+    random_jets( rng, n_jets, pythia_events[i] );
+    smear_jets( rng, pythia_events[i], geant_events[i] );
+  }
+
+  std::vector<fastjet::PseudoJet> matched_geant, matched_pythia;
+  std::vector<std::pair<unsigned, unsigned> > matches;
+
+  // reference matching
+  std::vector<unsigned long> legacy_counts( n_events );
+  unsigned long legacy_matches = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for ( unsigned i = 0; i < n_events; ++i ) {
+    legacy_match( pythia_events[i], geant_events[i], radius, matched_geant, matched_pythia );
+    legacy_counts[i] = matched_geant.size();
+    legacy_matches += matched_geant.size();
+  }
+  double legacy_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+  std::cout << "events: " << n_events << " pythia jets/event: " << n_jets << " R: " << radius << std::endl;
+  std::cout << "legacy:        time/event: " << 1e6 * legacy_seconds / n_events << " us"
+            << " matches/event: " << double( legacy_matches ) / n_events << std::endl;
+
+  const std::string modes[2] = { "greedy", "bidirectional" };
+  for ( unsigned m = 0; m < 2; ++m ) {
+    jet_matcher matcher( radius, jet_matcher::parse_mode( modes[m] ) );
+
+    unsigned long n_matches = 0;
+    unsigned long n_differ = 0;
+    start = std::chrono::steady_clock::now();
+    for ( unsigned i = 0; i < n_events; ++i ) {
+      matcher.match( pythia_events[i], geant_events[i], matches );
+      n_matches += matches.size();
+      if ( matches.size() != legacy_counts[i] ) ++n_differ;
+    }
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    std::cout << modes[m] << ( m == 0 ? ":        " : ": " ) << "time/event: " << 1e6 * seconds / n_events << " us"
+              << " matches/event: " << double( n_matches ) / n_events
+              << " events differing from legacy: " << n_differ
+              << " speedup: " << legacy_seconds / seconds << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,81 @@
+// implementation for synthetic_event
+
+#include "synthetic_event.hh"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+  const double pion_mass = 0.13957;
+  const double two_pi = 6.283185307179586;
+}
+
+synthetic_event::synthetic_event( unsigned seed ) : rng_( seed ) { }
+
+void synthetic_event::generate( std::vector<fastjet::PseudoJet>& particles, double mean_multiplicity,
+                                double hard_pt ) {
+  particles.clear();
+
+  std::poisson_distribution<int> multiplicity( mean_multiplicity );
+  std::exponential_distribution<double> soft_pt( 1.0 / 0.5 );
+  std::uniform_real_distribution<double> eta( -1.0, 1.0 );
+  std::uniform_real_distribution<double> phi( 0.0, two_pi );
+
+  // the soft underlying event
+  int n_soft = multiplicity( rng_ );
+  for ( int i = 0; i < n_soft; ++i )
+    add_particle( particles, 0.2 + soft_pt( rng_ ), eta( rng_ ), phi( rng_ ) );
+
+  // and a back-to-back pair of hard jets - each split into a handful
+  // of fragments collimated around the jet axis
+  std::uniform_real_distribution<double> jet_eta( -0.6, 0.6 );
+  std::normal_distribution<double> spread( 0.0, 0.1 );
+  std::poisson_distribution<int> n_fragments( 6.0 );
+  std::uniform_real_distribution<double> fraction( 0.1, 1.0 );
+
+  double axis_phi = phi( rng_ );
+  for ( int jet = 0; jet < 2; ++jet ) {
+    double axis_eta = jet_eta( rng_ );
+    int n = 1 + n_fragments( rng_ );
+
+    std::vector<double> weights( n );
+    double total = 0.0;
+    for ( int i = 0; i < n; ++i ) { weights[i] = fraction( rng_ ); total += weights[i]; }
+
+    for ( int i = 0; i < n; ++i )
+      add_particle( particles, hard_pt * weights[i] / total, axis_eta + spread( rng_ ),
+                    axis_phi + spread( rng_ ) );
+
+    axis_phi += 0.5 * two_pi;
+  }
+}
+
+void synthetic_event::smear( const std::vector<fastjet::PseudoJet>& truth, std::vector<fastjet::PseudoJet>& detector,
+                             double efficiency, double resolution ) {
+  detector.clear();
+
+  std::uniform_real_distribution<double> accept( 0.0, 1.0 );
+  std::normal_distribution<double> smearing( 1.0, resolution );
+
+  for ( unsigned i = 0; i < truth.size(); ++i ) {
+    if ( accept( rng_ ) > efficiency ) continue;
+    double scale = std::max( 0.0, smearing( rng_ ) );
+    fastjet::PseudoJet particle( truth[i].px() * scale, truth[i].py() * scale,
+                                 truth[i].pz() * scale, truth[i].E() * scale );
+    particle.set_user_index( truth[i].user_index() );
+    detector.push_back( particle );
+  }
+}
+
+void synthetic_event::add_particle( std::vector<fastjet::PseudoJet>& particles, double pt, double eta, double phi ) {
+  std::uniform_int_distribution<int> charge( -1, 1 );
+
+  double px = pt * std::cos( phi );
+  double py = pt * std::sin( phi );
+  double pz = pt * std::sinh( eta );
+  double e  = std::sqrt( px * px + py * py + pz * pz + pion_mass * pion_mass );
+
+  fastjet::PseudoJet particle( px, py, pz, e );
+  particle.set_user_index( charge( rng_ ) );
+  particles.push_back( particle );
+}
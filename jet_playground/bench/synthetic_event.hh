@@ -0,0 +1,55 @@
+/*  Generates synthetic pp-like events for benchmarking the
+    jetfinding hot path without the STAR picoDst files. An event
+    is a soft underlying event plus a back-to-back pair of
+    collimated "jets", with the charge stored in the user index
+    just like geant_reader::generate_pseudojets does. A simple
+    detector response ( tracking efficiency & pt smearing ) can
+    be applied to produce a paired geant-like event.
+ */
+
+#include "fastjet/PseudoJet.hh"
+
+#include <random>
+#include <vector>
+
+#ifndef BENCH_SYNTHETIC_EVENT_HH
+#define BENCH_SYNTHETIC_EVENT_HH
+
+class synthetic_event {
+
+public:
+
+  /** the seed fixes the sequence of events, so that every
+      benchmark run sees exactly the same input
+   */
+  synthetic_event( unsigned seed = 42 );
+
+  /** default destructor */
+  ~synthetic_event() {};
+
+  /** generates a particle level event into particles ( which is cleared
+      first ). mean_multiplicity is the mean number of soft particles,
+      hard_pt the approximate pt of each of the two hard jets
+   */
+  void generate( std::vector<fastjet::PseudoJet>& particles, double mean_multiplicity = 20.0,
+                 double hard_pt = 15.0 );
+
+  /** applies a detector response to a particle level event:
+      each particle survives with probability efficiency, and
+      its momentum is smeared by a relative resolution
+   */
+  void smear( const std::vector<fastjet::PseudoJet>& truth, std::vector<fastjet::PseudoJet>& detector,
+              double efficiency = 0.85, double resolution = 0.05 );
+
+private:
+
+  std::mt19937 rng_;
+
+  /** adds a single particle with the given kinematics, with a random
+      charge ( 2/3 charged, 1/3 neutral )
+   */
+  void add_particle( std::vector<fastjet::PseudoJet>& particles, double pt, double eta, double phi );
+
+};
+
+#endif // BENCH_SYNTHETIC_EVENT_HH
@@ -0,0 +1,49 @@
+// implementation for detector_response
+
+#include "detector_response.hh"
+
+#include <cmath>
+#include <algorithm>
+
+constexpr double detector_response::track_eta_max;
+constexpr double detector_response::tower_eta_max;
+
+detector_response::detector_response( double track_efficiency, double track_resolution,
+                                      double tower_resolution, double vz_sigma, unsigned seed ) :
+                  track_efficiency_( track_efficiency ), track_resolution_( track_resolution ),
+                  tower_resolution_( tower_resolution ), vz_sigma_( vz_sigma ), rng_( seed ) { }
+
+void detector_response::apply( const std::vector<fastjet::PseudoJet>& truth,
+                               std::vector<fastjet::PseudoJet>& detector ) {
+  detector.clear();
+
+  std::uniform_real_distribution<double> accept( 0.0, 1.0 );
+  std::normal_distribution<double> gauss( 0.0, 1.0 );
+
+  for ( unsigned i = 0; i < truth.size(); ++i ) {
+    const fastjet::PseudoJet& particle = truth[i];
+    bool charged = particle.user_index() != 0;
+
+    double scale;
+    if ( charged ) {
+      if ( std::fabs( particle.eta() ) > track_eta_max ) continue;
+      if ( accept( rng_ ) > track_efficiency_ ) continue;
+      scale = 1.0 + track_resolution_ * gauss( rng_ );
+    }
+    else {
+      if ( std::fabs( particle.eta() ) > tower_eta_max ) continue;
+      scale = 1.0 + tower_resolution_ / std::sqrt( std::max( particle.E(), 0.01 ) ) * gauss( rng_ );
+    }
+    if ( scale <= 0.0 ) continue;
+
+    fastjet::PseudoJet smeared( particle.px() * scale, particle.py() * scale,
+                                particle.pz() * scale, particle.E() * scale );
+    smeared.set_user_index( particle.user_index() );
+    detector.push_back( smeared );
+  }
+}
+
+double detector_response::vertex_z() {
+  std::normal_distribution<double> vz( 0.0, vz_sigma_ );
+  return vz( rng_ );
+}
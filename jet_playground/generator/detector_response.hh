@@ -0,0 +1,62 @@
+/*  A simple parametrized STAR detector response, used to produce
+    geant-like detector level events from pythia particle level events
+    without running the full simulation. Charged particles are tracks,
+    with an efficiency and a relative pt resolution. Neutral particles
+    are towers, with a stochastic energy resolution, and only exist
+    inside the BEMC acceptance. The charge is kept in the user index,
+    like geant_reader::generate_pseudojets does
+ */
+
+#include "fastjet/PseudoJet.hh"
+
+#include <random>
+#include <vector>
+
+#ifndef GENERATOR_DETECTOR_RESPONSE_HH
+#define GENERATOR_DETECTOR_RESPONSE_HH
+
+class detector_response {
+
+public:
+
+  /** track_efficiency:  probability a charged particle is reconstructed
+      track_resolution:  relative track pt resolution, sigma(pt)/pt
+      tower_resolution:  stochastic tower term, sigma(E)/E = a/sqrt(E)
+      vz_sigma:          width of the vertex z distribution, in cm
+      the seed fixes the sequence of responses
+   */
+  detector_response( double track_efficiency = 0.85, double track_resolution = 0.01,
+                     double tower_resolution = 0.16, double vz_sigma = 15.0,
+                     unsigned seed = 42 );
+
+  /** default destructor */
+  ~detector_response() {};
+
+  /** the acceptance of the tracking & the BEMC */
+  static constexpr double track_eta_max = 1.0;
+  static constexpr double tower_eta_max = 1.0;
+
+  /** fills detector ( which is cleared first ) with the reconstructed
+      tracks & towers for the truth level particles
+   */
+  void apply( const std::vector<fastjet::PseudoJet>& truth, std::vector<fastjet::PseudoJet>& detector );
+
+  /** draws a primary vertex z position */
+  double vertex_z();
+
+  double track_efficiency() const  { return track_efficiency_; }
+  double track_resolution() const  { return track_resolution_; }
+  double tower_resolution() const  { return tower_resolution_; }
+
+private:
+
+  double track_efficiency_;
+  double track_resolution_;
+  double tower_resolution_;
+  double vz_sigma_;
+
+  std::mt19937 rng_;
+
+};
+
+#endif // GENERATOR_DETECTOR_RESPONSE_HH
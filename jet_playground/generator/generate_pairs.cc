@@ -0,0 +1,191 @@
+// generates paired geant-like & pythia events for load testing:
+// pp collisions at sqrt(s) = 200 GeV from pythia 8 in a set of pt-hat
+// bins, passed through a parametrized detector response, and written as
+// picoDst_<lo>_<hi>_<n>.root files in the TStarJetPico layout, so that
+// process_geant, plan_shards & merge_shards run on them unchanged
+
+#include "detector_response.hh"
+#include "pico_writer.hh"
+
+#include "Pythia8/Pythia.h"
+
+#include "TSystem.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <exception>
+
+/** a pt-hat bin, parsed from "lo_hi" */
+struct pt_hat_bin {
+  int lo, hi;
+  std::string name() const { std::ostringstream name; name << "picoDst_" << lo << "_" << hi; return name.str(); }
+};
+
+/** the run ids are 1BBBFFFF: B the bin index, F the file index in the bin.
+    eventID is the run id followed by the event id as a string, so every
+    run id has the same number of digits - otherwise run 1001 event 12
+    and run 10011 event 2 would be the same event
+ */
+const int max_bins = 1000;
+const long long max_files_per_bin = 10000;
+int make_run_id( unsigned bin, int file_idx ) { return 10000000 + 10000 * bin + file_idx; }
+
+/** pythia.next() failing this many times in a row is an error,
+    rather than a loop that never ends
+ */
+const int max_failures = 1000;
+
+/** parses a comma separated list of bins, "5_7,25_35" */
+std::vector<pt_hat_bin> parse_bins( const std::string& list );
+
+/** fills particles with the visible final state of the pythia event,
+    with the charge in the user index
+ */
+void final_state( const Pythia8::Event& event, std::vector<fastjet::PseudoJet>& particles );
+
+int main( int argc, const char** argv ) {
+
+  /** generate_pairs takes the output directory, followed by --key value options -
+       --bins:             pt-hat bins ( default 5_7,15_25,25_35,45_55 )
+       --events:           events per bin ( default 10000 )
+       --events-per-file:  events per output file ( default 5000 )
+       --seed:             random seed for pythia & the detector response ( default 1 )
+       --efficiency:       tracking efficiency ( default 0.85 )
+       --resolution:       relative track pt resolution ( default 0.01 )
+       --tower-resolution: stochastic tower energy resolution ( default 0.16 )
+       --vz-sigma:         vertex z spread in cm ( default 15 )
+       --energy:           center of mass energy in GeV ( default 200 )
+   */
+  if ( argc < 2 || argc % 2 != 0 ) {
+    std::cerr << "usage: generate_pairs output_dir [--key value] ..." << std::endl;
+    return -1;
+  }
+
+  std::string output              = argv[1];
+  std::vector<pt_hat_bin> bins    = parse_bins( "5_7,15_25,25_35,45_55" );
+  long long n_events              = 10000;
+  long long events_per_file       = 5000;
+  int seed                        = 1;
+  double efficiency               = 0.85;
+  double resolution               = 0.01;
+  double tower_resolution         = 0.16;
+  double vz_sigma                 = 15.0;
+  double energy                   = 200.0;
+
+  for ( int i = 2; i + 1 < argc; i += 2 ) {
+    std::string key = argv[i];
+    std::string value = argv[i+1];
+    if ( key == "--bins" )                  bins = parse_bins( value );
+    else if ( key == "--events" )           n_events = std::stoll( value );
+    else if ( key == "--events-per-file" )  events_per_file = std::stoll( value );
+    else if ( key == "--seed" )             seed = std::stoi( value );
+    else if ( key == "--efficiency" )       efficiency = std::stod( value );
+    else if ( key == "--resolution" )       resolution = std::stod( value );
+    else if ( key == "--tower-resolution" ) tower_resolution = std::stod( value );
+    else if ( key == "--vz-sigma" )         vz_sigma = std::stod( value );
+    else if ( key == "--energy" )           energy = std::stod( value );
+    else { std::cerr << "unknown option: " << key << std::endl; return -1; }
+  }
+  if ( bins.empty() || n_events <= 0 || events_per_file <= 0 ) { std::cerr << "Error: nothing to generate" << std::endl; return -1; }
+  if ( bins.size() > unsigned( max_bins ) || ( n_events + events_per_file - 1 ) / events_per_file > max_files_per_bin ) {
+    std::cerr << "Error: at most " << max_bins << " bins of " << max_files_per_bin
+              << " files each, so that the run ids stay unique" << std::endl;
+    return -1;
+  }
+
+  gSystem->mkdir( output.c_str(), true );
+
+  // every file is listed, so the output can be handed straight to
+  // process_geant or plan_shards, and the generated cross sections are
+  // written as xsec:: lines that can be added to the reader settings
+  std::ofstream file_list( output + "/files.list" );
+  std::ofstream xsec( output + "/xsec.txt" );
+  xsec << "# generated cross sections ( mb ) - add these to the reader settings\n";
+
+  std::vector<fastjet::PseudoJet> truth, detector;
+
+  for ( unsigned b = 0; b < bins.size(); ++b ) {
+    const pt_hat_bin& bin = bins[b];
+
+    Pythia8::Pythia pythia;
+    pythia.readString( "Beams:eCM = " + std::to_string( energy ) );
+    pythia.readString( "HardQCD:all = on" );
+    pythia.readString( "PhaseSpace:pTHatMin = " + std::to_string( bin.lo ) );
+    pythia.readString( "PhaseSpace:pTHatMax = " + std::to_string( bin.hi ) );
+    pythia.readString( "Random:setSeed = on" );
+    pythia.readString( "Random:seed = " + std::to_string( seed + b ) );
+    pythia.readString( "Next:numberCount = 0" );
+    if ( !pythia.init() ) { std::cerr << "Error: pythia failed to initialize for bin " << bin.name() << std::endl; return -1; }
+
+    detector_response response( efficiency, resolution, tower_resolution, vz_sigma, seed + b );
+
+    std::unique_ptr<pico_writer> writer;
+    int file_idx = 0;
+    long long n_generated = 0;
+    int n_failures = 0;
+    while ( n_generated < n_events ) {
+      if ( !pythia.next() ) {
+        if ( ++n_failures < max_failures ) continue;
+        std::cerr << "Error: pythia failed to generate " << max_failures << " events in a row in bin "
+                  << bin.name() << std::endl;
+        return -1;
+      }
+      n_failures = 0;
+
+      if ( !writer || writer->entries() >= events_per_file ) {
+        if ( writer ) writer->close();
+        std::ostringstream name;
+        name << output << "/" << bin.name() << "_" << file_idx << ".root";
+        writer.reset( new pico_writer( name.str() ) );
+        file_list << name.str() << "\n";
+        ++file_idx;
+      }
+
+      final_state( pythia.event, truth );
+      response.apply( truth, detector );
+
+      // run ids are unique per file ( the index in its name ), so event
+      // ids are unique per run
+      int run_id = make_run_id( b, file_idx - 1 );
+      writer->write( detector, truth, run_id, writer->entries(), response.vertex_z() );
+      ++n_generated;
+    }
+    writer->close();
+
+    xsec << "xsec::" << bin.name() << " = " << pythia.info.sigmaGen() << ", " << n_generated << "\n";
+    std::cout << "bin " << bin.name() << ": " << n_generated << " events in " << file_idx << " files, sigma = "
+              << pythia.info.sigmaGen() << " mb" << std::endl;
+  }
+
+  return 0;
+}
+
+std::vector<pt_hat_bin> parse_bins( const std::string& list ) {
+  std::vector<pt_hat_bin> bins;
+  std::stringstream stream( list );
+  std::string value;
+  while ( std::getline( stream, value, ',' ) ) {
+    if ( value.empty() ) continue;
+    std::string::size_type split = value.find( '_' );
+    if ( split == std::string::npos ) { std::cerr << "Error: pt-hat bins are lo_hi, got " << value << std::endl; throw std::exception(); }
+    pt_hat_bin bin;
+    bin.lo = std::stoi( value.substr( 0, split ) );
+    bin.hi = std::stoi( value.substr( split + 1 ) );
+    bins.push_back( bin );
+  }
+  return bins;
+}
+
+void final_state( const Pythia8::Event& event, std::vector<fastjet::PseudoJet>& particles ) {
+  particles.clear();
+  for ( int i = 0; i < event.size(); ++i ) {
+    if ( !event[i].isFinal() || !event[i].isVisible() ) continue;
+    fastjet::PseudoJet particle( event[i].px(), event[i].py(), event[i].pz(), event[i].e() );
+    // chargeType is three times the charge
+    particle.set_user_index( event[i].chargeType() / 3 );
+    particles.push_back( particle );
+  }
+}
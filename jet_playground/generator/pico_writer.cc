@@ -0,0 +1,111 @@
+// implementation for pico_writer
+
+#include "pico_writer.hh"
+
+#include "TStarJetPicoEventHeader.h"
+#include "TStarJetPicoPrimaryTrack.h"
+#include "TStarJetPicoTower.h"
+
+#include <cmath>
+#include <exception>
+#include <iostream>
+
+namespace {
+  /** the BEMC has 40 towers in eta ( -1 < eta < 1 ) by 120 in phi */
+  const int bemc_eta_bins = 40;
+  const int bemc_phi_bins = 120;
+  const double pi = 3.14159265358979;
+
+  int tower_id( double eta, double phi ) {
+    int eta_bin = std::min( bemc_eta_bins - 1, std::max( 0, int( ( eta + 1.0 ) / 2.0 * bemc_eta_bins ) ) );
+    int phi_bin = std::min( bemc_phi_bins - 1, std::max( 0, int( ( phi + pi ) / ( 2.0 * pi ) * bemc_phi_bins ) ) );
+    return 1 + eta_bin * bemc_phi_bins + phi_bin;
+  }
+}
+
+pico_writer::pico_writer( const std::string& file_name ) : file_(), geant_tree_(nullptr), pythia_tree_(nullptr),
+              geant_event_( new TStarJetPicoEvent() ), pythia_event_( new TStarJetPicoEvent() ), entries_(0) {
+  file_.reset( new TFile( file_name.c_str(), "RECREATE" ) );
+  if ( file_->IsZombie() ) { std::cerr << "Error: can't create " << file_name << std::endl; throw std::exception(); }
+
+  geant_tree_ = new TTree( "JetTree", "synthetic geant events" );
+  pythia_tree_ = new TTree( "JetTreeMc", "synthetic pythia events" );
+  geant_tree_->Branch( "PicoJetTree", "TStarJetPicoEvent", &geant_event_ );
+  pythia_tree_->Branch( "PicoJetTree", "TStarJetPicoEvent", &pythia_event_ );
+}
+
+pico_writer::~pico_writer() {
+  if ( file_ ) close();
+  delete geant_event_;
+  delete pythia_event_;
+}
+
+void pico_writer::write( const std::vector<fastjet::PseudoJet>& detector,
+                         const std::vector<fastjet::PseudoJet>& truth,
+                         int run_id, int event_id, double vz ) {
+  fill_event( geant_event_, detector, run_id, event_id, vz );
+  fill_event( pythia_event_, truth, run_id, event_id, vz );
+  geant_tree_->Fill();
+  pythia_tree_->Fill();
+  ++entries_;
+}
+
+void pico_writer::close() {
+  if ( !file_ ) return;
+  file_->cd();
+  geant_tree_->Write( "", TObject::kOverwrite );
+  pythia_tree_->Write( "", TObject::kOverwrite );
+  file_->Close();
+  // the trees belong to the file
+  file_.reset();
+}
+
+void pico_writer::fill_event( TStarJetPicoEvent* event, const std::vector<fastjet::PseudoJet>& particles,
+                              int run_id, int event_id, double vz ) {
+  event->Clear();
+
+  int n_tracks = 0, n_towers = 0, refmult = 0;
+  for ( unsigned i = 0; i < particles.size(); ++i ) {
+    const fastjet::PseudoJet& particle = particles[i];
+    double phi = particle.phi_std();
+
+    if ( particle.user_index() != 0 ) {
+      // tracks are given quality values that pass the geant track cuts
+      TStarJetPicoPrimaryTrack track;
+      track.SetPx( particle.px() );
+      track.SetPy( particle.py() );
+      track.SetPz( particle.pz() );
+      track.SetEta( particle.eta() );
+      track.SetPhi( phi );
+      track.SetCharge( particle.user_index() );
+      track.SetDCA( 0.5 );
+      track.SetNOfFittPoints( 40 );
+      track.SetNOfPossPoints( 45 );
+      event->AddPrimaryTrack( &track );
+      ++n_tracks;
+      if ( std::fabs( particle.eta() ) < 0.5 ) ++refmult;
+      continue;
+    }
+
+    // the BEMC acceptance is applied by detector_response - the truth
+    // event keeps its neutral particles at every eta
+    TStarJetPicoTower tower;
+    tower.SetId( tower_id( particle.eta(), phi ) );
+    tower.SetEnergy( particle.E() );
+    tower.SetEta( particle.eta() );
+    tower.SetPhi( phi );
+    tower.SetEtaCorrected( particle.eta() );
+    tower.SetPhiCorrected( phi );
+    event->AddTower( &tower );
+    ++n_towers;
+  }
+
+  TStarJetPicoEventHeader* header = event->GetHeader();
+  header->SetRunId( run_id );
+  header->SetEventId( event_id );
+  header->SetPrimaryVertexZ( vz );
+  header->SetvpdVz( vz );
+  header->SetReferenceMultiplicity( refmult );
+  header->SetNOfPrimaryTracks( n_tracks );
+  header->SetNOfTowers( n_towers );
+}
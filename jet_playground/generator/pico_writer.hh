@@ -0,0 +1,61 @@
+/*  Writes paired detector & particle level events to a file in the
+    TStarJetPico layout: a JetTree ( geant ) and a JetTreeMc ( pythia )
+    tree with the same number of entries, one TStarJetPicoEvent per
+    entry in the PicoJetTree branch. Charged particles are stored as
+    primary tracks, neutral particles as BEMC towers, so that the files
+    can be read by geant_reader exactly like the simulation output
+ */
+
+#include "fastjet/PseudoJet.hh"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TStarJetPicoEvent.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef GENERATOR_PICO_WRITER_HH
+#define GENERATOR_PICO_WRITER_HH
+
+class pico_writer {
+
+public:
+
+  /** opens ( and overwrites ) file_name. Throws if it can't be created */
+  pico_writer( const std::string& file_name );
+
+  /** closes the file, if close() wasn't called */
+  ~pico_writer();
+
+  /** adds one paired entry to both trees - the geant & pythia
+      events share the run & event id and the vertex
+   */
+  void write( const std::vector<fastjet::PseudoJet>& detector,
+              const std::vector<fastjet::PseudoJet>& truth,
+              int run_id, int event_id, double vz );
+
+  /** writes the trees & closes the file */
+  void close();
+
+  long long entries() const { return entries_; }
+
+private:
+
+  std::unique_ptr<TFile> file_;
+  TTree* geant_tree_;
+  TTree* pythia_tree_;
+  TStarJetPicoEvent* geant_event_;
+  TStarJetPicoEvent* pythia_event_;
+  long long entries_;
+
+  /** fills a TStarJetPicoEvent from a list of particles, as they are -
+      the acceptance is up to the caller
+   */
+  void fill_event( TStarJetPicoEvent* event, const std::vector<fastjet::PseudoJet>& particles,
+                   int run_id, int event_id, double vz );
+
+};
+
+#endif // GENERATOR_PICO_WRITER_HH
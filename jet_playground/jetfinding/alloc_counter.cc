@@ -0,0 +1,48 @@
+// implementation for alloc_counter
+
+#include "alloc_counter.hh"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+  
+  /** a plain integer, so it needs no dynamic initialization -
+      operator new can be called before main() */
+  thread_local unsigned long long n_allocations = 0;
+  
+  void* counted_alloc( std::size_t size ) {
+    ++n_allocations;
+    return std::malloc( size == 0 ? 1 : size );
+  }
+  
+}
+
+unsigned long long alloc_counter::count() {
+  return n_allocations;
+}
+
+void* operator new( std::size_t size ) {
+  void* ptr = counted_alloc( size );
+  if ( ptr == nullptr ) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[]( std::size_t size ) {
+  void* ptr = counted_alloc( size );
+  if ( ptr == nullptr ) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new( std::size_t size, const std::nothrow_t& ) noexcept {
+  return counted_alloc( size );
+}
+
+void* operator new[]( std::size_t size, const std::nothrow_t& ) noexcept {
+  return counted_alloc( size );
+}
+
+void operator delete( void* ptr ) noexcept                         { std::free( ptr ); }
+void operator delete[]( void* ptr ) noexcept                       { std::free( ptr ); }
+void operator delete( void* ptr, const std::nothrow_t& ) noexcept  { std::free( ptr ); }
+void operator delete[]( void* ptr, const std::nothrow_t& ) noexcept { std::free( ptr ); }
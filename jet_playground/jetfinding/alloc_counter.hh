@@ -0,0 +1,21 @@
+/*  Counts heap allocations made by the current thread. The global
+    operator new is replaced ( in alloc_counter.cc ) by a thin wrapper
+    around malloc that bumps a thread local counter, so any code that
+    links alloc_counter.cc can measure how many allocations a section
+    of the event loop makes - e.g. to check that the particle buffers
+    have stopped growing.
+ */
+
+#ifndef JETFINDING_ALLOC_COUNTER_HH
+#define JETFINDING_ALLOC_COUNTER_HH
+
+namespace alloc_counter {
+  
+  /** number of calls to operator new ( all forms ) made
+      by the calling thread since it started
+   */
+  unsigned long long count();
+  
+}
+
+#endif // JETFINDING_ALLOC_COUNTER_HH
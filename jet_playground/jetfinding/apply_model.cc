@@ -0,0 +1,120 @@
+// applies a correction model exported by models/export_model.py to
+// a tree written by process_geant ( training, or the validation & test
+// partitions ), and writes the predicted pt of every jet to a tree with
+// the same number of entries, so it can be added as a friend:
+// training->AddFriend( "correction", output ). The features are the per
+// jet branches process_geant writes with --features true ( the default ),
+// so the input must come from a process_geant that writes all of them -
+// older output has no ncharge or charge_frac
+
+#include "correction_model.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TLeaf.h"
+
+int main( int argc, const char** argv ) {
+
+  /** apply_model takes 2 to 5 arguments -
+   [1]: the exported model
+   [2]: a process_geant output file ( the model's features are read
+        from the leaves of the tree with the same names )
+   [3]: the output file ( default: the input, with _corrected.root )
+   [4]: the name of the prediction branch ( default: corrected_pt )
+   [5]: the tree to apply the model to - training, validation or test
+        ( default: training )
+   */
+
+  std::string model_file, input_file, output_file, branch = "corrected_pt", tree_name = "training";
+
+  switch ( argc ) {
+    case 6 :
+      tree_name = argv[5];
+    case 5 :
+      branch = argv[4];
+    case 4 :
+      output_file = argv[3];
+    case 3 :
+      model_file = argv[1];
+      input_file = argv[2];
+      break;
+    default :
+      std::cerr << "usage: apply_model model input.root [output.root] [branch] [tree]" << std::endl;
+      return -1;
+  }
+  if ( output_file == "" ) {
+    output_file = input_file;
+    if ( output_file.size() > 5 && output_file.compare( output_file.size() - 5, 5, ".root" ) == 0 )
+      output_file.resize( output_file.size() - 5 );
+    output_file += "_corrected.root";
+  }
+
+  correction_model model;
+  if ( !model.load( model_file ) ) return -1;
+
+  TFile input( input_file.c_str(), "READ" );
+  TTree* tree = input.IsZombie() ? nullptr : (TTree*) input.Get( tree_name.c_str() );
+  if ( tree == nullptr ) { std::cerr << "Error: no " << tree_name << " tree in " << input_file << std::endl; return -1; }
+
+  /** only the feature branches are read */
+  const std::vector<std::string>& features = model.features();
+  std::vector<TLeaf*> leaves;
+  tree->SetBranchStatus( "*", false );
+  for ( unsigned i = 0; i < features.size(); ++i ) {
+    TLeaf* leaf = tree->GetLeaf( features[i].c_str() );
+    if ( leaf == nullptr ) { std::cerr << "Error: the " << tree_name << " tree has no " << features[i] << " leaf - "
+                                       << "was it written by an older process_geant, or with --features false?" << std::endl;
+                             return -1; }
+    tree->SetBranchStatus( leaf->GetBranch()->GetName(), true );
+    leaves.push_back( leaf );
+  }
+
+  TFile output( output_file.c_str(), "RECREATE" );
+  if ( output.IsZombie() ) { std::cerr << "Error: can't open " << output_file << std::endl; return -1; }
+  // the tree belongs to the output file, which deletes it on Close()
+  TTree* correction = new TTree( "correction", ( "model predictions for the " + tree_name + " tree" ).c_str() );
+  Double_t prediction = 0;
+  correction->Branch( branch.c_str(), &prediction, ( branch + "/D" ).c_str() );
+
+  /** the entries are read & predicted in batches, so that the model
+      runs over many rows at a time
+   */
+  const Long64_t batch = 4096;
+  const Long64_t n_entries = tree->GetEntries();
+  std::vector<double> rows( batch * features.size() );
+  std::vector<double> predictions( batch );
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for ( Long64_t first = 0; first < n_entries; first += batch ) {
+    Long64_t n = std::min( batch, n_entries - first );
+    for ( Long64_t i = 0; i < n; ++i ) {
+      tree->GetEntry( first + i );
+      for ( unsigned j = 0; j < leaves.size(); ++j )
+        rows[i * features.size() + j] = leaves[j]->GetValue();
+    }
+
+    model.predict( rows.data(), n, predictions.data() );
+
+    for ( Long64_t i = 0; i < n; ++i ) {
+      prediction = predictions[i];
+      correction->Fill();
+    }
+  }
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+  output.cd();
+  correction->Write();
+  output.Close();
+
+  std::cout << "applied " << model_file << " to " << n_entries << " jets in " << seconds << " s";
+  if ( seconds > 0 ) std::cout << ": " << n_entries / seconds << " jets/s";
+  std::cout << std::endl << "wrote " << branch << " to " << output_file << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+// implementation for checkpoint
+
+#include "checkpoint.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+bool checkpoint::read( const std::string& path ) {
+  std::ifstream in( path );
+  if ( !in.is_open() ) return false;
+  
+  outputs.clear();
+  train_entries.clear();
+  event_entries.clear();
+  
+  bool has_entry = false;
+  std::string line;
+  while ( std::getline( in, line ) ) {
+    std::istringstream tokens( line );
+    std::string key;
+    tokens >> key;
+    if ( key == "entry" ) has_entry = bool( tokens >> entry );
+    else if ( key == "from_resume_files" ) tokens >> from_resume_files;
+    else if ( key == "output" ) {
+      std::string name;
+      long long n_train, n_event;
+      if ( !( tokens >> name >> n_train >> n_event ) ) return false;
+      outputs.push_back( name );
+      train_entries.push_back( n_train );
+      event_entries.push_back( n_event );
+    }
+  }
+  return has_entry && !outputs.empty();
+}
+
+bool checkpoint::write( const std::string& path ) const {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out( tmp );
+    if ( !out.is_open() ) return false;
+    out << "entry " << entry << "\n";
+    out << "from_resume_files " << from_resume_files << "\n";
+    for ( unsigned i = 0; i < outputs.size(); ++i )
+      out << "output " << outputs[i] << " " << train_entries[i] << " " << event_entries[i] << "\n";
+    out.flush();
+    if ( !out ) return false;
+  }
+  return std::rename( tmp.c_str(), path.c_str() ) == 0;
+}
@@ -0,0 +1,43 @@
+/*  The state needed to resume an interrupted run: the next chain
+    entry to process, and for every output file the number of tree
+    entries that were safely on disk ( AutoSaved ) at that point. It is
+    stored as a small text file next to the output, and replaced
+    atomically, so a job killed at any time leaves either the old or
+    the new checkpoint behind - never a partial one.
+ */
+
+#include <string>
+#include <vector>
+
+#ifndef JETFINDING_CHECKPOINT_HH
+#define JETFINDING_CHECKPOINT_HH
+
+struct checkpoint {
+  
+  checkpoint() : entry(0), from_resume_files(false), outputs(), train_entries(), event_entries() {};
+  
+  /** the next chain entry to process */
+  long long entry;
+  
+  /** false: the checkpointed entries are in the output files themselves.
+      true: a resumed run has moved them to <output>.resume, and has not
+      reached its own first checkpoint yet
+   */
+  bool from_resume_files;
+  
+  /** per output file: its name, and the training & event tree entries */
+  std::vector<std::string> outputs;
+  std::vector<long long> train_entries;
+  std::vector<long long> event_entries;
+  
+  /** reads the checkpoint from path - returns false if there
+      is no checkpoint, or it is malformed
+   */
+  bool read( const std::string& path );
+  
+  /** writes to a temporary file, and renames it over path */
+  bool write( const std::string& path ) const;
+  
+};
+
+#endif // JETFINDING_CHECKPOINT_HH
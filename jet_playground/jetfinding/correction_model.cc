@@ -0,0 +1,168 @@
+// implementation for correction_model
+
+#include "correction_model.hh"
+
+#include "base.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace {
+  /** rows per block - the terms of a block stay in L1/L2 while
+      every tree is applied to it
+   */
+  const unsigned block_rows = 256;
+}
+
+correction_model::correction_model() : type_( model_linear ), features_(), n_terms_(0), powers_(),
+              intercept_(0.0), coefficients_(), nodes_(), roots_(), terms_() { }
+
+bool correction_model::load( const std::string& path ) {
+  std::ifstream in( path );
+  if ( !in.is_open() ) { __ERR( "can't open the model " << path ) return false; }
+
+  features_.clear();
+  powers_.clear();
+  coefficients_.clear();
+  nodes_.clear();
+  roots_.clear();
+
+  std::string key, type;
+  int version = 0;
+  if ( !( in >> key >> version ) || key != "jet_model" || version != 1 ) {
+    __ERR( path << " is not a jet_model version 1 file" ) return false;
+  }
+
+  if ( !( in >> key >> type ) || key != "type" ) { __ERR( path << ": expected the model type" ) return false; }
+  if      ( type == "linear" ) type_ = model_linear;
+  else if ( type == "tree" )   type_ = model_tree;
+  else if ( type == "forest" ) type_ = model_forest;
+  else { __ERR( path << ": unknown model type " << type ) return false; }
+
+  unsigned n_features = 0;
+  if ( !( in >> key >> n_features ) || key != "features" || n_features == 0 ) {
+    __ERR( path << ": expected the feature list" ) return false;
+  }
+  features_.resize( n_features );
+  for ( unsigned i = 0; i < n_features; ++i ) in >> features_[i];
+
+  if ( !( in >> key >> n_terms_ ) || key != "terms" || n_terms_ == 0 ) {
+    __ERR( path << ": expected the polynomial terms" ) return false;
+  }
+  powers_.resize( n_terms_ * n_features );
+  for ( unsigned i = 0; i < powers_.size(); ++i ) in >> powers_[i];
+  if ( !in || *std::min_element( powers_.begin(), powers_.end() ) < 0 ) {
+    __ERR( path << ": malformed polynomial terms" ) return false;
+  }
+
+  if ( type_ == model_linear ) {
+    unsigned n_coefficients = 0;
+    if ( !( in >> key >> intercept_ ) || key != "intercept" ||
+         !( in >> key >> n_coefficients ) || key != "coefficients" || n_coefficients != n_terms_ ) {
+      __ERR( path << ": expected the intercept & one coefficient per term" ) return false;
+    }
+    coefficients_.resize( n_coefficients );
+    for ( unsigned i = 0; i < n_coefficients; ++i ) in >> coefficients_[i];
+    if ( !in ) { __ERR( path << ": malformed coefficients" ) return false; }
+    return true;
+  }
+
+  unsigned n_trees = 0;
+  if ( !( in >> key >> n_trees ) || key != "trees" || n_trees == 0 || ( type_ == model_tree && n_trees != 1 ) ) {
+    __ERR( path << ": expected the number of trees" ) return false;
+  }
+  for ( unsigned i = 0; i < n_trees; ++i )
+    if ( !read_tree( in ) ) { __ERR( path << ": malformed tree " << i ) return false; }
+  return true;
+}
+
+bool correction_model::read_tree( std::istream& in ) {
+  std::string key;
+  unsigned count = 0;
+  if ( !( in >> key >> count ) || key != "nodes" || count == 0 ) return false;
+
+  std::vector<int> left( count ), right( count ), term( count );
+  std::vector<double> threshold( count ), value( count );
+  for ( unsigned i = 0; i < count; ++i )
+    in >> left[i] >> right[i] >> term[i] >> threshold[i] >> value[i];
+  if ( !in ) return false;
+
+  // lay the tree out breadth first, allocating the two children of a
+  // split as a pair - every sklearn node is placed exactly once
+  std::vector<char> placed( count, 0 );
+  std::vector<std::pair<int, unsigned> > queue( 1, std::make_pair( 0, unsigned( nodes_.size() ) ) );
+  roots_.push_back( nodes_.size() );
+  nodes_.push_back( node() );
+  for ( unsigned q = 0; q < queue.size(); ++q ) {
+    int old = queue[q].first;
+    unsigned idx = queue[q].second;
+    if ( old < 0 || unsigned( old ) >= count || placed[old] ) return false;
+    placed[old] = 1;
+
+    if ( left[old] == -1 ) {
+      node leaf = { -1, 0, value[old] };
+      nodes_[idx] = leaf;
+      continue;
+    }
+    if ( term[old] < 0 || unsigned( term[old] ) >= n_terms_ ) return false;
+
+    unsigned children = nodes_.size();
+    nodes_.resize( children + 2 );
+    node split = { term[old], int32_t( children ), threshold[old] };
+    nodes_[idx] = split;
+    queue.push_back( std::make_pair( left[old], children ) );
+    queue.push_back( std::make_pair( right[old], children + 1 ) );
+  }
+  return true;
+}
+
+void correction_model::predict( const double* rows, unsigned n, double* out ) {
+  const unsigned n_features = features_.size();
+  terms_.resize( block_rows * n_terms_ );
+
+  for ( unsigned start = 0; start < n; start += block_rows ) {
+    const unsigned m = std::min( block_rows, n - start );
+
+    // the polynomial terms of the block, as PolynomialFeatures computes them
+    for ( unsigned r = 0; r < m; ++r ) {
+      const double* x = rows + size_t( start + r ) * n_features;
+      double* t = &terms_[r * n_terms_];
+      for ( unsigned j = 0; j < n_terms_; ++j ) {
+        double product = 1.0;
+        const int* powers = &powers_[j * n_features];
+        for ( unsigned f = 0; f < n_features; ++f )
+          for ( int p = 0; p < powers[f]; ++p ) product *= x[f];
+        t[j] = product;
+      }
+    }
+
+    double* y = out + start;
+    if ( type_ == model_linear ) {
+      for ( unsigned r = 0; r < m; ++r ) {
+        const double* t = &terms_[r * n_terms_];
+        double sum = intercept_;
+        for ( unsigned j = 0; j < n_terms_; ++j ) sum += coefficients_[j] * t[j];
+        y[r] = sum;
+      }
+      continue;
+    }
+
+    // one tree at a time over the whole block. sklearn compares the
+    // features as floats, so the terms are rounded the same way
+    std::fill( y, y + m, 0.0 );
+    const node* nodes = nodes_.data();
+    for ( unsigned tree = 0; tree < roots_.size(); ++tree ) {
+      for ( unsigned r = 0; r < m; ++r ) {
+        const double* t = &terms_[r * n_terms_];
+        unsigned idx = roots_[tree];
+        while ( nodes[idx].term >= 0 )
+          idx = nodes[idx].left + ( double( float( t[nodes[idx].term] ) ) > nodes[idx].threshold );
+        y[r] += nodes[idx].threshold;
+      }
+    }
+    if ( roots_.size() > 1 )
+      for ( unsigned r = 0; r < m; ++r ) y[r] /= roots_.size();
+  }
+}
@@ -0,0 +1,96 @@
+/*  Applies the jet pt correction models trained in models/ ( linear
+    regression, decision tree & random forest ) in C++, so corrected pt
+    can be produced without a round trip through python. The models are
+    exported by models/export_model.py to a small text format:
+
+      jet_model 1
+      type linear | tree | forest
+      features <n> <name> ...           the input columns, in order
+      terms <m>                         the polynomial features the model
+      <n exponents> x m                 was trained on ( PolynomialFeatures'
+                                        powers_ - one line per term )
+    linear:
+      intercept <value>
+      coefficients <m> <value> ...
+    tree & forest:
+      trees <k>
+      nodes <count>                     per tree, in sklearn's node order:
+      <left> <right> <term> <threshold> <value> x count
+                                        left = -1 for a leaf
+
+    All of the trees are flattened into one node array when loaded, with
+    the two children of every node next to each other, so that a descent
+    is a single indexed load per level with no branch on the direction.
+ */
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#ifndef JETFINDING_CORRECTION_MODEL_HH
+#define JETFINDING_CORRECTION_MODEL_HH
+
+class correction_model {
+
+public:
+
+  enum model_type { model_linear, model_tree, model_forest };
+
+  correction_model();
+
+  /** default destructor */
+  ~correction_model() {};
+
+  /** reads an exported model - returns false ( with an error
+      message ) if the file is missing or malformed
+   */
+  bool load( const std::string& path );
+
+  model_type type() const                           { return type_; }
+
+  /** the input columns each row must hold, in order */
+  const std::vector<std::string>& features() const  { return features_; }
+
+  /** predicts n rows - row major, features().size() values per row -
+      into out. The rows are processed in blocks: the polynomial terms of
+      a block are computed once, then each tree is applied to the whole
+      block while it is in cache. Gives the same values as the model's
+      predict() in sklearn, up to the rounding of the linear sums
+   */
+  void predict( const double* rows, unsigned n, double* out );
+
+private:
+
+  /** a tree node: for a split, term & threshold, with the children at
+      left & left + 1 ( rows with term <= threshold go left ). For a leaf,
+      term is -1 and threshold holds the prediction
+   */
+  struct node {
+    int32_t term;
+    int32_t left;
+    double threshold;
+  };
+
+  model_type type_;
+  std::vector<std::string> features_;
+
+  /** the polynomial terms: powers_[term * features + feature] */
+  unsigned n_terms_;
+  std::vector<int> powers_;
+
+  double intercept_;
+  std::vector<double> coefficients_;
+
+  std::vector<node> nodes_;
+  std::vector<unsigned> roots_;
+
+  /** the terms of the current block, block_rows x n_terms_ */
+  std::vector<double> terms_;
+
+  /** reads one tree in sklearn's layout, and appends it to nodes_ */
+  bool read_tree( std::istream& in );
+
+};
+
+#endif // JETFINDING_CORRECTION_MODEL_HH
@@ -1,12 +1,19 @@
 
 #include "event.hh"
+#include "alloc_counter.hh"
 
 #include "TSystem.h"
 
-#include "fastjet/ClusterSequenceArea.hh"
+#include "fastjet/ClusterSequence.hh"
 
+#include <algorithm>
+#include <cstdio>
 #include <exception>
 #include <functional>
+#include <memory>
+#include <sstream>
+
+#include <unistd.h>
 
 TLorentzVector ConvertPseudoJet(const fastjet::PseudoJet& jet) {
   TLorentzVector tmp;
@@ -14,193 +21,728 @@ TLorentzVector ConvertPseudoJet(const fastjet::PseudoJet& jet) {
   return tmp;
 }
 
+namespace {
+  /** copies the momentum & the charge ( the user index ) only - the copy
+      shares nothing with the cluster sequence, so it can be handed to the
+      writer thread ( fastjet's reference counts are not thread safe )
+   */
+  void copy_momentum( const fastjet::PseudoJet& jet, fastjet::PseudoJet& copy ) {
+    copy.reset_momentum( jet );
+    copy.set_user_index( jet.user_index() );
+  }
+
+  void copy_momenta( const std::vector<fastjet::PseudoJet>& jets, std::vector<fastjet::PseudoJet>& copies ) {
+    copies.resize( jets.size() );
+    for ( unsigned i = 0; i < jets.size(); ++i )
+      copy_momentum( jets[i], copies[i] );
+  }
+}
+
 event::event( const std::string& input_file,
               const std::string& settings_doc ) : geant_reader( settings_doc, input_file ),
-              train_data_(nullptr), geant_jets_({}), pythia_jets_({}), geant_jet_(),
-              pythia_jet_(), geant_constituents_(nullptr), pythia_constituents_(nullptr),
-              eventID(0)
+              analyses_(), buffers_(), particle_allocations_(0), prefetch_(0), schema_(schema_object), numpy_width_(64), truncated_jets_(0), features_(true), extra_features_(), partitions_(), partition_( event_partition::train ),
+              stream_(nullptr), output_settings_(), async_depth_(0), writer_(), record_(),
+              branches_(), eventID(0), id_string_(), run_id_(0),
+              event_id_(0), refmult_(0), vz_(0), weight_(1)
 { }
 
 event::~event() {
-  delete train_data_;
+  // the writer fills the trees until its queue is empty
+  writer_.reset();
+  for ( unsigned i = 0; i < analyses_.size(); ++i )
+    delete analyses_[i];
 }
 
-bool event::process_event( const fastjet::JetDefinition& jet_def, const fastjet::AreaDefinition& area_def,
-                          const fastjet::Selector& constituent_selector, const fastjet::Selector jet_selector,
-                          bool charged_jets ) {
-  /** selects if we use the charged or full jet reconstruction */
-  if ( charged_jets ) return process_charged( jet_def, area_def, constituent_selector,
-                                              jet_selector );
-  else                return process_full( jet_def, area_def, constituent_selector,
-                                             jet_selector );
+event::jet_analysis::jet_analysis( const jet_config& config_ ) : config( config_ ), index(0), buffer(0), train_data(nullptr),
+              validation_data(nullptr), test_data(nullptr),
+              geant_jets({}), pythia_jets({}), geant_inclusive(), pythia_inclusive(), constituents(),
+              geant_selected(), pythia_selected(), matcher( config_.jet_def.R(), config_.match ), matches(),
+              matched_geant(), matched_pythia(), geant_jet(), pythia_jet(), geant_constituents(nullptr),
+              pythia_constituents(nullptr), geant_area(0.0), pythia_area(0.0), directory(nullptr), event_data(nullptr),
+              n_matched(0), features(), numpy_path(), numpy_train(), numpy_event(),
+              numpy_validation(), numpy_test()
+{ }
+
+event::jet_analysis::~jet_analysis() {
+  delete train_data;
+  delete validation_data;
+  delete test_data;
+  delete event_data;
 }
 
-bool event::process_full( const fastjet::JetDefinition& jet_def, const fastjet::AreaDefinition& area_def,
-                     const fastjet::Selector& constituent_selector, const fastjet::Selector jet_selector
-                      ) {
+TTree* event::jet_analysis::tree( event_partition::partition p ) {
+  switch ( p ) {
+    case event_partition::train :      return train_data;
+    case event_partition::validation : return validation_data;
+    default :                          return test_data;
+  }
+}
+
+npy_table& event::jet_analysis::table( event_partition::partition p ) {
+  switch ( p ) {
+    case event_partition::train :      return numpy_train;
+    case event_partition::validation : return numpy_validation;
+    default :                          return numpy_test;
+  }
+}
+
+void event::add_config( const jet_config& config ) {
+  analyses_.push_back( new jet_analysis( config ) );
+  analyses_.back()->index = analyses_.size() - 1;
   
-  /* clear any jets from the last event
-     for cleanliness */
-  geant_jets_.clear();
-  pythia_jets_.clear();
+  // configurations with the same constituent cuts share a buffer
+  unsigned buffer = 0;
+  while ( buffer < buffers_.size() && !( buffers_[buffer].cuts == config.cuts ) )
+    ++buffer;
+  if ( buffer == buffers_.size() )
+    buffers_.push_back( particle_buffer( config.cuts ) );
+  analyses_.back()->buffer = buffer;
+}
+
+bool event::process_event() {
   
-  /* clear the constituents */
-  geant_constituents_->Clear();
-  pythia_constituents_->Clear();
+  unsigned long long allocations = alloc_counter::count();
   
-  std::vector<fastjet::PseudoJet> geant_constituents = constituent_selector( geant_pseudojets() );
-  std::vector<fastjet::PseudoJet> pythia_constituents = constituent_selector( pythia_pseudojets() );
+  load_event();
   
-  fastjet::ClusterSequenceArea cluster_geant( geant_constituents, jet_def, area_def );
-  fastjet::ClusterSequenceArea cluster_pythia( pythia_constituents, jet_def, area_def );
+  // the partition only depends on the ids, so it is the
+  // same in every run, configuration & shard
+  partition_ = partitions_.assign( run_id_, event_id_ );
   
-  geant_jets_ = fastjet::sorted_by_pt( jet_selector( cluster_geant.inclusive_jets() ) );
-  pythia_jets_ = fastjet::sorted_by_pt( jet_selector( cluster_pythia.inclusive_jets() ) );
+  // create event ID first - the same string as std::to_string(run_id_) +
+  // std::to_string(event_id_), built in place
+  char id[32];
+  std::snprintf( id, sizeof( id ), "%d%d", run_id_, event_id_ );
+  id_string_.assign( id );
+  std::hash<std::string> hash;
+  eventID = hash(id_string_);
   
-  match_jets( jet_def.R() );
+  bool status = true;
+  unsigned long long n_jets = 0;
+  for ( unsigned i = 0; i < analyses_.size(); ++i ) {
+    status = process_analysis( *analyses_[i] ) && status;
+    n_jets += analyses_[i]->geant_jets.size();
+  }
   
-  fill_tree( constituent_selector );
+  unsigned long long n_particles = 0;
+  for ( unsigned i = 0; i < buffers_.size(); ++i )
+    n_particles += buffers_[i].geant.size() + buffers_[i].pythia.size();
+  stats_.add_event( n_particles, n_jets, alloc_counter::count() - allocations );
   
-  return true;
+  return status;
+}
+
+void event::load_event() {
+  
+  scoped_timer timer( stats_, run_stats::convert );
+  
+  /* build the particle lists once per set of cuts - they are shared
+     by every configuration with those cuts. The cuts are applied as the
+     particles are converted, straight into the reused buffers
+   */
+  event_record* record = current_record();
+  if ( record != nullptr ) {
+    // the prefetch thread has already converted the event - swapping
+    // hands it our old buffers to refill, so nothing is copied
+    for ( unsigned i = 0; i < buffers_.size(); ++i ) {
+      buffers_[i].geant.swap( record->geant[i] );
+      buffers_[i].pythia.swap( record->pythia[i] );
+    }
+    
+    run_id_ = record->run_id;
+    event_id_ = record->event_id;
+    refmult_ = record->refmult;
+    vz_ = record->vz;
+    weight_ = record->weight;
+    return;
+  }
+  
+  unsigned long long allocations = alloc_counter::count();
+  for ( unsigned i = 0; i < buffers_.size(); ++i ) {
+    geant_pseudojets( buffers_[i].geant, buffers_[i].cuts );
+    pythia_pseudojets( buffers_[i].pythia, buffers_[i].cuts );
+  }
+  particle_allocations_ += alloc_counter::count() - allocations;
+  
+  if ( cached() ) {
+    const cache_event& header = cached_header();
+    run_id_ = header.run_id;
+    event_id_ = header.event_id;
+    refmult_ = header.refmult;
+    vz_ = header.vz;
+    weight_ = header.weight;
+    return;
+  }
+  
+  TStarJetPicoEventHeader* header = get_geant_reader().GetEvent()->GetHeader();
+  run_id_ = header->GetRunId();
+  event_id_ = header->GetEventId();
+  refmult_ = header->GetReferenceMultiplicity();
+  vz_ = header->GetPrimaryVertexZ();
+  weight_ = event_weight();
 }
 
-bool event::process_charged( const fastjet::JetDefinition& jet_def, const fastjet::AreaDefinition& area_def,
-                            const fastjet::Selector& constituent_selector, const fastjet::Selector jet_selector
-                             ) {
+bool event::process_analysis( jet_analysis& analysis ) {
   
   /* clear any jets from the last event
-   for cleanliness */
-  geant_jets_.clear();
-  pythia_jets_.clear();
+     for cleanliness */
+  analysis.geant_jets.clear();
+  analysis.pythia_jets.clear();
   
+  const jet_config& config = analysis.config;
   
-  // create a selector that selects all tracks with user index ( charge ) of -1, 1
-  fastjet::Selector charge_selector = SelectorUserIndex( std::vector<int> { -2, -1, 1, 2 } );
+  const std::vector<fastjet::PseudoJet>& geant_constituents = buffers_[analysis.buffer].geant;
+  const std::vector<fastjet::PseudoJet>& pythia_constituents = buffers_[analysis.buffer].pythia;
   
-  std::vector<fastjet::PseudoJet> geant_constituents = charge_selector( constituent_selector( geant_pseudojets() ) );
-  std::vector<fastjet::PseudoJet> pythia_constituents = charge_selector( constituent_selector( pythia_pseudojets() ) );
-   
-  fastjet::ClusterSequenceArea cluster_geant( geant_constituents, jet_def, area_def );
-  fastjet::ClusterSequenceArea cluster_pythia( pythia_constituents, jet_def, area_def );
+  /* the cluster sequence type depends on the area mode - with active
+     areas the ghosts are the shared template held by the configuration.
+     Small events may not need a cluster sequence at all */
+  std::unique_ptr<fastjet::ClusterSequence> cluster_geant;
+  std::unique_ptr<fastjet::ClusterSequence> cluster_pythia;
+  {
+    scoped_timer timer( stats_, run_stats::cluster );
+    cluster( analysis, geant_constituents, cluster_geant, analysis.geant_inclusive );
+    cluster( analysis, pythia_constituents, cluster_pythia, analysis.pythia_inclusive );
+  }
   
-  geant_jets_ = fastjet::sorted_by_pt( jet_selector( cluster_geant.inclusive_jets() ) );
-  pythia_jets_ = fastjet::sorted_by_pt( jet_selector( cluster_pythia.inclusive_jets() ) );
+  {
+    scoped_timer timer( stats_, run_stats::select );
+    config.select_jets( analysis.geant_inclusive, analysis.geant_jets );
+    config.select_jets( analysis.pythia_inclusive, analysis.pythia_jets );
+    // only the leading jet is kept otherwise, so there is no need to sort
+    if ( config.inclusive ) {
+      sort_by_pt( analysis.geant_jets );
+      sort_by_pt( analysis.pythia_jets );
+    }
+  }
   
-  match_jets( jet_def.R() );
+  {
+    scoped_timer timer( stats_, run_stats::match );
+    if ( config.inclusive ) match_jets( analysis );
+    else                    match_leading_jet( analysis );
+  }
+  
+  scoped_timer timer( stats_, run_stats::fill );
   
-  fill_tree( constituent_selector );
+  fill_tree( analysis );
+  
+  // the event tree gets every processed event, so that
+  // the jet rate can be normalized
+  if ( analysis.event_data != nullptr || numpy_output() ) {
+    output_record& record = next_record( analysis, false );
+    record.n_matched = analysis.geant_jets.size();
+    queue_record();
+  }
   
   return true;
 }
 
+void event::cluster( jet_analysis& analysis, const std::vector<fastjet::PseudoJet>& particles,
+                     std::unique_ptr<fastjet::ClusterSequence>& sequence,
+                     std::vector<fastjet::PseudoJet>& jets ) {
+  if ( analysis.config.use_small_n( particles.size() ) ) {
+    sequence.reset();
+    analysis.clusterer.cluster( analysis.config.jet_def, particles, jets );
+    return;
+  }
+  sequence.reset( analysis.config.cluster( particles ) );
+  jets = sequence->inclusive_jets();
+}
+
 void event::init_tree() {
   
+  // if every configuration is charged only, the towers are never used
+  bool charged_only = !buffers_.empty();
+  for ( unsigned i = 0; i < buffers_.size(); ++i )
+    if ( !buffers_[i].cuts.charged_only ) charged_only = false;
+  set_charged_only( charged_only );
+  
   // initialize the reader
   init();
   
-  // and initialize the trees with default branches
-  train_data_          = new TTree( "training", "training data" );
+  // the prefetch thread converts the same particle lists we would -
+  // there is nothing to decode ahead when reading from a cache
+  if ( prefetch_ > 0 && !cached() ) {
+    std::vector<particle_cuts> cuts;
+    for ( unsigned i = 0; i < buffers_.size(); ++i )
+      cuts.push_back( buffers_[i].cuts );
+    enable_prefetch( prefetch_, cuts );
+  }
   
-  // event information
-  geant_jet_.Clear();
-  pythia_jet_.Clear();
-  geant_constituents_ = new TClonesArray("TLorentzVector", 100);
-  pythia_constituents_ = new TClonesArray("TLorentzVector", 100);
+  // and initialize the trees with default branches -
+  // one tree per configuration
+  for ( unsigned i = 0; i < analyses_.size(); ++i ) {
+    jet_analysis& analysis = *analyses_[i];
+    
+    if ( features_ ) analysis.features.add_defaults();
+    for ( unsigned j = 0; j < extra_features_.size(); ++j )
+      analysis.features.add( extra_features_[j].first, extra_features_[j].second );
+    
+    if ( numpy_output() ) {
+      init_numpy( analysis );
+      continue;
+    }
+    
+    // trees are attached to the current directory when they are created
+    TDirectory::TContext context( analysis.directory != nullptr ? analysis.directory : gDirectory );
+    
+    if ( schema_ == schema_object ) {
+      analysis.geant_jet.Clear();
+      analysis.pythia_jet.Clear();
+      analysis.geant_constituents = new TClonesArray("TLorentzVector", 100);
+      analysis.pythia_constituents = new TClonesArray("TLorentzVector", 100);
+    }
+    
+    // the partitions' trees share the branch buffers
+    analysis.train_data = make_train_tree( analysis, event_partition::train );
+    if ( partitions_.enabled() ) {
+      analysis.validation_data = make_train_tree( analysis, event_partition::validation );
+      analysis.test_data = make_train_tree( analysis, event_partition::test );
+    }
+    
+    if ( schema_ == schema_flat ) {
+      analysis.event_data = new TTree( "event", "event level data" );
+      analysis.event_data->Branch("eventID", &branches_.eventID, "eventID/l");
+      analysis.event_data->Branch("runID", &branches_.run_id, "runID/I");
+      analysis.event_data->Branch("eventNo", &branches_.event_id, "eventNo/I");
+      analysis.event_data->Branch("refmult", &branches_.refmult, "refmult/I");
+      analysis.event_data->Branch("vz", &branches_.vz, "vz/F");
+      analysis.event_data->Branch("weight", &branches_.weight, "weight/D");
+      analysis.event_data->Branch("njets", &analysis.n_matched, "njets/I");
+      if ( partitions_.enabled() )
+        analysis.event_data->Branch("partition", &branches_.partition, "partition/I");
+    }
+    
+    for ( unsigned p = 0; p < event_partition::n_partitions; ++p )
+      if ( analysis.tree( event_partition::partition( p ) ) != nullptr )
+        output_settings_.apply( analysis.tree( event_partition::partition( p ) ) );
+    if ( analysis.event_data != nullptr )
+      output_settings_.apply( analysis.event_data );
+  }
+  
+  // the trees & tables are complete - from here on they are
+  // only filled through write_record()
+  if ( async_depth_ > 0 ) {
+    writer_.reset( new output_writer( async_depth_, [this]( output_record& record ) { write_record( record ); } ) );
+    writer_->start();
+  }
+  
+  // every configuration has the same features - the configurations
+  // are named like their output files
+  if ( stream_ != nullptr && !analyses_.empty() ) {
+    std::vector<std::string> configs, features;
+    for ( unsigned i = 0; i < analyses_.size(); ++i ) {
+      const jet_config& config = analyses_[i]->config;
+      std::ostringstream name;
+      name << config.algorithm << "_R_" << config.resolution << "_inc_" << config.inclusive
+           << "_charged_" << config.charged;
+      configs.push_back( name.str() );
+    }
+    for ( unsigned i = 0; i < analyses_[0]->features.size(); ++i )
+      features.push_back( analyses_[0]->features.name( i ) );
+    if ( !stream_->begin( configs, features ) ) { __ERR( "failed to send the stream schema" ) throw std::exception(); }
+  }
+  
+}
+
+TTree* event::make_train_tree( jet_analysis& analysis, event_partition::partition p ) {
+  std::string name = event_partition::name( p );
+  TTree* tree = new TTree( name.c_str(), ( name + " data" ).c_str() );
   
-  train_data_->Branch("djet", &geant_jet_);
-  train_data_->Branch("pjet", &pythia_jet_);
-  train_data_->Branch("dconst", &geant_constituents_);
-  train_data_->Branch("pconst", &pythia_constituents_);
+  if ( schema_ == schema_flat ) {
+    // split, flat branches for both jets, with eventID to
+    // join to the event tree
+    tree->Branch("eventID", &branches_.eventID, "eventID/l");
+    tree->Branch("weight", &branches_.weight, "weight/D");
+    analysis.geant_flat.branch( tree, "d" );
+    analysis.pythia_flat.branch( tree, "p" );
+    analysis.features.branch( tree );
+    return tree;
+  }
   
+  // event information
+  tree->Branch("djet", &analysis.geant_jet);
+  tree->Branch("pjet", &analysis.pythia_jet);
+  tree->Branch("dconst", &analysis.geant_constituents);
+  tree->Branch("pconst", &analysis.pythia_constituents);
+  tree->Branch("darea", &analysis.geant_area, "darea/D");
+  tree->Branch("parea", &analysis.pythia_area, "parea/D");
+  tree->Branch("weight", &branches_.weight, "weight/D");
+  analysis.features.branch( tree );
+  return tree;
 }
 
 void event::fill_trees() {
-  if ( train_data_ == nullptr ) { std::cerr << "ERROR: event::init_trees() must be called before trees can be filled" << std::endl; throw std::exception();}
+  flush_output();
+  if ( numpy_output() ) {
+    for ( unsigned i = 0; i < analyses_.size(); ++i )
+      analyses_[i]->table( partition_ ).fill();
+    return;
+  }
+  if ( analyses_.size() == 0 || analyses_[0]->train_data == nullptr ) { std::cerr << "ERROR: event::init_trees() must be called before trees can be filled" << std::endl; throw std::exception();}
  
-  train_data_->Fill();
+  for ( unsigned i = 0; i < analyses_.size(); ++i )
+    analyses_[i]->tree( partition_ )->Fill();
+}
+
+
+void event::write_tree( unsigned idx ) {
+  flush_output();
+  if ( numpy_output() && idx < analyses_.size() ) { write_numpy( *analyses_[idx] ); return; }
+  if ( idx >= analyses_.size() || analyses_[idx]->train_data == nullptr ) { std::cerr << "ERROR: event::init_trees() must be called before trees can be written to disk" << std::endl; throw std::exception();}
+  analyses_[idx]->train_data->Write( "", TObject::kOverwrite );
+  if ( analyses_[idx]->validation_data != nullptr ) {
+    analyses_[idx]->validation_data->Write( "", TObject::kOverwrite );
+    analyses_[idx]->test_data->Write( "", TObject::kOverwrite );
+  }
+  if ( analyses_[idx]->event_data != nullptr )
+    analyses_[idx]->event_data->Write( "", TObject::kOverwrite );
+}
+
+void event::autosave_trees() {
+  if ( numpy_output() ) { __ERR( "the numpy schemas can't be checkpointed" ) throw std::exception(); }
+  flush_output();
+  for ( unsigned i = 0; i < analyses_.size(); ++i ) {
+    analyses_[i]->train_data->AutoSave( "SaveSelf" );
+    if ( analyses_[i]->validation_data != nullptr ) {
+      analyses_[i]->validation_data->AutoSave( "SaveSelf" );
+      analyses_[i]->test_data->AutoSave( "SaveSelf" );
+    }
+    if ( analyses_[i]->event_data != nullptr )
+      analyses_[i]->event_data->AutoSave( "SaveSelf" );
+  }
 }
 
+void event::restore_tree( unsigned idx, TTree* train_tree, TTree* event_tree,
+                          Long64_t n_train, Long64_t n_event ) {
+  if ( idx >= analyses_.size() || analyses_[idx]->train_data == nullptr ) { std::cerr << "ERROR: event::init_trees() must be called before trees can be restored" << std::endl; throw std::exception();}
+  if ( partitions_.enabled() ) { __ERR( "partitioned output can't be restored from a checkpoint" ) throw std::exception(); }
+  flush_output();
+  if ( train_tree == nullptr || train_tree->GetEntries() < n_train ) { __ERR( "checkpointed training tree is missing entries" ) throw std::exception(); }
+  
+  // CopyEntries points the old tree's branches at our buffers, so
+  // both schemas are copied without re-binding anything by hand
+  analyses_[idx]->train_data->CopyEntries( train_tree, n_train );
+  
+  if ( analyses_[idx]->event_data != nullptr && n_event > 0 ) {
+    if ( event_tree == nullptr || event_tree->GetEntries() < n_event ) { __ERR( "checkpointed event tree is missing entries" ) throw std::exception(); }
+    analyses_[idx]->event_data->CopyEntries( event_tree, n_event );
+  }
+}
 
-void event::write_tree() {
-  if ( train_data_ == nullptr ) { std::cerr << "ERROR: event::init_trees() must be called before trees can be written to disk" << std::endl; throw std::exception();}
-  train_data_->Write();
+void event::init_numpy( jet_analysis& analysis ) {
+  if ( analysis.numpy_path == "" ) { __ERR( "set_numpy_output() must be called for every configuration" ) throw std::exception(); }
+  
+  std::string directory = schema_ == schema_npz ? analysis.numpy_path + ".parts" : analysis.numpy_path;
+  if ( !analysis.numpy_train.open( directory + "/training" ) ||
+       !analysis.numpy_event.open( directory + "/event" ) ) throw std::exception();
+  bool status = add_train_columns( analysis, analysis.numpy_train );
+  
+  if ( partitions_.enabled() ) {
+    if ( !analysis.numpy_validation.open( directory + "/validation" ) ||
+         !analysis.numpy_test.open( directory + "/test" ) ) throw std::exception();
+    status = status && add_train_columns( analysis, analysis.numpy_validation ) &&
+             add_train_columns( analysis, analysis.numpy_test );
+  }
+  
+  npy_table& events = analysis.numpy_event;
+  status = status && events.add_column( "eventID", &branches_.eventID ) &&
+           events.add_column( "runID", &branches_.run_id ) && events.add_column( "eventNo", &branches_.event_id ) &&
+           events.add_column( "refmult", &branches_.refmult ) && events.add_column( "vz", &branches_.vz ) &&
+           events.add_column( "weight", &branches_.weight ) && events.add_column( "njets", &analysis.n_matched );
+  if ( partitions_.enabled() )
+    status = status && events.add_column( "partition", &branches_.partition );
+  if ( !status ) throw std::exception();
+}
+
+bool event::add_train_columns( jet_analysis& analysis, npy_table& table ) {
+  // the same columns as the flat trees
+  return table.add_column( "eventID", &branches_.eventID ) && table.add_column( "weight", &branches_.weight ) &&
+         analysis.geant_flat.column( table, "d", numpy_width_ ) &&
+         analysis.pythia_flat.column( table, "p", numpy_width_ ) &&
+         analysis.features.column( table );
+}
+
+void event::write_numpy( jet_analysis& analysis ) {
+  npy_table* tables[4] = { &analysis.numpy_train, &analysis.numpy_event,
+                           &analysis.numpy_validation, &analysis.numpy_test };
+  const char* table_names[4] = { "training", "event", "validation", "test" };
+  const unsigned n_tables = partitions_.enabled() ? 4 : 2;
+  
+  bool status = true;
+  for ( unsigned t = 0; t < n_tables; ++t )
+    status = tables[t]->close() && status;
+  if ( !status ) {
+    __ERR( "failed writing the numpy output " << analysis.numpy_path ) throw std::exception();
+  }
+  if ( schema_ != schema_npz ) return;
+  
+  std::vector<std::string> files, names;
+  for ( unsigned t = 0; t < n_tables; ++t )
+    for ( unsigned i = 0; i < tables[t]->files().size(); ++i ) {
+      files.push_back( tables[t]->directory() + "/" + tables[t]->files()[i] );
+      names.push_back( std::string( table_names[t] ) + "/" + tables[t]->files()[i] );
+    }
+  
+  // the staged .npy files are only removed once the archive is complete
+  if ( !npz_pack( analysis.numpy_path, files, names ) ) {
+    __ERR( "the .npy files are left in " << analysis.numpy_path << ".parts" ) throw std::exception();
+  }
+  for ( unsigned i = 0; i < files.size(); ++i )
+    std::remove( files[i].c_str() );
+  for ( unsigned t = 0; t < n_tables; ++t )
+    rmdir( tables[t]->directory().c_str() );
+  rmdir( ( analysis.numpy_path + ".parts" ).c_str() );
 }
 
-void event::match_jets( double radius ) {
+void event::match_jets( jet_analysis& analysis ) {
   /** match jets such that the highest pt jets are matched preferentially,
-      such that delta_R < resolution
+      such that delta_R < resolution - the matcher does the lookup through
+      an eta-phi grid rather than scanning every geant jet
    */
-  std::vector<fastjet::PseudoJet> matched_geant;
-  std::vector<fastjet::PseudoJet> matched_pythia;
+  analysis.matcher.match( analysis.pythia_jets, analysis.geant_jets, analysis.matches );
   
-  for ( unsigned i = 0; i < pythia_jets_.size(); ++i ) {
-    /** match to pythia jet via radial distance, choosing high momentum jets
-        preferentially, since both geant_jets and pythia_jets are sorted by pt
-     */
-    
-    fastjet::PseudoJet pythia_jet = pythia_jets_[i];
-    fastjet::Selector radial_selector = fastjet::SelectorCircle( radius );
-    radial_selector.set_reference( pythia_jet );
-    std::vector<fastjet::PseudoJet> matched = radial_selector( geant_jets_ );
+  analysis.matched_geant.clear();
+  analysis.matched_pythia.clear();
+  for ( unsigned i = 0; i < analysis.matches.size(); ++i ) {
+    analysis.matched_pythia.push_back( analysis.pythia_jets[analysis.matches[i].first] );
+    analysis.matched_geant.push_back( analysis.geant_jets[analysis.matches[i].second] );
+  }
+  
+  analysis.geant_jets.swap( analysis.matched_geant );
+  analysis.pythia_jets.swap( analysis.matched_pythia );
+  
+}
+
+void event::match_leading_jet( jet_analysis& analysis ) {
+  /** finds the leading pythia jet with a single pass, and its geant match -
+      only that pair is kept, so only its constituents are ever copied
+   */
+  analysis.matched_geant.clear();
+  analysis.matched_pythia.clear();
+  
+  if ( analysis.pythia_jets.size() > 0 && analysis.geant_jets.size() > 0 ) {
+    unsigned leading = 0;
+    for ( unsigned i = 1; i < analysis.pythia_jets.size(); ++i )
+      if ( analysis.pythia_jets[i].pt2() > analysis.pythia_jets[leading].pt2() ) leading = i;
     
-    // check to make sure the matched jets werent used before...
-    for ( unsigned j = 0; j < matched.size(); ++j ) {
-      std::ptrdiff_t idx = std::find( matched_geant.begin(), matched_geant.end(), matched[j]  ) - matched_geant.begin();
-      if ( idx < int ( matched_geant.size() ) ) {
-        matched.erase( std::find( matched.begin(), matched.end(), matched_geant[idx]  ) );
-      }
+    int match = analysis.matcher.match_leading( analysis.pythia_jets, leading, analysis.geant_jets );
+    if ( match >= 0 ) {
+      analysis.matched_pythia.push_back( analysis.pythia_jets[leading] );
+      analysis.matched_geant.push_back( analysis.geant_jets[match] );
     }
-    
-    // if no match exists, skip
-    if ( matched.size() == 0 ) continue;
-    
-    // theres a match: save it
-    matched_geant.push_back( matched[0] );
-    matched_pythia.push_back( pythia_jet );
-    
   }
-
-  geant_jets_ = matched_geant;
-  pythia_jets_ = matched_pythia;
   
+  analysis.geant_jets.swap( analysis.matched_geant );
+  analysis.pythia_jets.swap( analysis.matched_pythia );
 }
 
-void event::fill_tree( const fastjet::Selector& constituent_selector  ) {
-  if ( geant_jets_.size() == 0 ||
-      pythia_jets_.size() == 0  ) { return; }
-  if (geant_jets_.size() != pythia_jets_.size()) {
+void event::fill_tree( jet_analysis& analysis ) {
+  if ( analysis.geant_jets.size() == 0 ||
+      analysis.pythia_jets.size() == 0  ) { return; }
+  if (analysis.geant_jets.size() != analysis.pythia_jets.size()) {
     std::cerr<<"error in matching"<<std::endl;
     return;
   }
-
-  // create event ID first
-  std::hash<std::string> hash;
-  std::string id_string = std::to_string(get_geant_reader().GetEvent()->GetHeader()->GetRunId())
-                        + std::to_string(get_geant_reader().GetEvent()->GetHeader()->GetEventId());
-  eventID = hash(id_string);
-
   
-  for (int i = 0; i < geant_jets_.size(); ++i) {
-    geant_jet_ = ConvertPseudoJet(geant_jets_[i]);
-    pythia_jet_ = ConvertPseudoJet(pythia_jets_[i]);
+  for (unsigned i = 0; i < analysis.geant_jets.size(); ++i) {
     
-    std::vector<fastjet::PseudoJet> dconst = geant_jets_[i].constituents();
-    std::vector<fastjet::PseudoJet> pconst = pythia_jets_[i].constituents();
+    // the area is only defined if the cluster sequence computed one
+    double geant_area = analysis.geant_jets[i].has_area() ? analysis.geant_jets[i].area() : 0.0;
+    double pythia_area = analysis.pythia_jets[i].has_area() ? analysis.pythia_jets[i].area() : 0.0;
     
-    for (int j = 0; j < dconst[i].constituents().size();++j){
-      new((*geant_constituents_)[j]) TLorentzVector(ConvertPseudoJet(dconst[j]));
-    }
-    for (int j = 0; j < pconst[i].constituents().size();++j){
-      new((*pythia_constituents_)[j]) TLorentzVector(ConvertPseudoJet(pconst[j]));
-    }
+    // the track selector removes any explicit ghosts from the constituents
+    std::vector<fastjet::PseudoJet>& dconst = analysis.geant_selected;
+    std::vector<fastjet::PseudoJet>& pconst = analysis.pythia_selected;
+    analysis.config.select_constituents( analysis.geant_jets[i], analysis.constituents, dconst );
+    analysis.config.select_constituents( analysis.pythia_jets[i], analysis.constituents, pconst );
     
+    if ( analysis.features.size() > 0 )
+      analysis.features.compute( analysis.geant_jets[i], geant_area, dconst,
+                                 analysis.pythia_jets[i], pythia_area, pconst );
+    
+    if ( stream_ != nullptr ) {
+      jet_pair pair;
+      pair.geant = &analysis.geant_jets[i];
+      pair.pythia = &analysis.pythia_jets[i];
+      pair.geant_area = geant_area;
+      pair.pythia_area = pythia_area;
+      pair.geant_constituents = &dconst;
+      pair.pythia_constituents = &pconst;
+      stream_->publish( analysis.index, partition_, eventID, weight_, pair,
+                        analysis.features.values(), analysis.features.size() );
+    }
     
-    train_data_->Fill();
-    geant_constituents_->Clear();
-    pythia_constituents_->Clear();
+    output_record& record = next_record( analysis, true );
+    record.geant_area = geant_area;
+    record.pythia_area = pythia_area;
+    copy_momentum( analysis.geant_jets[i], record.geant );
+    copy_momentum( analysis.pythia_jets[i], record.pythia );
+    copy_momenta( dconst, record.geant_constituents );
+    copy_momenta( pconst, record.pythia_constituents );
+    record.features.assign( analysis.features.values(), analysis.features.values() + analysis.features.size() );
+    queue_record();
   }
   
+}
+
+output_record& event::next_record( const jet_analysis& analysis, bool pair ) {
+  output_record& record = writer_ ? writer_->acquire() : record_;
+  record.pair = pair;
+  record.analysis = analysis.index;
+  record.partition = partition_;
+  record.eventID = eventID;
+  record.run_id = run_id_;
+  record.event_id = event_id_;
+  record.refmult = refmult_;
+  record.vz = vz_;
+  record.weight = weight_;
+  return record;
+}
+
+void event::queue_record() {
+  if ( writer_ ) writer_->push();
+  else           write_record( record_ );
+}
+
+void event::write_record( output_record& record ) {
+  jet_analysis& analysis = *analyses_[record.analysis];
+  event_partition::partition partition = event_partition::partition( record.partition );
+  
+  branches_.eventID = record.eventID;
+  branches_.run_id = record.run_id;
+  branches_.event_id = record.event_id;
+  branches_.refmult = record.refmult;
+  branches_.partition = record.partition;
+  branches_.vz = record.vz;
+  branches_.weight = record.weight;
+  
+  if ( !record.pair ) {
+    analysis.n_matched = record.n_matched;
+    if ( analysis.event_data != nullptr ) analysis.event_data->Fill();
+    else                                  analysis.numpy_event.fill();
+    return;
+  }
+  
+  if ( analysis.features.size() > 0 )
+    analysis.features.store( record.features.data() );
+  
+  if ( schema_ == schema_flat ) {
+    if ( !analysis.geant_flat.set( record.geant, record.geant_area, record.geant_constituents ) ) ++truncated_jets_;
+    if ( !analysis.pythia_flat.set( record.pythia, record.pythia_area, record.pythia_constituents ) ) ++truncated_jets_;
+    analysis.tree( partition )->Fill();
+    return;
+  }
+  
+  if ( numpy_output() ) {
+    // fixed width arrays keep the hardest constituents - the
+    // record's copies are ours to sort
+    sort_by_pt( record.geant_constituents );
+    sort_by_pt( record.pythia_constituents );
+    analysis.geant_flat.set( record.geant, record.geant_area, record.geant_constituents );
+    analysis.pythia_flat.set( record.pythia, record.pythia_area, record.pythia_constituents );
+    analysis.geant_flat.pad( numpy_width_ );
+    analysis.pythia_flat.pad( numpy_width_ );
+    if ( record.geant_constituents.size() > numpy_width_ ) ++truncated_jets_;
+    if ( record.pythia_constituents.size() > numpy_width_ ) ++truncated_jets_;
+    analysis.table( partition ).fill();
+    return;
+  }
+  
+  analysis.geant_jet = ConvertPseudoJet( record.geant );
+  analysis.pythia_jet = ConvertPseudoJet( record.pythia );
+  analysis.geant_area = record.geant_area;
+  analysis.pythia_area = record.pythia_area;
+  
+  for (unsigned j = 0; j < record.geant_constituents.size();++j){
+    new((*analysis.geant_constituents)[j]) TLorentzVector(ConvertPseudoJet(record.geant_constituents[j]));
+  }
+  for (unsigned j = 0; j < record.pythia_constituents.size();++j){
+    new((*analysis.pythia_constituents)[j]) TLorentzVector(ConvertPseudoJet(record.pythia_constituents[j]));
+  }
+  
+  analysis.tree( partition )->Fill();
+  analysis.geant_constituents->Clear();
+  analysis.pythia_constituents->Clear();
+}
+
+void event::output_bytes( Long64_t& total, Long64_t& zipped ) {
+  flush_output();
+  total = zipped = 0;
+  for ( unsigned i = 0; i < analyses_.size(); ++i ) {
+    TTree* trees[4] = { analyses_[i]->train_data, analyses_[i]->validation_data,
+                        analyses_[i]->test_data, analyses_[i]->event_data };
+    for ( unsigned t = 0; t < 4; ++t )
+      if ( trees[t] != nullptr ) {
+        total += trees[t]->GetTotBytes();
+        zipped += trees[t]->GetZipBytes();
+      }
+  }
+}
+
+//---------------------------------------------------
+/** implementation of the flat output schema
+ */
+output_schema parse_output_schema( const std::string& schema ) {
+  if ( schema == "object" ) return schema_object;
+  if ( schema == "flat" ) return schema_flat;
+  if ( schema == "npy" ) return schema_npy;
+  if ( schema == "npz" ) return schema_npz;
+  std::string msg = "unrecognized output schema: " + schema; __ERR( msg.c_str() )
+  throw std::exception();
+}
+
+void flat_jet::branch( TTree* tree, const std::string& prefix ) {
+  std::string count = prefix + "nconst";
+  tree->Branch( (prefix + "pt").c_str(), &pt, (prefix + "pt/F").c_str() );
+  tree->Branch( (prefix + "eta").c_str(), &eta, (prefix + "eta/F").c_str() );
+  tree->Branch( (prefix + "phi").c_str(), &phi, (prefix + "phi/F").c_str() );
+  tree->Branch( (prefix + "m").c_str(), &m, (prefix + "m/F").c_str() );
+  tree->Branch( (prefix + "area").c_str(), &area, (prefix + "area/F").c_str() );
+  tree->Branch( count.c_str(), &nconst, (count + "/I").c_str() );
+  tree->Branch( (prefix + "const_pt").c_str(), const_pt, (prefix + "const_pt[" + count + "]/F").c_str() );
+  tree->Branch( (prefix + "const_eta").c_str(), const_eta, (prefix + "const_eta[" + count + "]/F").c_str() );
+  tree->Branch( (prefix + "const_phi").c_str(), const_phi, (prefix + "const_phi[" + count + "]/F").c_str() );
+  tree->Branch( (prefix + "const_e").c_str(), const_e, (prefix + "const_e[" + count + "]/F").c_str() );
+  tree->Branch( (prefix + "const_charge").c_str(), const_charge, (prefix + "const_charge[" + count + "]/I").c_str() );
+}
+
+bool flat_jet::column( npy_table& table, const std::string& prefix, unsigned width ) {
+  width = std::min( width, unsigned( max_constituents ) );
+  return table.add_column( prefix + "pt", &pt ) && table.add_column( prefix + "eta", &eta ) &&
+         table.add_column( prefix + "phi", &phi ) && table.add_column( prefix + "m", &m ) &&
+         table.add_column( prefix + "area", &area ) && table.add_column( prefix + "nconst", &nconst ) &&
+         table.add_column( prefix + "const_pt", const_pt, width ) &&
+         table.add_column( prefix + "const_eta", const_eta, width ) &&
+         table.add_column( prefix + "const_phi", const_phi, width ) &&
+         table.add_column( prefix + "const_e", const_e, width ) &&
+         table.add_column( prefix + "const_charge", const_charge, width );
+}
+
+void flat_jet::pad( unsigned width ) {
+  for ( int i = nconst; i < int( width ); ++i ) {
+    const_pt[i] = const_eta[i] = const_phi[i] = const_e[i] = 0;
+    const_charge[i] = 0;
+  }
+}
+
+bool flat_jet::set( const fastjet::PseudoJet& jet, double jet_area,
+                    const std::vector<fastjet::PseudoJet>& constituents ) {
+  pt = jet.pt();
+  eta = jet.eta();
+  phi = jet.phi_std();
+  m = jet.m();
+  area = jet_area;
   
+  nconst = std::min( int( constituents.size() ), max_constituents );
+  for ( int i = 0; i < nconst; ++i ) {
+    const_pt[i] = constituents[i].pt();
+    const_eta[i] = constituents[i].eta();
+    const_phi[i] = constituents[i].phi_std();
+    const_e[i] = constituents[i].E();
+    const_charge[i] = constituents[i].user_index();
+  }
+  return nconst == int( constituents.size() );
 }
 
 //---------------------------------------------------
@@ -6,8 +6,16 @@
  */
 
 #include "geant_reader.hh"
+#include "jet_config.hh"
+#include "small_n_clusterer.hh"
+#include "npy_writer.hh"
+#include "jet_features.hh"
+#include "event_partition.hh"
+#include "jet_stream.hh"
+#include "output_writer.hh"
 
 #include "TTree.h"
+#include "TDirectory.h"
 #include "TBranch.h"
 
 #include "fastjet/PseudoJet.hh"
@@ -15,51 +23,216 @@
 #include "fastjet/AreaDefinition.hh"
 #include "fastjet/Selector.hh"
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <utility>
 
 #ifndef EVENT_HH
 #define EVENT_HH
 
+/** the layout of the output trees.
+    schema_object: djet/pjet as TLorentzVector, and the constituents in
+                   TClonesArrays of TLorentzVector ( the original format )
+    schema_flat:   split, flat branches - per jet floats, a constituent
+                   count and variable length float arrays for the
+                   constituents, plus a separate event level tree keyed
+                   by eventID. These need no object streaming, and can be
+                   read straight into numpy arrays
+    schema_npy:    no ROOT output - the flat schema's columns as .npy files,
+                   one per column, in <path>/training/ ( one row per jet
+                   pair ) and <path>/event/ ( one row per event ). Scalars
+                   are 1D arrays; the constituent columns are 2D, ( rows,
+                   width ), pt ordered & zero padded past *nconst - only
+                   the hardest width constituents are kept. The files can
+                   be mapped with numpy.load( mmap_mode='r' ). With
+                   partitioning, the held out jet pairs are written to
+                   <path>/validation/ & <path>/test/ instead
+    schema_npz:    the same arrays, packed into a single uncompressed .npz at
+                   <path> once the run is complete, with the member names
+                   training/<column> & event/<column> ( and validation/
+                   & test/ with partitioning )
+ */
+enum output_schema { schema_object, schema_flat, schema_npy, schema_npz };
+
+/** converts "object", "flat", "npy" or "npz" to an output_schema.
+    Throws on an unrecognized string
+ */
+output_schema parse_output_schema( const std::string& schema );
+
+/** converts a jet or constituent to the TLorentzVector
+    stored in the object schema
+ */
+TLorentzVector ConvertPseudoJet( const fastjet::PseudoJet& jet );
+
+/** flat branch buffers for a single jet & its constituents */
+struct flat_jet {
+  
+  /** constituents beyond this are dropped - this is far more
+      than any pp jet we see
+   */
+  static const int max_constituents = 512;
+  
+  Float_t pt, eta, phi, m, area;
+  Int_t nconst;
+  Float_t const_pt[max_constituents];
+  Float_t const_eta[max_constituents];
+  Float_t const_phi[max_constituents];
+  Float_t const_e[max_constituents];
+  Int_t const_charge[max_constituents];
+  
+  /** creates the branches prefix+"pt", prefix+"nconst", prefix+"const_pt"... */
+  void branch( TTree* tree, const std::string& prefix );
+  
+  /** the same columns in a numpy table, with the constituent
+      arrays width wide ( at most max_constituents )
+   */
+  bool column( npy_table& table, const std::string& prefix, unsigned width );
+  
+  /** sets the jet & constituent values - returns false if there
+      were more than max_constituents, and the rest were dropped
+   */
+  bool set( const fastjet::PseudoJet& jet, double jet_area,
+            const std::vector<fastjet::PseudoJet>& constituents );
+  
+  /** zeroes the constituent arrays from nconst up to width */
+  void pad( unsigned width );
+};
+
 class event : public geant_reader {
 
 public:
   
-  /** the event takes 5 arguments for construction,
+  /** the event takes 2 arguments for construction,
       everything else is set via a call to init.
-      train_tree & label_tree are where the output ( training data
-      for my models ) are stored in TTree format
-      naive_tree is an optional output where a detector
-      tracking efficiency is used for comparison.
-      The last two are used to setup the input options 
-      & TChain in the reader
+      The two are used to setup the input options 
+      & TChain in the reader. The jet finding configurations
+      are added with add_config(), and each one gets its own
+      training tree, so that any number of ( algorithm, R, charge )
+      combinations can be run off of the same decoded event
    */
   event( const std::string& input_file = "", const std::string& settings_doc = "" );
   
   /** destructor */
   ~event();
   
+  /** adds a jet finding configuration to run on every event.
+      must be called before init_tree()
+   */
+  void add_config( const jet_config& config );
+  
+  /** number of configurations, and access to each configuration */
+  unsigned n_configs() const                    { return analyses_.size(); }
+  const jet_config& get_config( unsigned idx ) const { return analyses_[idx]->config; }
+  
+  /** selects the layout of the output trees. Must be
+      called before init_tree() - default is schema_object
+   */
+  void set_output_schema( output_schema schema ) { schema_ = schema; }
+  output_schema get_output_schema() const       { return schema_; }
+  
+  /** decode events on a background thread, up to depth events ahead of
+      the one being clustered ( 0 disables prefetching, the default ). Only
+      affects the next() loop - must be called before init_tree()
+   */
+  void set_prefetch( unsigned depth )           { prefetch_ = depth; }
+  
+  /** creates the trees for configuration idx in dir ( usually the output
+      file ) instead of in memory, so that their baskets are flushed to
+      disk as they fill. The directory must outlive the event. Must be
+      called before init_tree()
+   */
+  void set_output_directory( unsigned idx, TDirectory* dir ) { analyses_[idx]->directory = dir; }
+  
+  /** for the numpy schemas: where configuration idx is written ( see
+      output_schema ), and the width of the constituent arrays ( default
+      64 ). Must be called before init_tree()
+   */
+  void set_numpy_output( unsigned idx, const std::string& path ) { analyses_[idx]->numpy_path = path; }
+  void set_numpy_width( unsigned width )        { numpy_width_ = std::min( width, unsigned( flat_jet::max_constituents ) ); }
+  
+  /** the per jet features ( see jet_features ) written with every matched
+      pair, as flat branches in every schema. set_features( false ) drops
+      the standard set; add_feature() registers another feature for every
+      configuration. Both must be called before init_tree()
+   */
+  void set_features( bool enabled )             { features_ = enabled; }
+  void add_feature( const std::string& name, jet_features::feature f )
+                                                { extra_features_.push_back( std::make_pair( name, f ) ); }
+  
+  /** splits the jet pairs between the train, validation & test partitions
+      by event ( see event_partition ): the train partition is written to
+      the training tree, the others to trees ( or numpy tables ) named
+      validation & test, with the same branches. The flat schema's event
+      tree keeps every event, with its partition in a partition branch.
+      Must be called before init_tree() - default is no partitioning
+   */
+  void set_partitions( const event_partition& partitions ) { partitions_ = partitions; }
+  const event_partition& get_partitions() const { return partitions_; }
+  
+  /** publishes every matched pair to stream as it is filled, alongside
+      the usual output - the schema is sent by init_tree(). The stream is
+      not owned, and must outlive the event; the events of several
+      threads can share one. Must be called before init_tree()
+   */
+  void set_stream( jet_stream* stream )          { stream_ = stream; }
+  
+  /** the codec, auto flush interval & basket size of the output trees
+      ( see output_settings ). Must be called before init_tree()
+   */
+  void set_output_settings( const output_settings& settings ) { output_settings_ = settings; }
+  
+  /** fills the trees ( or numpy tables ) on a writer thread, with up to
+      depth records queued behind the event loop ( see output_writer ) -
+      0 fills them on the event thread, the default. ROOT has to be in
+      thread safe mode. Must be called before init_tree()
+   */
+  void set_async_output( unsigned depth )       { async_depth_ = depth; }
+  
+  /** the writer thread - nullptr when filling on the event thread */
+  const output_writer* get_writer() const       { return writer_.get(); }
+  
+  /** waits until the writer thread has filled everything queued so far,
+      so that the trees can be used from this thread. Every call that
+      reads or writes the trees does this first
+   */
+  void flush_output()                            { if ( writer_ ) writer_->drain(); }
+  
+  /** the number of jets whose constituents didn't all fit in the flat
+      or numpy arrays ( flat_jet::max_constituents, or the numpy width ) -
+      only the first ( for numpy the hardest ) are written. Call
+      flush_output() first
+   */
+  unsigned long truncated_jets() const          { return truncated_jets_; }
+  
+  /** the uncompressed & compressed size of the baskets of every tree */
+  void output_bytes( Long64_t& total, Long64_t& zipped );
+  
+  /** true for schema_npy & schema_npz, which write no trees */
+  bool numpy_output() const                     { return schema_ == schema_npy || schema_ == schema_npz; }
+  
   /** initialization function that initializes both the
-   reader & the TTree used to store output
+   reader & the TTrees used to store output ( one per configuration )
    */
   void init_tree();
   
   /** processes the geant & pythia data to produce a list of candidate jets
-      constituent_selector is applied to the constituents before clustering,
-      jet_selector is applied to the jets after clustering
+      for every configuration. The particle lists are built once per event
+      for each distinct set of constituent cuts, with the cuts applied
+      during the conversion, and shared between the configurations. The
+      jet_selector is applied to the jets after clustering. Inclusive
+      configurations keep every matched pair, the others only the
+      leading pythia jet & its match
    */
-  bool process_event( const fastjet::JetDefinition& jet_def, const fastjet::AreaDefinition& area_def,
-                    const fastjet::Selector& constituent_selector, const fastjet::Selector jet_selector,
-                    bool charged_jets );
+  bool process_event();
   
-  /** performs the clustering and matching for full jets ( charged and neutral) */
-  bool process_full( const fastjet::JetDefinition& jet_def, const fastjet::AreaDefinition& area_def,
-                const fastjet::Selector& constituent_selector, const fastjet::Selector jet_selector
-                 );
-  
-  /** same methodology but uses only charged constituents */
-  bool process_charged( const fastjet::JetDefinition& jet_def, const fastjet::AreaDefinition& area_def,
-                       const fastjet::Selector& constituent_selector, const fastjet::Selector jet_selector
-                       );
+  /** the number of heap allocations made while building the particle
+      lists, summed over all events processed by this object. The lists
+      are reused between events, so this should stop growing once the
+      buffers have reached the largest event size. The allocations of
+      the whole event are counted in stats() ( see run_stats )
+   */
+  unsigned long long particle_allocations() const { return particle_allocations_; }
   
   /** call to propogate current event to the tree. If its not
       called, no information from the current event will be 
@@ -67,60 +240,275 @@ public:
    */
   void fill_trees();
   
-  /** write the tree to current ROOT directory/file */
-  void write_tree();
+  /** write the tree(s) for configuration idx to current ROOT directory/file,
+      replacing any autosaved copy. For the numpy schemas, this closes the
+      configuration's .npy files instead ( and packs them, for npz )
+   */
+  void write_tree( unsigned idx = 0 );
+  
+  /** checkpointing: autosave_trees() writes the tree headers of every
+      configuration to their output directories, so that all entries filled
+      so far can be recovered from the file. restore_tree() copies the first
+      n_train/n_event entries of the trees from an interrupted run into the
+      new trees for configuration idx ( event_tree may be nullptr )
+   */
+  void autosave_trees();
+  void restore_tree( unsigned idx, TTree* train_tree, TTree* event_tree,
+                     Long64_t n_train, Long64_t n_event );
   
   /**  get for TTree, this is implemented so that
        branches can be added by the user, and doesn't 
        require a rewrite of the implementation.
    */
-  TTree* get_train_tree()                       { return train_data_; }
+  TTree* get_train_tree( unsigned idx = 0 )     { return analyses_[idx]->train_data; }
+  
+  /** the tree holding partition p of configuration idx - the
+      training tree for the train partition, nullptr for a held out
+      partition without partitioning
+   */
+  TTree* get_partition_tree( unsigned idx, event_partition::partition p ) { return analyses_[idx]->tree( p ); }
+  
+  /** the event level tree - only exists for schema_flat */
+  TTree* get_event_tree( unsigned idx = 0 )     { return analyses_[idx]->event_data; }
   
   
 private:
   
-  /** the tree for recording the training data
-      including event & lead jet information (where the jet 
-      has been matched to the leading jet from pythia ). 
-      its possible that the tree is not owned by the event class,
-      in which case we don't delete or write it
+  /** all of the per-configuration state: the tree for recording the
+      training data, the clustered jets, and the branch variables
    */
-  TTree* train_data_;
+  struct jet_analysis {
+    
+    jet_analysis( const jet_config& config_ );
+    ~jet_analysis();
+    
+    /** the tree & numpy table partition p is written to */
+    TTree* tree( event_partition::partition p );
+    npy_table& table( event_partition::partition p );
+    
+    jet_config config;
+    
+    /** the configuration's position in analyses_ */
+    unsigned index;
+    
+    /** which of the particle buffers this configuration clusters */
+    unsigned buffer;
+    
+    /** the tree for recording the training data
+        including event & lead jet information (where the jet
+        has been matched to the leading jet from pythia ).
+     */
+    TTree* train_data;
+    
+    /** the held out partitions - nullptr without partitioning */
+    TTree* validation_data, *test_data;
+    
+    /** holders for the clustered jets so they can be manipulated
+        before written to file
+     */
+    std::vector<fastjet::PseudoJet> geant_jets;
+    std::vector<fastjet::PseudoJet> pythia_jets;
+    
+    /** the per event scratch: the inclusive jets before selection, and
+        the selected constituents of the pair being written ( gathered in
+        constituents ). They are cleared, not freed, between events - like
+        the jet vectors above, they stop allocating once they have grown
+        to the largest event
+     */
+    std::vector<fastjet::PseudoJet> geant_inclusive, pythia_inclusive;
+    std::vector<fastjet::PseudoJet> constituents, geant_selected, pythia_selected;
+    
+    /** the built-in clustering for small events, if the
+        configuration enables it
+     */
+    small_n_clusterer clusterer;
+    
+    /** the matcher & its output, kept between events so
+        that matching doesn't allocate
+     */
+    jet_matcher matcher;
+    std::vector<std::pair<unsigned, unsigned> > matches;
+    std::vector<fastjet::PseudoJet> matched_geant, matched_pythia;
+    
+    /** variables to generate the branches for the ttree
+        including jet level & event level information,
+        as well as the truth labels - only set by write_record()
+     */
+    TLorentzVector geant_jet, pythia_jet;
+    TClonesArray* geant_constituents, *pythia_constituents;
+    double geant_area, pythia_area;
+    
+    /** where the trees are created - nullptr for memory */
+    TDirectory* directory;
+    
+    /** the flat schema branches: per jet & per event */
+    TTree* event_data;
+    flat_jet geant_flat, pythia_flat;
+    Int_t n_matched;
+    
+    /** the features of the current jet pair */
+    jet_features features;
+    
+    /** the numpy schemas' output: the same values as the flat
+        branches, as columns of the training & event tables
+     */
+    std::string numpy_path;
+    npy_table numpy_train, numpy_event;
+    npy_table numpy_validation, numpy_test;
+  };
   
+  /** one analysis per configuration - held by pointer so that
+      the branch addresses stay fixed
+   */
+  std::vector<jet_analysis*> analyses_;
   
-  /** holders for the clustered jets so they can be manipulated 
-      before written to file 
+  /** the particle lists for the current event, one pair per distinct
+      set of cuts ( in practice, one for full jets, one for charged jets ),
+      shared between all configurations with those cuts. The vectors keep
+      their capacity from event to event
    */
-  std::vector<fastjet::PseudoJet> geant_jets_;
-  std::vector<fastjet::PseudoJet> pythia_jets_;
+  struct particle_buffer {
+    particle_buffer( const particle_cuts& cuts_ ) : cuts( cuts_ ), geant(), pythia() {};
+    particle_cuts cuts;
+    std::vector<fastjet::PseudoJet> geant;
+    std::vector<fastjet::PseudoJet> pythia;
+  };
+  std::vector<particle_buffer> buffers_;
+  
+  unsigned long long particle_allocations_;
+  
+  /** prefetch depth, 0 if disabled */
+  unsigned prefetch_;
+  
+  /** builds the particle lists & reads the header values for the current
+      event, either from the readers, or from the prefetched record
+   */
+  void load_event();
+  
+  /** performs the clustering and matching for a single configuration,
+      from its particle buffer
+   */
+  bool process_analysis( jet_analysis& analysis );
+  
+  /** clusters particles into their inclusive jets, with the small_n_clusterer
+      or with fastjet - sequence owns the fastjet cluster sequence, which the
+      jets' constituents need, and is reset for the small_n_clusterer. A
+      cluster sequence can't be rerun, so it is the one part of the
+      clustering that is built anew for every event
+   */
+  void cluster( jet_analysis& analysis, const std::vector<fastjet::PseudoJet>& particles,
+                std::unique_ptr<fastjet::ClusterSequence>& sequence,
+                std::vector<fastjet::PseudoJet>& jets );
   
   /** function used to match jets with a radial distance metric
       matches highest energy jets with R < resolution
+      ( or mutual closest pairs, in bidirectional mode )
       discards jets that are not matched
   */
-  void match_jets( double radius );
+  void match_jets( jet_analysis& analysis );
   
-  /** variables to generate the branches for the ttree
-      including jet level & event level information,
-      as well as the truth labels
+  /** the leading jet mode ( configurations that aren't inclusive ): keeps
+      only the leading pythia jet and its geant match, without sorting
    */
-  TLorentzVector geant_jet_, pythia_jet_;
-  TClonesArray* geant_constituents_, *pythia_constituents_;
+  void match_leading_jet( jet_analysis& analysis );
+  
+  /** which layout the output trees use */
+  output_schema schema_;
   
-  /** further variables stored in the tree */
+  /** the width of the numpy constituent arrays */
+  unsigned numpy_width_;
+  
+  /** jets written with fewer constituents than they have - only
+      touched by write_record()
+   */
+  unsigned long truncated_jets_;
+  
+  /** whether the standard features are written, and the
+      features registered with add_feature()
+   */
+  bool features_;
+  std::vector<std::pair<std::string, jet_features::feature> > extra_features_;
+  
+  /** the partitions, and the partition of the current event */
+  event_partition partitions_;
+  event_partition::partition partition_;
+  
+  /** where the matched pairs are streamed to - nullptr for no stream */
+  jet_stream* stream_;
+  
+  /** the output tree settings, the writer thread's queue depth & the
+      writer - nullptr if the records are written on the event thread,
+      through record_
+   */
+  output_settings output_settings_;
+  unsigned async_depth_;
+  std::unique_ptr<output_writer> writer_;
+  output_record record_;
+  
+  /** returns the slot for the next record of analysis, with the event's
+      values filled in. queue_record() hands it to the writer, or writes
+      it straight away
+   */
+  output_record& next_record( const jet_analysis& analysis, bool pair );
+  void queue_record();
+  
+  /** sets the branch buffers from a record & fills its tree or numpy
+      table - on the writer thread, if there is one
+   */
+  void write_record( output_record& record );
+  
+  /** the branch buffers of the event level values, shared by every
+      tree. The event thread's values are copied into the records, so
+      it can move on to the next event while these are written
+   */
+  struct event_branches {
+    event_branches() : eventID(0), run_id(0), event_id(0), refmult(0), partition(0), vz(0), weight(1) {};
+    unsigned long eventID;
+    Int_t run_id, event_id, refmult, partition;
+    Float_t vz;
+    Double_t weight;
+  };
+  event_branches branches_;
+  
+  /** creates a training tree ( or one of the held out partitions' ) */
+  TTree* make_train_tree( jet_analysis& analysis, event_partition::partition p );
+  
+  /** opens the numpy tables for analysis, with the same columns as the
+      flat trees - the npz schema stages them in <path>.parts
+   */
+  void init_numpy( jet_analysis& analysis );
+  
+  /** adds the training columns to one of analysis' numpy tables */
+  bool add_train_columns( jet_analysis& analysis, npy_table& table );
+  
+  /** closes the numpy tables, and for npz packs them into the archive */
+  void write_numpy( jet_analysis& analysis );
+  
+  /** further variables stored with every record, and the
+      string it is hashed from - kept, so that it doesn't allocate
+   */
   unsigned long eventID;
+  std::string id_string_;
+  
+  /** event level information, stored in the event records */
+  Int_t run_id_, event_id_, refmult_;
+  Float_t vz_;
+  
+  /** the pt-hat weight, stored with every jet & event so that
+      the output can be used without a cross section lookup
+   */
+  Double_t weight_;
   
   /** used to fill jets & event info to the ttrees
    can either write all jets ( inclusive ) or
    writes the leading jet
    */
-  void fill_tree( const fastjet::Selector& constituent_selector );
+  void fill_tree( jet_analysis& analysis );
   
 };
 
 
 
-
 //______________________________________________________________
 /** helper Selector to select on user supplied user_info */
 class SelectorUserIndexWorker : public fastjet::SelectorWorker {
@@ -0,0 +1,139 @@
+// implementation for event_cache
+
+#include "event_cache.hh"
+
+#include "base.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  const char cache_magic[8] = { 'J', 'E', 'T', 'C', 'A', 'C', 'H', 'E' };
+  const uint32_t cache_version = 1;
+
+  /** every event record starts 8 byte aligned, for the weight */
+  uint64_t padding( uint64_t bytes ) { return ( 8 - bytes % 8 ) % 8; }
+}
+
+event_cache_writer::event_cache_writer() : path_(), out_(), position_(0), offsets_() { }
+
+event_cache_writer::~event_cache_writer() {
+  if ( out_.is_open() ) close();
+}
+
+bool event_cache_writer::open( const std::string& path ) {
+  path_ = path;
+  out_.open( path_ + ".tmp", std::ios::binary | std::ios::trunc );
+  if ( !out_.is_open() ) return false;
+
+  // a placeholder - the event count & index offset are only known at close()
+  cache_file_header header;
+  std::memset( &header, 0, sizeof( header ) );
+  out_.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+  position_ = sizeof( header );
+  offsets_.clear();
+  return bool( out_ );
+}
+
+void event_cache_writer::add( cache_event header, const std::vector<cache_particle>& geant,
+                              const std::vector<cache_particle>& pythia ) {
+  header.n_geant = geant.size();
+  header.n_pythia = pythia.size();
+
+  offsets_.push_back( position_ );
+  out_.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+  out_.write( reinterpret_cast<const char*>( geant.data() ), geant.size() * sizeof( cache_particle ) );
+  out_.write( reinterpret_cast<const char*>( pythia.data() ), pythia.size() * sizeof( cache_particle ) );
+
+  uint64_t bytes = sizeof( header ) + ( geant.size() + pythia.size() ) * sizeof( cache_particle );
+  const char zeros[8] = { 0 };
+  out_.write( zeros, padding( bytes ) );
+  position_ += bytes + padding( bytes );
+}
+
+bool event_cache_writer::close() {
+  if ( !out_.is_open() ) return false;
+
+  out_.write( reinterpret_cast<const char*>( offsets_.data() ), offsets_.size() * sizeof( uint64_t ) );
+
+  cache_file_header header;
+  std::memcpy( header.magic, cache_magic, sizeof( cache_magic ) );
+  header.version = cache_version;
+  header.particle_size = sizeof( cache_particle );
+  header.n_events = offsets_.size();
+  header.index_offset = position_;
+  out_.seekp( 0 );
+  out_.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+  bool status = bool( out_ );
+  out_.close();
+  if ( !status ) { __ERR( "failed writing the event cache " << path_ ) return false; }
+  return std::rename( ( path_ + ".tmp" ).c_str(), path_.c_str() ) == 0;
+}
+
+event_cache::event_cache() : fd_(-1), data_(nullptr), size_(0), n_events_(0), index_(nullptr) { }
+
+event_cache::~event_cache() {
+  if ( data_ != nullptr ) munmap( const_cast<char*>( data_ ), size_ );
+  if ( fd_ >= 0 ) ::close( fd_ );
+}
+
+bool event_cache::open( const std::string& path ) {
+  fd_ = ::open( path.c_str(), O_RDONLY );
+  if ( fd_ < 0 ) { __ERR( "can't open the event cache " << path ) return false; }
+
+  struct stat info;
+  if ( fstat( fd_, &info ) != 0 || size_t( info.st_size ) < sizeof( cache_file_header ) ) {
+    __ERR( path << " is not an event cache" ) return false;
+  }
+  size_ = info.st_size;
+
+  void* map = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0 );
+  if ( map == MAP_FAILED ) { __ERR( "can't map the event cache " << path ) return false; }
+  data_ = static_cast<const char*>( map );
+
+  // sweeps read the events front to back
+  madvise( map, size_, MADV_SEQUENTIAL );
+
+  const cache_file_header& header = *reinterpret_cast<const cache_file_header*>( data_ );
+  if ( std::memcmp( header.magic, cache_magic, sizeof( cache_magic ) ) != 0 ||
+       header.version != cache_version || header.particle_size != sizeof( cache_particle ) ) {
+    __ERR( path << " is not an event cache, or was written by a different version" ) return false;
+  }
+  if ( header.index_offset > size_ || ( size_ - header.index_offset ) / sizeof( uint64_t ) != header.n_events ) {
+    __ERR( path << " is truncated" ) return false;
+  }
+  n_events_ = header.n_events;
+  index_ = reinterpret_cast<const uint64_t*>( data_ + header.index_offset );
+
+  // every event has to lie within the event records
+  for ( unsigned long long i = 0; i < n_events_; ++i ) {
+    if ( index_[i] + sizeof( cache_event ) > header.index_offset ||
+         index_[i] + sizeof( cache_event ) + uint64_t( this->header( i ).n_geant + this->header( i ).n_pythia ) *
+         sizeof( cache_particle ) > header.index_offset ) {
+      __ERR( path << " has a corrupt event index" ) return false;
+    }
+  }
+  return true;
+}
+
+void event_cache::fill_pseudojets( const cache_particle* begin, unsigned n,
+                                   std::vector<fastjet::PseudoJet>& particles, const particle_cuts& cuts ) {
+  particles.clear();
+
+  for ( const cache_particle* p = begin; p != begin + n; ++p ) {
+    if ( !cuts.accept_charge( p->charge ) ) continue;
+
+    fastjet::PseudoJet tmpPJ( p->px, p->py, p->pz, p->e );
+    if ( !cuts.accept_kinematics( tmpPJ.pt(), tmpPJ.rap() ) ) continue;
+
+    tmpPJ.set_user_index( p->charge );
+    particles.push_back( tmpPJ );
+  }
+}
@@ -0,0 +1,136 @@
+/*  A compact binary cache of the events accepted by the reader, so that
+    repeated passes over the same data ( sweeps over jet configurations )
+    don't decode the TStarJetPico trees & re-apply the reader cuts every
+    time. A skim writes, for every accepted event, the header information
+    and the full geant & pythia particle lists as the reader selected them
+    - the jet configurations' particle cuts are applied when reading, so
+    one cache serves every configuration. The reader maps the file into
+    memory, and hands out pointers into the mapping, so nothing is copied
+    until the particles are converted to pseudojets.
+
+    layout ( native byte order ):
+      cache_file_header
+      per event: cache_event, n_geant + n_pythia cache_particles,
+                 padded to a multiple of 8 bytes
+      the index: one 8 byte file offset per event
+ */
+
+#include "particle_cuts.hh"
+
+#include "fastjet/PseudoJet.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef JETFINDING_EVENT_CACHE_HH
+#define JETFINDING_EVENT_CACHE_HH
+
+struct cache_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t particle_size;
+  uint64_t n_events;
+  uint64_t index_offset;
+};
+
+struct cache_event {
+  int32_t run_id, event_id, refmult;
+  float vz;
+  double weight;
+  uint32_t n_geant, n_pythia;
+};
+
+struct cache_particle {
+  float px, py, pz, e;
+  int32_t charge;
+};
+
+/** writes a cache to a temporary file next to path, which is renamed
+    over path by close() once the index is written - an interrupted
+    skim leaves no cache behind
+ */
+class event_cache_writer {
+
+public:
+
+  event_cache_writer();
+
+  /** closes the cache, if it was not closed yet */
+  ~event_cache_writer();
+
+  /** creates the cache - returns false if the file can't be opened */
+  bool open( const std::string& path );
+
+  /** appends an event. header's particle counts are set from the lists */
+  void add( cache_event header, const std::vector<cache_particle>& geant,
+            const std::vector<cache_particle>& pythia );
+
+  /** writes the index & the final file header, and moves the cache into place */
+  bool close();
+
+  /** the number of events written so far */
+  unsigned long long n_events() const          { return offsets_.size(); }
+
+private:
+
+  std::string path_;
+  std::ofstream out_;
+  uint64_t position_;
+  std::vector<uint64_t> offsets_;
+
+};
+
+class event_cache {
+
+public:
+
+  event_cache();
+
+  /** unmaps the file */
+  ~event_cache();
+
+  /** maps path into memory, and checks its header & index - returns false
+      ( with an error message ) if it isn't a complete cache
+   */
+  bool open( const std::string& path );
+
+  /** the number of events in the cache */
+  unsigned long long n_events() const          { return n_events_; }
+
+  /** event idx - its header, and its geant & pythia particles ( header().n_geant
+      & header().n_pythia of them ). The pointers are into the mapping, and
+      stay valid while the cache is open
+   */
+  const cache_event& header( unsigned long long idx ) const {
+    return *reinterpret_cast<const cache_event*>( data_ + index_[idx] );
+  }
+  const cache_particle* geant( unsigned long long idx ) const {
+    return reinterpret_cast<const cache_particle*>( data_ + index_[idx] + sizeof( cache_event ) );
+  }
+  const cache_particle* pythia( unsigned long long idx ) const {
+    return geant( idx ) + header( idx ).n_geant;
+  }
+
+  /** converts the n particles that pass cuts into pseudojets, the same way
+      geant_reader::fill_pseudojets does: particles is cleared first, and the
+      user index is set to the charge
+   */
+  static void fill_pseudojets( const cache_particle* begin, unsigned n,
+                               std::vector<fastjet::PseudoJet>& particles, const particle_cuts& cuts );
+
+private:
+
+  int fd_;
+  const char* data_;
+  size_t size_;
+  unsigned long long n_events_;
+  const uint64_t* index_;
+
+  event_cache( const event_cache& );
+  event_cache& operator=( const event_cache& );
+
+};
+
+#endif // JETFINDING_EVENT_CACHE_HH
@@ -0,0 +1,67 @@
+// implementation for event_partition
+
+#include "event_partition.hh"
+
+#include <cstdint>
+#include <sstream>
+
+event_partition::event_partition() : enabled_(false), edges_{ 1.0, 1.0 } { }
+
+bool event_partition::set_fractions( double train_fraction, double validation_fraction, double test_fraction ) {
+  double sum = train_fraction + validation_fraction + test_fraction;
+  if ( train_fraction < 0 || validation_fraction < 0 || test_fraction < 0 || !( sum > 0 ) ) {
+    enabled_ = false;
+    edges_[0] = edges_[1] = 1.0;
+    return false;
+  }
+  enabled_ = true;
+  edges_[0] = train_fraction / sum;
+  edges_[1] = ( train_fraction + validation_fraction ) / sum;
+  // an empty test partition has to stay empty, whatever the rounding
+  if ( test_fraction == 0 ) edges_[1] = 1.0;
+  return true;
+}
+
+bool event_partition::parse( const std::string& fractions ) {
+  std::istringstream in( fractions );
+  double values[3];
+  char separator;
+  if ( !( in >> values[0] >> separator ) || separator != ',' ||
+       !( in >> values[1] >> separator ) || separator != ',' ||
+       !( in >> values[2] ) || !( in >> std::ws ).eof() ) return false;
+  return set_fractions( values[0], values[1], values[2] );
+}
+
+double event_partition::fraction( partition p ) const {
+  switch ( p ) {
+    case train :      return edges_[0];
+    case validation : return edges_[1] - edges_[0];
+    default :         return 1.0 - edges_[1];
+  }
+}
+
+unsigned long long event_partition::hash( int run_id, int event_id ) {
+  // the splitmix64 finalizer, over both ids packed into one word
+  uint64_t x = ( uint64_t( uint32_t( run_id ) ) << 32 ) | uint32_t( event_id );
+  x += 0x9e3779b97f4a7c15ULL;
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+  return x ^ ( x >> 31 );
+}
+
+event_partition::partition event_partition::assign( int run_id, int event_id ) const {
+  if ( !enabled_ ) return train;
+  // the top 53 bits as a double in [0,1), exactly
+  double u = double( hash( run_id, event_id ) >> 11 ) * ( 1.0 / 9007199254740992.0 );
+  if ( u < edges_[0] ) return train;
+  if ( u < edges_[1] ) return validation;
+  return test;
+}
+
+const char* event_partition::name( partition p ) {
+  switch ( p ) {
+    case train :      return "training";
+    case validation : return "validation";
+    default :         return "test";
+  }
+}
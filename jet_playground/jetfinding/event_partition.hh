@@ -0,0 +1,60 @@
+/*  Assigns every event to the train, validation or test partition at
+    production time, from a stable hash of its run & event id - so an
+    event lands in the same partition in every run, every configuration
+    and every shard, however the input is split or ordered. The hash is
+    a fixed 64 bit mix ( splitmix64 ), not std::hash, whose values are
+    up to the standard library. With partitioning off ( the default ),
+    every event is in the train partition.
+ */
+
+#include <string>
+
+#ifndef JETFINDING_EVENT_PARTITION_HH
+#define JETFINDING_EVENT_PARTITION_HH
+
+class event_partition {
+
+public:
+
+  enum partition { train = 0, validation = 1, test = 2 };
+  static const unsigned n_partitions = 3;
+
+  /** partitioning off: everything is train */
+  event_partition();
+
+  /** default destructor */
+  ~event_partition() {};
+
+  /** sets the relative sizes of the partitions - they are normalized
+      to their sum. Returns false ( and leaves partitioning off ) if any
+      is negative, or they are all zero
+   */
+  bool set_fractions( double train_fraction, double validation_fraction, double test_fraction );
+
+  /** parses "train,validation,test", e.g. "0.8,0.1,0.1" */
+  bool parse( const std::string& fractions );
+
+  bool enabled() const                          { return enabled_; }
+  double fraction( partition p ) const;
+
+  /** the 64 bit hash of an event's ids, uniform over all values */
+  static unsigned long long hash( int run_id, int event_id );
+
+  /** the partition of an event */
+  partition assign( int run_id, int event_id ) const;
+
+  /** the name of the partition's tree ( or numpy table ):
+      training, validation or test
+   */
+  static const char* name( partition p );
+
+private:
+
+  bool enabled_;
+
+  /** the upper edges of the train & validation partitions in [0,1) */
+  double edges_[2];
+
+};
+
+#endif // JETFINDING_EVENT_PARTITION_HH
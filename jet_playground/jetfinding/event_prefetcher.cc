@@ -0,0 +1,85 @@
+// implementation for event_prefetcher
+
+#include "event_prefetcher.hh"
+
+event_prefetcher::event_prefetcher( unsigned depth, producer produce ) : produce_( produce ),
+              ring_( depth + 1 ), head_(0), tail_(0), count_(0), holding_(false),
+              done_(false), stop_(false), n_waits_(0), error_(), lock_(), not_empty_(), not_full_(), thread_()
+{ }
+
+event_prefetcher::~event_prefetcher() {
+  {
+    std::lock_guard<std::mutex> guard( lock_ );
+    stop_ = true;
+  }
+  not_full_.notify_all();
+  if ( thread_.joinable() )
+    thread_.join();
+}
+
+void event_prefetcher::start() {
+  if ( !thread_.joinable() )
+    thread_ = std::thread( &event_prefetcher::run, this );
+}
+
+event_record* event_prefetcher::next() {
+  std::unique_lock<std::mutex> guard( lock_ );
+  
+  // hand the last record back to the producer
+  if ( holding_ ) {
+    head_ = ( head_ + 1 ) % ring_.size();
+    --count_;
+    holding_ = false;
+    not_full_.notify_one();
+  }
+  
+  if ( count_ == 0 && !done_ ) {
+    ++n_waits_;
+    not_empty_.wait( guard, [this] { return count_ > 0 || done_; } );
+  }
+  
+  if ( count_ == 0 ) {
+    if ( error_ ) std::rethrow_exception( error_ );
+    return nullptr;
+  }
+  
+  holding_ = true;
+  return &ring_[head_];
+}
+
+void event_prefetcher::run() {
+  while ( true ) {
+    {
+      std::unique_lock<std::mutex> guard( lock_ );
+      not_full_.wait( guard, [this] { return count_ < ring_.size() || stop_; } );
+      if ( stop_ ) return;
+    }
+    
+    // the tail record is free, so it can be filled without the lock.
+    // An exception would end the program on this thread - it is passed
+    // on to the consumer instead
+    bool status = false;
+    std::exception_ptr error;
+    try {
+      status = produce_( ring_[tail_] );
+    } catch ( ... ) {
+      error = std::current_exception();
+    }
+    
+    std::lock_guard<std::mutex> guard( lock_ );
+    if ( error ) error_ = error;
+    if ( !status ) {
+      done_ = true;
+      not_empty_.notify_one();
+      return;
+    }
+    tail_ = ( tail_ + 1 ) % ring_.size();
+    ++count_;
+    not_empty_.notify_one();
+  }
+}
+
+bool event_prefetcher::failed() const {
+  std::lock_guard<std::mutex> guard( lock_ );
+  return error_ != nullptr;
+}
@@ -0,0 +1,105 @@
+/*  A bounded ring buffer of decoded events, filled on a background
+    thread. The producer ( the reader ) decodes the next entries and
+    converts them into particle lists while the consumer ( the jet
+    finding loop ) clusters the current one, so that file reads and
+    decompression overlap with clustering. The records are allocated
+    once, and their particle vectors keep their capacity as the slots
+    are recycled.
+ */
+
+#include "fastjet/PseudoJet.hh"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef JETFINDING_EVENT_PREFETCHER_HH
+#define JETFINDING_EVENT_PREFETCHER_HH
+
+/** everything the jet finding needs from a single entry: the header
+    information, and the geant & pythia particle lists - one list per
+    set of particle cuts requested from the reader
+ */
+struct event_record {
+  
+  event_record() : entry(0), run_id(0), event_id(0), refmult(0), vz(0.0), weight(1.0), geant(), pythia() {};
+  
+  unsigned entry;
+  int run_id, event_id, refmult;
+  float vz;
+  double weight;
+  
+  std::vector<std::vector<fastjet::PseudoJet> > geant;
+  std::vector<std::vector<fastjet::PseudoJet> > pythia;
+};
+
+class event_prefetcher {
+  
+public:
+  
+  /** fills the given record with the next event. Returns false once
+      there are no more events - a read error should be thrown, so that
+      it isn't mistaken for the end of the input
+   */
+  typedef std::function<bool( event_record& )> producer;
+  
+  /** the producer runs at most depth events ahead of the event being
+      processed - the ring holds one more record, for the consumer
+   */
+  event_prefetcher( unsigned depth, producer produce );
+  
+  /** stops & joins the producer thread */
+  ~event_prefetcher();
+  
+  /** starts the producer thread */
+  void start();
+  
+  /** releases the record returned by the previous call, and blocks until
+      the next one is available. Returns nullptr once the producer has
+      run out of events. The record stays valid until the next call. If
+      the producer threw, the records it filled before are returned first,
+      then the exception is thrown here
+   */
+  event_record* next();
+  
+  /** true if the producer stopped on an exception rather than
+      at the end of the input
+   */
+  bool failed() const;
+  
+  /** the prefetch depth, and the number of times next()
+      had to wait on the producer - if this is a large fraction of the
+      events, the loop is still I/O bound
+   */
+  unsigned depth() const                          { return ring_.size() - 1; }
+  unsigned long n_waits() const                   { return n_waits_; }
+  
+private:
+  
+  /** the producer thread's loop */
+  void run();
+  
+  producer produce_;
+  std::vector<event_record> ring_;
+  
+  /** head_ is the oldest filled record, tail_ the next record the
+      producer will fill. count_ includes the record held by the consumer
+   */
+  unsigned head_, tail_, count_;
+  bool holding_, done_, stop_;
+  unsigned long n_waits_;
+  
+  /** what the producer threw - it stops at the first */
+  std::exception_ptr error_;
+  
+  mutable std::mutex lock_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::thread thread_;
+  
+};
+
+#endif // JETFINDING_EVENT_PREFETCHER_HH
@@ -8,6 +8,10 @@
  */
 
 #include "base.hh"
+#include "particle_cuts.hh"
+#include "event_prefetcher.hh"
+#include "event_cache.hh"
+#include "run_stats.hh"
 
 #include "TStarJetPicoReader.h"
 #include "TStarJetPicoEvent.h"
@@ -16,9 +20,13 @@
 #include "TStarJetPicoEventHeader.h"
 
 #include "TClonesArray.h"
+#include "TChain.h"
+#include "TFile.h"
 
 #include "fastjet/PseudoJet.hh"
 
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -78,10 +86,54 @@ public:
   
   /** will pull the next event until error or reaches the end of the tree
       will attempt to keep both readers in sync by matching tree entry #
-      this could be necessary for trigger requirements
+      this could be necessary for trigger requirements. In lockstep mode
+      ( see the settings file ) both trees are advanced sequentially instead.
+      With prefetching enabled, this takes the next record from the
+      prefetch buffer
    */
   bool next();
+  
+  /** starts next() at chain entry, instead of the beginning - used to
+      resume an interrupted run. Reading switches to lockstep mode, which
+      steps through the entries by number. Must be called after init()
+      and before the first call to next()
+   */
+  void set_first_entry( unsigned int entry )                 { lockstep_ = true; next_entry_ = entry; }
+  
+  /** true once a tree entry failed to read. next() then returns false,
+      the same as at the end of the input - check this afterwards to
+      tell the two apart
+   */
+  bool read_error() const                                    { return read_error_; }
+  
+  /** opt-in asynchronous prefetching for next(): a background thread reads
+      & decodes up to depth events ahead, converting each into one geant &
+      pythia particle list per entry in cuts, and the header information.
+      Must be called after init() and before the first call to next().
+      While prefetching, the readers belong to the prefetch thread - use
+      current_record() for the event data, not the readers. ROOT thread
+      safety has to be enabled by the caller
+   */
+  void enable_prefetch( unsigned depth, const std::vector<particle_cuts>& cuts );
+  
+  /** true if next() is reading from the prefetch buffer */
+  bool prefetching() const                                   { return prefetch_depth_ > 0; }
+  
+  /** the record for the current event when prefetching, otherwise nullptr.
+      the particle vectors can be swapped out, the record's vectors are
+      refilled by the prefetch thread once the record is released
+   */
+  event_record* current_record()                             { return current_record_; }
+  
+  /** the number of times next() had to wait for the prefetch thread */
+  unsigned long prefetch_waits() const                       { return prefetcher_ ? prefetcher_->n_waits() : 0; }
  
+  /** the pt-hat bin of a file: the file name up to the file
+      number, /path/to/picoDst_25_35_3.root -> picoDst_25_35 -
+      the key of the xsec:: weights, and the unit plan_shards costs
+   */
+  static std::string xsec_bin( const std::string& file_name );
+  
   /** reads in the tree entry idx. returns: error == -1; event did not
       pass cuts == 0; event successfully loaded == 1
    */
@@ -98,10 +150,82 @@ public:
   std::vector<fastjet::PseudoJet> pythia_pseudojets()        { return generate_pseudojets( pythia_tracks() ); }
   std::vector<fastjet::PseudoJet> geant_pseudojets()         { return generate_pseudojets( geant_tracks( ) ); }
   
+  /** the same conversion, but into a caller owned buffer: particles is
+      cleared ( keeping its capacity ) and filled in a single pass with
+      only the particles that pass cuts. Once the buffer has grown to the
+      largest event seen, this does no heap allocation
+   */
+  void pythia_pseudojets( std::vector<fastjet::PseudoJet>& particles, const particle_cuts& cuts ) {
+    if ( cached() ) event_cache::fill_pseudojets( cache_->pythia( current_event_ ), cached_header().n_pythia, particles, cuts );
+    else fill_pseudojets( pythia_tracks(), particles, cuts );
+  }
+  void geant_pseudojets( std::vector<fastjet::PseudoJet>& particles, const particle_cuts& cuts ) {
+    if ( cached() ) event_cache::fill_pseudojets( cache_->geant( current_event_ ), cached_header().n_geant, particles, cuts );
+    else fill_pseudojets( geant_tracks( ), particles, cuts );
+  }
+  
+  /** the conversions themselves, from any container of TStarJetVectors:
+      generate_pseudojets converts every vector into a new list, fill_pseudojets
+      converts those that pass cuts into particles. They use no reader state,
+      so the benchmarks can run them on synthetic containers
+   */
+  static std::vector<fastjet::PseudoJet> generate_pseudojets( TStarJetVectorContainer<TStarJetVector>* tracks );
+  static void fill_pseudojets( TStarJetVectorContainer<TStarJetVector>* tracks,
+                               std::vector<fastjet::PseudoJet>& particles, const particle_cuts& cuts );
+  
+  /** set before init() when only charged particles are used - the tower
+      branches are then not read. The geant towers are still read if the
+      event_et_cut is set, since the cut is evaluated on them
+   */
+  void set_charged_only( bool charged_only )                 { charged_only_ = charged_only; }
+  
+  /** reads the events from an event cache written by a skim ( see
+      write_cache_event() ) instead of from the trees: init() maps the
+      cache instead of building the chains, and next(), read_entry() & the
+      buffered pseudojet conversions above read from it. The reader cuts
+      were applied by the skim, so the settings file's cuts are not used.
+      Must be called before init()
+   */
+  void set_cache( const std::string& cache_path )            { cache_path_ = cache_path; }
+  
+  /** true if the events are read from a cache, and the current event's
+      header information when they are
+   */
+  bool cached() const                                        { return cache_ != nullptr; }
+  const cache_event& cached_header() const                   { return cache_->header( current_event_ ); }
+  
+  /** appends the current event to writer: its header information &
+      weight, and every particle the reader selected, before any jet
+      configuration's particle cuts. Reads from the trees, so it can't
+      be used while prefetching or reading from a cache
+   */
+  void write_cache_event( event_cache_writer& writer );
+  
+  /** bytes read from disk, and the number of read calls, since init().
+      ROOT only counts these per process, so with several readers in
+      several threads this is the total over all of them
+   */
+  Long64_t bytes_read() const                                { return TFile::GetFileBytesRead() - bytes_read_start_; }
+  Int_t read_calls() const                                   { return TFile::GetFileReadCalls() - read_calls_start_; }
+  
+  /** per stage timing & counters for everything read through this
+      reader - the read stage is timed in next(), the other stages by
+      the jet finding that uses the reader
+   */
+  const run_stats& stats() const                             { return stats_; }
+  
+  /** the pt-hat weight of the current event ( the same for every event
+      in a file ), see LookupXsec()
+   */
+  double event_weight() const {
+    if ( current_record_ != nullptr ) return current_record_->weight;
+    return cached() ? cached_header().weight : xsec_weight_;
+  }
+  
   /** access to the number of events, the current event number, etc */
   unsigned int current_event()                               { return current_event_; }
-  unsigned int total_events()                                { return geant_reader_.GetNOfEvents(); }
-  unsigned int accepted_events()                             { return geant_reader_.GetNOfAcceptedEvents(); }
+  unsigned int total_events()                                { return cached() ? cache_->n_events() : geant_reader_.GetNOfEvents(); }
+  unsigned int accepted_events()                             { return cached() ? cache_->n_events() : geant_reader_.GetNOfAcceptedEvents(); }
   
 private:
   
@@ -139,17 +263,89 @@ private:
    */
   std::vector<std::string> parse_root_string();
   
-  /** used to process TStarJetVectors into fastjet::Pseudojets
-      useful for the jetfinding process, where an std::vector<pseudojet>
-      is required
+  /** branch pruning & read caching. cache_size_ is in MB, set from
+      all::cache_size, 0 disables the cache
+   */
+  bool charged_only_;
+  bool et_cut_set_;
+  int cache_size_;
+  int cache_learn_entries_;
+  Long64_t bytes_read_start_;
+  Int_t read_calls_start_;
+  
+  /** disables the tower branches & tower processing on a reader */
+  void prune_towers( TStarJetPicoReader& reader );
+  
+  /** lockstep mode ( all::lockstep = true in the settings file ): both
+      chains are read sequentially by entry number, with a TTreeCache on
+      each. next_entry_ is the next entry to try, last_entry_ the entry
+      that was last successfully read by either mode
    */
-  std::vector<fastjet::PseudoJet> generate_pseudojets( TStarJetVectorContainer<TStarJetVector>* tracks );
+  bool lockstep_;
+  unsigned int next_entry_;
+  unsigned int last_entry_;
+  
+  /** set when ReadEvent fails, in either mode */
+  bool read_error_;
+  
+  /** advances both readers to the next entry that passes the cuts on
+      both sides, reading each entry once with ReadEvent
+   */
+  bool read_next_lockstep();
+  
+  /** reads the next synchronized geant & pythia entries - the body of next()
+      without prefetching. Does not update current_event_, so that it can be
+      called from the prefetch thread
+   */
+  bool read_next();
+  
+  /** the prefetch producer: reads the next event & fills record */
+  bool read_record( event_record& record );
+  
+  /** the pt-hat weights, xsec / n_events, keyed by pt-hat bin ( picoDst_25_35 ),
+      from the xsec:: entries in the settings file. The weight of the current
+      file is only looked up again when the chain's tree number changes
+   */
+  std::map<std::string, double> xsec_weights_;
+  int xsec_tree_;
+  double xsec_weight_;
+  
+  /** called after every successful read - refreshes xsec_weight_
+      if the geant chain has moved to a new file
+   */
+  void update_xsec_weight();
+  
+  /** with an xsec:: table, every file of the chain must be in one of
+      its bins - reports the bins that aren't, and returns false
+   */
+  bool check_xsec_weights( TChain* chain ) const;
+  
+  /** the prefetch state. The prefetcher is declared after the readers
+      so that its thread is stopped before they are destroyed
+   */
+  unsigned prefetch_depth_;
+  std::vector<particle_cuts> prefetch_cuts_;
+  std::unique_ptr<event_prefetcher> prefetcher_;
+  event_record* current_record_;
+  
+  /** the event cache, when reading from one, and the
+      particle scratch space for writing one
+   */
+  std::string cache_path_;
+  std::unique_ptr<event_cache> cache_;
+  std::vector<cache_particle> cache_geant_;
+  std::vector<cache_particle> cache_pythia_;
   
 protected:
+  
+  run_stats stats_;
+  
   /** used to get the relative weight for each event ( high pT jets are
-      oversampled in the Geant data to get weight in the tail of the distribution )
+      oversampled in the Geant data to get weight in the tail of the distribution ).
+      Returns the weight of the file's pt-hat bin, or 1 if the settings
+      file has no xsec:: table. Throws if the bin isn't in the table
    */
-  double LookupXsec ();
+  double LookupXsec( const std::string& file_name ) const;
   
 };
 
@@ -5,6 +5,10 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <exception>
+#include <functional>
+#include <cmath>
+#include <set>
 
 #include "TStarJetPicoEventCuts.h"
 #include "TStarJetPicoTrackCuts.h"
@@ -13,6 +17,7 @@
 
 #include "TString.h"
 #include "TFile.h"
+#include "TObjArray.h"
 
 /** helper function to split strings into substrings
     with respect to a specified character.
@@ -29,7 +34,10 @@ bool HasEnding (std::string const &full_string, std::string const &ending);
 /** default initializer that assumes an unmodified file structure in the 
     source directory, it will run with "normal" reader settings
  */
-geant_reader::geant_reader() {
+geant_reader::geant_reader() : charged_only_(false), et_cut_set_(false), cache_size_(30), cache_learn_entries_(10),
+              bytes_read_start_(0), read_calls_start_(0), lockstep_(false), next_entry_(0), last_entry_(0), read_error_(false), xsec_weights_(), xsec_tree_(-1), xsec_weight_(1.0),
+              prefetch_depth_(0), prefetch_cuts_(), prefetcher_(), current_record_(nullptr),
+              cache_path_(), cache_(), cache_geant_(), cache_pythia_() {
   settings_ = "${CMAKE_BINARY_DIR}/settings/reader.txt";
   input_file_path_ = "";
 
@@ -38,7 +46,11 @@ geant_reader::geant_reader() {
 /** allows the user to specify both a non-default settings file, and a 
     input file for the data trees
  */
-geant_reader::geant_reader( const std::string& settings_doc, const std::string& input_file ) {
+geant_reader::geant_reader( const std::string& settings_doc, const std::string& input_file ) :
+              charged_only_(false), et_cut_set_(false), cache_size_(30), cache_learn_entries_(10),
+              bytes_read_start_(0), read_calls_start_(0), lockstep_(false), next_entry_(0), last_entry_(0), read_error_(false), xsec_weights_(), xsec_tree_(-1), xsec_weight_(1.0),
+              prefetch_depth_(0), prefetch_cuts_(), prefetcher_(), current_record_(nullptr),
+              cache_path_(), cache_(), cache_geant_(), cache_pythia_() {
   if ( settings_doc == "" ) settings_ = "${CMAKE_BINARY_DIR}/settings/reader.txt";
   else settings_ = settings_doc;
   input_file_path_ = input_file;
@@ -56,6 +68,16 @@ bool geant_reader::init() {
     return false;
   }
   
+  // a cache replaces the trees entirely - the skim has
+  // already applied the event & track cuts
+  if ( cache_path_ != "" ) {
+    cache_.reset( new event_cache() );
+    if ( !cache_->open( cache_path_ ) ) { cache_.reset(); return false; }
+    if ( n_events >= 0 ) __OUT( "all::number_of_events is not applied to the event cache" )
+    next_entry_ = 0;
+    return true;
+  }
+  
   // now build the file input chain from the provided string
   // Build our input now
   TChain* chain = new TChain( "JetTree" );
@@ -82,6 +104,10 @@ bool geant_reader::init() {
   geant_reader_.SetInputChain( chain );
   pythia_reader_.SetInputChain( mcChain );
   
+  // an unweighted file in a weighted sample would silently skew the
+  // spectrum, so every file has to have its bin in the xsec:: table
+  if ( !check_xsec_weights( chain ) ) return false;
+  
   // set hadronic correction for both to 100%
   // to follow what others have done I set to 0.999
   // I am unsure if 1.0 causes an issue, or what
@@ -100,14 +126,84 @@ bool geant_reader::init() {
   pythia_reader_.Init( n_events );
   geant_reader_.Init( n_events );
   
+  // only read the branches that are used - towers are only needed for
+  // full jets, or for the geant event et cut. The track & header branches
+  // are always read: every track member that isn't a constituent's
+  // momentum or charge is a track cut ( dca, fit points ), and the header
+  // feeds the event cuts ( trigger, refmult, vz, vpd vz ) & the output ids.
+  // Disabling any of their leaves would hand the cuts default values
+  if ( charged_only_ ) {
+    prune_towers( pythia_reader_ );
+    if ( !et_cut_set_ ) prune_towers( geant_reader_ );
+    else __OUT( "geant towers are still read: the event_et_cut needs them" )
+  }
+  
+  // a TTreeCache on each chain reads the baskets of the used branches
+  // in a few large requests. The branches are learned from the first
+  // cache_learn_entries entries
+  if ( cache_size_ > 0 ) {
+    const Long64_t cache_bytes = Long64_t( cache_size_ ) * 1000000;
+    geant_reader_.GetInputChain()->SetCacheSize( cache_bytes );
+    geant_reader_.GetInputChain()->SetCacheLearnEntries( cache_learn_entries_ );
+    pythia_reader_.GetInputChain()->SetCacheSize( cache_bytes );
+    pythia_reader_.GetInputChain()->SetCacheLearnEntries( cache_learn_entries_ );
+  }
+  
+  bytes_read_start_ = TFile::GetFileBytesRead();
+  read_calls_start_ = TFile::GetFileReadCalls();
+  next_entry_ = 0;
+  
   return true;
 }
 
 
 bool geant_reader::next() {
   
+  scoped_timer timer( stats_, run_stats::read );
+  
+  // next_entry_ also serves as the cache cursor, so set_first_entry() works
+  if ( cached() ) {
+    if ( next_entry_ >= cache_->n_events() ) return false;
+    current_event_ = next_entry_++;
+    return true;
+  }
+  
+  if ( prefetching() ) {
+    // the prefetch thread is started on the first call, once
+    // the user is done setting up the readers
+    if ( !prefetcher_ ) {
+      prefetcher_.reset( new event_prefetcher( prefetch_depth_,
+                         std::bind( &geant_reader::read_record, this, std::placeholders::_1 ) ) );
+      prefetcher_->start();
+    }
+    
+    // a read error on the prefetch thread is rethrown here, once
+    // the records buffered before it have been handed out
+    try {
+      current_record_ = prefetcher_->next();
+    }
+    catch ( std::exception& ) {
+      __ERR("prefetch thread: reading the input failed")
+      read_error_ = true;
+      current_record_ = nullptr;
+    }
+    if ( current_record_ == nullptr ) return false;
+    
+    current_event_ = current_record_->entry;
+    return true;
+  }
+  
+  bool status = read_next();
+  current_event_ = last_entry_;
+  return status;
+}
+
+bool geant_reader::read_next() {
+  
   // Print out reader status every 10 seconds
   geant_reader_.PrintStatus(20);
+  
+  if ( lockstep_ ) return read_next_lockstep();
 
   int geant_status = geant_reader_.NextEvent();
   int pythia_status = 0;
@@ -120,20 +216,124 @@ bool geant_reader::next() {
     geant_reader_.NextEvent();
   } while ( geant_status );
   
-  current_event_ = pythia_reader_.GetNOfCurrentEvent();
+  last_entry_ = pythia_reader_.GetNOfCurrentEvent();
+  
+  bool status = pythia_status*geant_status != 0;
+  if ( status ) update_xsec_weight();
+  return status;
+}
+
+bool geant_reader::read_next_lockstep() {
+  
+  // the geant side carries the detector level cuts, so it is read
+  // first - a rejected entry never touches the pythia tree, and both
+  // chains only ever move forward
+  while ( next_entry_ < total_events() ) {
+    unsigned int idx = next_entry_++;
+    
+    int geant_status = geant_reader_.ReadEvent( idx );
+    if ( geant_status == -1 ) { __ERR(Form("geant reader: error reading in event #%u",idx)) read_error_ = true; return false; }
+    if ( geant_status == 0 ) continue;
+    
+    int pythia_status = pythia_reader_.ReadEvent( idx );
+    if ( pythia_status == -1 ) { __ERR(Form("pythia reader: error reading in event #%u",idx)) read_error_ = true; return false; }
+    if ( pythia_status == 0 ) continue;
+    
+    last_entry_ = idx;
+    update_xsec_weight();
+    return true;
+  }
   
-  return pythia_status*geant_status != 0;
+  return false;
+}
+
+void geant_reader::enable_prefetch( unsigned depth, const std::vector<particle_cuts>& cuts ) {
+  if ( prefetcher_ ) { __ERR("prefetching must be enabled before the first call to next()") throw std::exception(); }
+  if ( cached() ) { __OUT("reading from an event cache - prefetching is not used") return; }
+  prefetch_depth_ = depth;
+  prefetch_cuts_ = cuts;
+}
+
+bool geant_reader::read_record( event_record& record ) {
+  
+  // a read error is thrown, so the prefetcher can pass it on
+  // instead of reporting the end of the input
+  if ( !read_next() ) {
+    if ( read_error_ ) throw std::exception();
+    return false;
+  }
+  
+  TStarJetPicoEventHeader* header = geant_reader_.GetEvent()->GetHeader();
+  record.entry = last_entry_;
+  record.run_id = header->GetRunId();
+  record.event_id = header->GetEventId();
+  record.refmult = header->GetReferenceMultiplicity();
+  record.vz = header->GetPrimaryVertexZ();
+  record.weight = xsec_weight_;
+  
+  // the record's vectors are reused - after the first pass
+  // around the ring this only allocates for unusually large events
+  record.geant.resize( prefetch_cuts_.size() );
+  record.pythia.resize( prefetch_cuts_.size() );
+  for ( unsigned i = 0; i < prefetch_cuts_.size(); ++i ) {
+    geant_pseudojets( record.geant[i], prefetch_cuts_[i] );
+    pythia_pseudojets( record.pythia[i], prefetch_cuts_[i] );
+  }
+  
+  return true;
+}
+
+void geant_reader::write_cache_event( event_cache_writer& writer ) {
+  
+  if ( prefetching() || cached() ) { __ERR("write_cache_event() reads from the trees") throw std::exception(); }
+  
+  TStarJetPicoEventHeader* header = geant_reader_.GetEvent()->GetHeader();
+  cache_event event;
+  event.run_id = header->GetRunId();
+  event.event_id = header->GetEventId();
+  event.refmult = header->GetReferenceMultiplicity();
+  event.vz = header->GetPrimaryVertexZ();
+  event.weight = xsec_weight_;
+  
+  TStarJetVectorContainer<TStarJetVector>* containers[2] = { geant_tracks(), pythia_tracks() };
+  std::vector<cache_particle>* particles[2] = { &cache_geant_, &cache_pythia_ };
+  for ( unsigned side = 0; side < 2; ++side ) {
+    particles[side]->clear();
+    for ( int i = 0; i < containers[side]->GetEntries(); ++i ) {
+      TStarJetVector* sv = containers[side]->Get(i);
+      cache_particle particle = { float( sv->Px() ), float( sv->Py() ), float( sv->Pz() ),
+                                  float( sv->E() ), int32_t( sv->GetCharge() ) };
+      particles[side]->push_back( particle );
+    }
+  }
+  
+  writer.add( event, cache_geant_, cache_pythia_ );
+}
+
+void geant_reader::prune_towers( TStarJetPicoReader& reader ) {
+  reader.SetProcessTowers( false );
+  reader.GetInputChain()->SetBranchStatus( "*fTowers*", false );
 }
 
 int geant_reader::read_entry( unsigned int idx ) {
   
+  scoped_timer timer( stats_, run_stats::read );
+  
+  // every cached event passed the reader cuts during the skim
+  if ( cached() ) {
+    if ( idx >= cache_->n_events() ) { __ERR(Form("event cache: no event #%u",idx)) return -1; }
+    current_event_ = idx;
+    return 1;
+  }
+  
   int pythia_status = pythia_reader_.ReadEvent( idx );
   int geant_status = geant_reader_.ReadEvent( idx );
   
-  if ( pythia_status == -1 ) { __ERR(Form("pythia reader: error reading in event #%u",idx)) return -1; }
-  if ( geant_status == -1 ) { __ERR(Form("geant reader: error reading in event #%u",idx)) return -1; }
+  if ( pythia_status == -1 ) { __ERR(Form("pythia reader: error reading in event #%u",idx)) read_error_ = true; return -1; }
+  if ( geant_status == -1 ) { __ERR(Form("geant reader: error reading in event #%u",idx)) read_error_ = true; return -1; }
   
   current_event_ = idx;
+  if ( pythia_status * geant_status != 0 ) update_xsec_weight();
   
   return pythia_status * geant_status;
   
@@ -181,6 +381,13 @@ int geant_reader::parse_settings() {
       if  ( init_tokens[0] == "all" ) {
         if ( tokens[0] == "data" ) { if  (input_file_path_ == "") input_file_path_ = tokens[1]; }
         else if ( tokens[0] == "number_of_events" ) n_events = stoi( tokens[1] );
+        else if ( tokens[0] == "cache_size" ) cache_size_ = stoi( tokens[1] );
+        else if ( tokens[0] == "cache_learn_entries" ) cache_learn_entries_ = stoi( tokens[1] );
+        else if ( tokens[0] == "lockstep" ) {
+          if      ( tokens[1] == "true" )  lockstep_ = true;
+          else if ( tokens[1] == "false" ) lockstep_ = false;
+          else { std::string msg = "lockstep must be true or false"; __ERR( msg.c_str() ); throw std::exception(); }
+        }
         else if ( tokens[0] == "trigger" ) {
           pythia_reader_.GetEventCuts()->SetTriggerSelection( tokens[1].c_str() );
           geant_reader_.GetEventCuts()->SetTriggerSelection( tokens[1].c_str() );
@@ -211,6 +418,7 @@ int geant_reader::parse_settings() {
              geant
            */
           geant_reader_.GetEventCuts()->SetMaxEventEtCut( stof( tokens[1] ) );
+          et_cut_set_ = true;
         
         } else { std::string  msg = tokens[0] + " is not a option in all:: scope."; __ERR( msg.c_str() ); throw std::exception(); }
       
@@ -249,6 +457,14 @@ int geant_reader::parse_settings() {
         } else { std::string  msg = tokens[0] + " is not a option in pythia:: scope."; __ERR( msg.c_str() ); throw std::exception(); }
 
         
+      }
+      else if ( init_tokens[0] == "xsec" ) {
+        
+        // xsec::<pt-hat bin> = cross section, number of generated events
+        std::vector<std::string> values { split_string( tokens[1], "," ) };
+        if ( values.size() != 2 || stof( values[1] ) <= 0 ) { std::string msg = line + " should be xsec::bin = cross_section, n_events"; __ERR( msg.c_str() ); throw std::exception(); }
+        xsec_weights_[tokens[0]] = stod( values[0] ) / stod( values[1] );
+        
       }
       else { std::string  msg = init_tokens[0] + " is not a valid scope."; __ERR( msg.c_str() ); throw std::exception(); }
     
@@ -290,6 +506,7 @@ std::vector<std::string> geant_reader::parse_root_string() {
 std::vector<fastjet::PseudoJet> geant_reader::generate_pseudojets( TStarJetVectorContainer<TStarJetVector>* container ) {
   
   std::vector<fastjet::PseudoJet> tracks;
+  tracks.reserve( container->GetEntries() );
   
   // Transform TStarJetVectors into (FastJet) PseudoJets
   TStarJetVector* sv;
@@ -305,112 +522,78 @@ std::vector<fastjet::PseudoJet> geant_reader::generate_pseudojets( TStarJetVecto
   return tracks;
 }
 
-double geant_reader::LookupXsec(  ){
-  
-  TString filename = geant_reader_.GetInputChain()->GetCurrentFile()->GetName();
-  
-  // Some data for geant
-  // -------------------
-  //cross-sections for simulated GEANT data sample
-  // From Renee.
-  // also available via
-  // http://people.physics.tamu.edu/sakuma/star/jets/c101121_event_selection/s0150_mclist_001/web.php
-  // Double_t MinbXsec=28.12;
-  // Double_t Xsec[12];
-  // Xsec[0]=28.11;//2
-  // Xsec[1]=1.287;//3
-  // Xsec[2]=0.3117;//4
-  // Xsec[3]=0.1360;//5
-  // Xsec[4]=0.02305;//7
-  // Xsec[5]=0.005494;//9
-  // Xsec[6]=0.002228;//11
-  // Xsec[7]=0.0003895;//15
-  // Xsec[8]=0.00001016;//25
-  // Xsec[9]=0.0000005010;//35
-  // Xsec[10]=0.0000000283;//45
-  // Xsec[11]=0.000000001443;//55
-  
-  // static const Double_t MinbXsec=28.12;
-  // static const Double_t Xsec[12] = {
-  //   28.11,		// 2-3
-  //   1.287,		// 3-4
-  //   0.3117,		// 4-5
-  //   0.1360,		// 5-7
-  //   0.02305,		// 7-9
-  //   0.005494,		// 9-11
-  //   0.002228,		// 11-15
-  //   0.0003895,		// 15-25
-  //   0.00001016,		// 25-35
-  //   0.0000005010,	// 35-45
-  //   0.0000000283,	// 45-55
-  //   0.000000001443	// 55-65
-  // };
-  
-  static const Double_t Xsec[12] = {
-    1.0,        // Placeholder for 2-3
-    1.30E+09,	// 3-4
-    3.15E+08,	// 4-5
-    1.37E+08,	// 5-7
-    2.30E+07,	// 7-9
-    5.53E+06,	// 9-11
-    2.22E+06,	// 11-15
-    3.90E+05,	// 15-25
-    1.02E+04,	// 25-35
-    5.01E+02,	// 35-45
-    2.86E+01,	// 45-55
-    1.46E+00	// 55-65
-  };
-  
-  static const Double_t Nmc[12] = {
-    1,			// 2-3
-    672518,		// 3-4
-    672447,		// 4-5
-    393498,		// 5-7
-    417659,		// 7-9
-    412652,		// 9-11
-    419030,		// 11-15
-    396744,		// 15-25
-    399919,		// 25-35
-    119995,		// 35-45
-    117999,		// 45-55
-    119999		// 55-65
-  };
-  
-  Double_t w[12];
-  for ( int i=0; i<12 ; ++i ){
-    w[i] = Xsec[i] / Nmc[i];
-    // w[i] = Nmc[i] / Xsec[i] ;
+void geant_reader::fill_pseudojets( TStarJetVectorContainer<TStarJetVector>* container,
+                                    std::vector<fastjet::PseudoJet>& particles,
+                                    const particle_cuts& cuts ) {
+  
+  // clear() keeps the capacity, so after the first few events
+  // the buffer is large enough & push_back never reallocates
+  particles.clear();
+  
+  TStarJetVector* sv;
+  for ( int i=0; i < container->GetEntries() ; ++i ){
+    sv = container->Get(i);
+    
+    int charge = sv->GetCharge();
+    if ( !cuts.accept_charge( charge ) ) continue;
+    
+    fastjet::PseudoJet tmpPJ( sv->Px(), sv->Py(), sv->Pz(), sv->E() );
+    if ( !cuts.accept_kinematics( tmpPJ.pt(), tmpPJ.rap() ) ) continue;
+    
+    tmpPJ.set_user_index( charge );
+    particles.push_back( tmpPJ );
+  }
+}
+
+double geant_reader::LookupXsec( const std::string& file_name ) const {
+  
+  std::string bin = xsec_bin( file_name );
+  
+  // without an xsec:: table, the sample is unweighted
+  if ( xsec_weights_.empty() ) return 1;
+  
+  std::map<std::string, double>::const_iterator weight = xsec_weights_.find( bin );
+  if ( weight == xsec_weights_.end() ) {
+    __ERR( "no xsec:: entry for pt-hat bin " << bin << " of " << file_name ) throw std::exception();
   }
+  return weight->second;
+}
+
+std::string geant_reader::xsec_bin( const std::string& file_name ) {
+  
+  // the pt-hat bin is the file name up to the file number:
+  // /path/to/picoDst_25_35_3.root -> picoDst_25_35
+  std::string bin = file_name.substr( file_name.find_last_of( '/' ) + 1 );
+  std::string::size_type last = bin.find_last_of( '_' );
+  if ( last != std::string::npos ) bin = bin.substr( 0, last );
+  return bin;
+}
+
+bool geant_reader::check_xsec_weights( TChain* chain ) const {
+  
+  if ( xsec_weights_.empty() ) return true;
+  
+  // the chain's elements are titled with their file names
+  std::set<std::string> missing;
+  TObjArray* files = chain->GetListOfFiles();
+  for ( Int_t i = 0; i < files->GetEntriesFast(); ++i ) {
+    std::string bin = xsec_bin( files->At( i )->GetTitle() );
+    if ( xsec_weights_.count( bin ) == 0 ) missing.insert( bin );
+  }
+  for ( std::set<std::string>::const_iterator bin = missing.begin(); bin != missing.end(); ++bin )
+    __ERR( "the input has files of pt-hat bin " << *bin << ", which has no xsec:: entry in " << settings_ )
+  return missing.empty();
+}
+
+void geant_reader::update_xsec_weight() {
   
-  // static const Double_t w[12] = {
-  //   1,			// Placeholder
-  //   1.90E+03,
-  //   6.30E+02,
-  //   3.43E+02,
-  //   5.49E+01,
-  //   1.33E+01,
-  //   5.30E+00,
-  //   9.81E-01,
-  //   2.56E-02,
-  //   4.56E-03,
-  //   2.43E-04,
-  //   1.20E-05
-  // };
-  
-  if ( filename.Contains("picoDst_3_4") ) return w[1];
-  if ( filename.Contains("picoDst_4_5") ) return w[2];
-  if ( filename.Contains("picoDst_5_7") ) return w[3];
-  if ( filename.Contains("picoDst_7_9") ) return w[4];
-  if ( filename.Contains("picoDst_9_11") ) return w[5];
-  if ( filename.Contains("picoDst_11_15") ) return w[6];
-  if ( filename.Contains("picoDst_15_25") ) return w[7];
-  if ( filename.Contains("picoDst_25_35") ) return w[8];
-  if ( filename.Contains("picoDst_35_45") ) return w[9];
-  if ( filename.Contains("picoDst_45_55") ) return w[10];
-  if ( filename.Contains("picoDst_55_65") ) return w[11];
-  
-  return 1;
+  // only look the weight up when the chain moves on to a new file
+  TChain* chain = geant_reader_.GetInputChain();
+  int tree = chain->GetTreeNumber();
+  if ( tree == xsec_tree_ ) return;
   
+  xsec_tree_ = tree;
+  xsec_weight_ = chain->GetCurrentFile() != nullptr ? LookupXsec( chain->GetCurrentFile()->GetName() ) : 1.0;
 }
 
 
@@ -0,0 +1,165 @@
+// implementation for jet_config
+
+#include "jet_config.hh"
+#include "small_n_clusterer.hh"
+
+#include "fastjet/ClusterSequenceArea.hh"
+#include "fastjet/ClusterSequenceActiveAreaExplicitGhosts.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <exception>
+
+namespace {
+  /** selector( jets ), into selected - a selector that can't be applied
+      jet by jet ( e.g. the hardest n ) goes through the copying form
+   */
+  void select( const fastjet::Selector& selector, const std::vector<fastjet::PseudoJet>& jets,
+               std::vector<fastjet::PseudoJet>& selected ) {
+    if ( !selector.applies_jet_by_jet() ) { selected = selector( jets ); return; }
+    selected.clear();
+    for ( unsigned i = 0; i < jets.size(); ++i )
+      if ( selector.pass( jets[i] ) ) selected.push_back( jets[i] );
+  }
+}
+
+area_mode parse_area_mode( const std::string& mode ) {
+  if ( mode == "none" ) return area_none;
+  if ( mode == "voronoi" || mode == "passive" ) return area_voronoi;
+  if ( mode == "active" ) return area_active;
+  std::string msg = "unrecognized area mode: " + mode; __ERR( msg.c_str() )
+  throw std::exception();
+}
+
+jet_config::jet_config( const std::string& algorithm_, double resolution_,
+                        bool inclusive_, bool charged_, area_mode area_,
+                        jet_matcher::match_mode match_ ) : algorithm( algorithm_ ),
+                        resolution( resolution_ ), inclusive( inclusive_ ), charged( charged_ ),
+                        area( area_ ), ghosts(), ghost_area( 0.0 ), match( match_ ), small_n_max( 0 ) {
+
+  /** set some constants that won't need to be changed -
+      kinemantic cuts for fastjet: jet pt cut,
+      constituent pt cut, and eta acceptance, and settings
+      for the area definition
+   */
+
+  /** eta acceptance ( STAR-like, |eta| < 1.0 ) */
+  const double eta_acceptance_max   = 1.0;
+
+  /** these are used to set up the active ghost area specification
+      used to calculate jet areas. See fastjet manual for explanations,
+      but its pretty self explanatory - ghosts should extend past the
+      acceptance by at least R, to keep area calculations robust
+   */
+  const double ghost_rap_max        = eta_acceptance_max + resolution;
+  const int ghost_repeat            = 1;
+  const double ghost_area_size      = 0.01;
+
+  /** kinematic limits for jet and their constituents.
+      constituents: |eta| < 1.0 ( STAR acceptance ),
+                     0.2 < | pt | < 30 GeV ( normal cuts for our analyses )
+      jets:         |eta| < 1.0 - R ( normal, avoid boundary effects )
+                     1.0 < | pt | < 100 GeV ( arbitrary, shouldn't hit upper bound )
+   */
+  const double const_eta_max = eta_acceptance_max;
+  const double const_pt_min = 0.2;
+  const double const_pt_max = 30.0;
+  const double jet_eta_max = eta_acceptance_max - resolution;
+  const double jet_pt_min = 1.0;
+  const double jet_pt_max = 100.0;
+
+  /** setup Fastjet - first, jet definition
+      the clustering algorithm that is used to decide
+      which pairs of pseudojets are combined at which step
+      the three choices are all sequential recombination
+      with different weightings by pT of the tracks - see
+      FastJet manual online
+   */
+  if ( algorithm == "antikt" )
+    jet_def = fastjet::JetDefinition( fastjet::antikt_algorithm, resolution );
+  else if ( algorithm == "kt" )
+    jet_def = fastjet::JetDefinition( fastjet::kt_algorithm, resolution );
+  else if ( algorithm == "CA" )
+    jet_def = fastjet::JetDefinition( fastjet::cambridge_algorithm, resolution );
+  else { std::string msg = "unrecognized jet algorithm: " + algorithm; __ERR( msg.c_str() ) throw std::exception(); }
+
+  /** create the area definition used to estimate the area of the
+   jet cone. For the active area, a large number of soft "ghosts" are
+   used - the fraction of ghosts in the clustered jet / total area = jet area.
+   Since the ghosts are the bulk of the clustering input for our
+   low multiplicity pp events, they are generated once here rather than
+   for every event & every clustering. The voronoi area needs no ghosts
+   at all.
+   */
+  if ( area == area_active ) {
+    fastjet::GhostedAreaSpec ghost_area_spec( ghost_rap_max, ghost_repeat, ghost_area_size );
+    area_def = fastjet::AreaDefinition( fastjet::active_area_explicit_ghosts, ghost_area_spec );
+    
+    std::vector<fastjet::PseudoJet>* ghost_template = new std::vector<fastjet::PseudoJet>();
+    ghost_area_spec.add_ghosts( *ghost_template );
+    ghosts.reset( ghost_template );
+    ghost_area = ghost_area_spec.actual_ghost_area();
+  }
+  else if ( area == area_voronoi ) {
+    area_def = fastjet::AreaDefinition( fastjet::VoronoiAreaSpec( 1.0 ) );
+  }
+
+  /** track / jet selectors
+   applied before clustering to tracks to select "good" tracks
+   jet selector is applied to the clustered inclusive jets to
+   select jets in our acceptance within a reasonable pt range
+   */
+  cuts            = particle_cuts( const_pt_min, const_pt_max, const_eta_max, charged );
+  jet_selector    = fastjet::SelectorPtMin( jet_pt_min )   * fastjet::SelectorPtMax( jet_pt_max )   * fastjet::SelectorAbsRapMax( jet_eta_max );
+  track_selector  = fastjet::SelectorPtMin( const_pt_min ) * fastjet::SelectorPtMax( const_pt_max ) * fastjet::SelectorAbsRapMax( const_eta_max );
+}
+
+bool jet_config::use_small_n( unsigned n ) const {
+  return n <= small_n_max && area == area_none && small_n_clusterer::supports( jet_def );
+}
+
+fastjet::ClusterSequence* jet_config::cluster( const std::vector<fastjet::PseudoJet>& particles ) const {
+  switch ( area ) {
+    case area_active :
+      return new fastjet::ClusterSequenceActiveAreaExplicitGhosts( particles, jet_def, *ghosts, ghost_area );
+    case area_voronoi :
+      return new fastjet::ClusterSequenceArea( particles, jet_def, area_def );
+    default :
+      return new fastjet::ClusterSequence( particles, jet_def );
+  }
+}
+
+void jet_config::select_jets( const std::vector<fastjet::PseudoJet>& jets,
+                              std::vector<fastjet::PseudoJet>& selected ) const {
+  select( jet_selector, jets, selected );
+}
+
+void jet_config::select_constituents( const fastjet::PseudoJet& jet, std::vector<fastjet::PseudoJet>& scratch,
+                                      std::vector<fastjet::PseudoJet>& selected ) const {
+  // jet.constituents() is add_constituents() into a new vector - the
+  // small_n_clusterer's joined jets have no cluster sequence to ask
+  scratch.clear();
+  if ( jet.has_valid_cluster_sequence() )
+    jet.associated_cluster_sequence()->add_constituents( jet, scratch );
+  else
+    scratch = jet.constituents();
+  select( track_selector, scratch, selected );
+}
+
+std::vector<jet_config> make_jet_configs( const std::vector<std::string>& algorithms,
+                                          const std::vector<double>& radii,
+                                          const std::vector<bool>& charged,
+                                          bool inclusive, area_mode area,
+                                          jet_matcher::match_mode match ) {
+  std::vector<jet_config> configs;
+  for ( unsigned i = 0; i < algorithms.size(); ++i )
+    for ( unsigned j = 0; j < radii.size(); ++j )
+      for ( unsigned k = 0; k < charged.size(); ++k )
+        configs.push_back( jet_config( algorithms[i], radii[j], inclusive, charged[k], area, match ) );
+  return configs;
+}
+
+void sort_by_pt( std::vector<fastjet::PseudoJet>& jets ) {
+  std::sort( jets.begin(), jets.end(),
+             []( const fastjet::PseudoJet& a, const fastjet::PseudoJet& b ) { return a.pt2() > b.pt2(); } );
+}
@@ -0,0 +1,126 @@
+/*  A single jet finding configuration: the jet algorithm and
+    resolution parameter, whether we use charged or full jets,
+    and the fastjet definitions & selectors derived from them.
+    Several configurations can be run off of the same decoded
+    event, so that a sweep over algorithms and radii only has
+    to read the input once.
+ */
+
+#include "base.hh"
+#include "particle_cuts.hh"
+#include "jet_matcher.hh"
+
+#include "fastjet/PseudoJet.hh"
+#include "fastjet/JetDefinition.hh"
+#include "fastjet/AreaDefinition.hh"
+#include "fastjet/Selector.hh"
+#include "fastjet/ClusterSequence.hh"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#ifndef JETFINDING_JET_CONFIG_HH
+#define JETFINDING_JET_CONFIG_HH
+
+/** how ( or if ) jet areas are estimated during clustering.
+    area_none:    plain clustering, no area ( cheapest )
+    area_voronoi: passive area from the voronoi cell of each particle,
+                  no ghosts are added
+    area_active:  active area from explicit ghosts - the ghosts are
+                  generated once, and the same set is reused for every
+                  event, and for both the geant & pythia clustering
+ */
+enum area_mode { area_none, area_voronoi, area_active };
+
+/** converts "none", "voronoi" ( or "passive" ), "active" to an area_mode.
+    Throws on an unrecognized string
+ */
+area_mode parse_area_mode( const std::string& mode );
+
+struct jet_config {
+
+  /** builds the jet definition, area definition and the
+      constituent & jet selectors for the given algorithm ( antikt,
+      kt, CA ) and resolution parameter. Throws on an unrecognized
+      algorithm
+   */
+  jet_config( const std::string& algorithm = "antikt", double resolution = 0.4,
+              bool inclusive = false, bool charged = false, area_mode area = area_active,
+              jet_matcher::match_mode match = jet_matcher::greedy );
+
+  /** clusters the particles with this configuration's jet definition
+      and area mode. The caller owns the returned cluster sequence,
+      which has to outlive any use of the jets' constituents
+   */
+  fastjet::ClusterSequence* cluster( const std::vector<fastjet::PseudoJet>& particles ) const;
+  
+  /** the selectors, without the temporaries: select_jets() fills selected
+      with the jets that pass jet_selector, select_constituents() with the
+      constituents of jet that pass track_selector, gathered in scratch
+      straight from the cluster sequence. Both keep the input order, and
+      reuse the vectors' storage - once they have grown to the largest
+      event, they don't allocate
+   */
+  void select_jets( const std::vector<fastjet::PseudoJet>& jets, std::vector<fastjet::PseudoJet>& selected ) const;
+  void select_constituents( const fastjet::PseudoJet& jet, std::vector<fastjet::PseudoJet>& scratch,
+                            std::vector<fastjet::PseudoJet>& selected ) const;
+
+  std::string algorithm;
+  double resolution;
+  bool inclusive;
+  bool charged;
+
+  /** clustering algorithm & area estimation */
+  fastjet::JetDefinition jet_def;
+  area_mode area;
+  fastjet::AreaDefinition area_def;
+
+  /** the ghost template for area_active, generated once from the
+      ghosted area spec. It is shared ( read-only ) between copies of
+      the configuration, so threads & events all use the same ghosts
+   */
+  std::shared_ptr<const std::vector<fastjet::PseudoJet> > ghosts;
+  double ghost_area;
+
+  /** the constituent cuts ( and charge requirement ), applied while
+      the particles are converted, before clustering
+   */
+  particle_cuts cuts;
+  
+  /** track_selector is the same constituent cut as a fastjet selector -
+      it is used to strip ghosts from the jet constituents. jet_selector
+      is applied to the jets after clustering
+   */
+  fastjet::Selector track_selector;
+  fastjet::Selector jet_selector;
+
+  /** how geant jets are matched to pythia jets ( within R ) */
+  jet_matcher::match_mode match;
+  
+  /** events with at most small_n_max particles are clustered by the built-in
+      small_n_clusterer instead of fastjet, if the algorithm is supported
+      and no area is requested. 0 ( the default ) always uses fastjet
+   */
+  unsigned small_n_max;
+  
+  /** true if n particles should be clustered with the small_n_clusterer */
+  bool use_small_n( unsigned n ) const;
+
+};
+
+/** builds the cross product of algorithms x radii x charge modes,
+    used to run a full sweep in a single pass
+ */
+std::vector<jet_config> make_jet_configs( const std::vector<std::string>& algorithms,
+                                          const std::vector<double>& radii,
+                                          const std::vector<bool>& charged,
+                                          bool inclusive, area_mode area = area_active,
+                                          jet_matcher::match_mode match = jet_matcher::greedy );
+
+/** sorts by decreasing pt in place, like fastjet::sorted_by_pt but
+    without the copy - for the vectors select_jets() reuses
+ */
+void sort_by_pt( std::vector<fastjet::PseudoJet>& jets );
+
+#endif // JETFINDING_JET_CONFIG_HH
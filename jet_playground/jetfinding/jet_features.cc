@@ -0,0 +1,113 @@
+// implementation for jet_features
+
+#include "jet_features.hh"
+
+#include "base.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+
+jet_features::jet_features() : names_(), features_(), values_(), buffers_(), attached_(false), pt_(), dr_(), charged_() { }
+
+void jet_features::add_defaults() {
+  add( "pt",          []( const jet_pair& p ) { return p.geant->pt(); } );
+  add( "eta",         []( const jet_pair& p ) { return p.geant->eta(); } );
+  add( "phi",         []( const jet_pair& p ) { return p.geant->phi_std(); } );
+  add( "area",        []( const jet_pair& p ) { return p.geant_area; } );
+  add( "nconst",      []( const jet_pair& p ) { return double( p.geant_sums.n ); } );
+  add( "ncharge",     []( const jet_pair& p ) { return double( p.geant_sums.ncharge ); } );
+  add( "charge_frac", []( const jet_pair& p ) {
+    return p.geant_sums.sum_pt > 0 ? p.geant_sums.charged_pt / p.geant_sums.sum_pt : 0.0; } );
+  add( "width",       []( const jet_pair& p ) {
+    return p.geant->pt() > 0 ? p.geant_sums.sum_pt_dr / p.geant->pt() : 0.0; } );
+  add( "lead_frac",   []( const jet_pair& p ) {
+    return p.geant->pt() > 0 ? p.geant_sums.max_pt / p.geant->pt() : 0.0; } );
+  add( "dispersion",  []( const jet_pair& p ) {
+    return p.geant_sums.sum_pt > 0 ? std::sqrt( p.geant_sums.sum_pt2 ) / p.geant_sums.sum_pt : 0.0; } );
+  add( "reco_pt",     []( const jet_pair& p ) { return p.pythia->pt(); } );
+}
+
+void jet_features::add( const std::string& name, feature f ) {
+  if ( attached_ ) { __ERR( "features must be added before they are attached to an output" ) throw std::exception(); }
+  if ( std::find( names_.begin(), names_.end(), name ) != names_.end() ) {
+    __ERR( "the feature " << name << " is already registered" ) throw std::exception();
+  }
+  names_.push_back( name );
+  features_.push_back( f );
+  values_.push_back( 0 );
+  buffers_.push_back( 0 );
+}
+
+void jet_features::branch( TTree* tree ) {
+  attached_ = true;
+  for ( unsigned i = 0; i < names_.size(); ++i )
+    tree->Branch( names_[i].c_str(), &buffers_[i], ( names_[i] + "/F" ).c_str() );
+}
+
+bool jet_features::column( npy_table& table ) {
+  attached_ = true;
+  for ( unsigned i = 0; i < names_.size(); ++i )
+    if ( !table.add_column( names_[i], &buffers_[i] ) ) return false;
+  return true;
+}
+
+void jet_features::store( const Float_t* values ) {
+  std::copy( values, values + buffers_.size(), buffers_.begin() );
+}
+
+void jet_features::compute( const fastjet::PseudoJet& geant, double geant_area,
+                            const std::vector<fastjet::PseudoJet>& geant_constituents,
+                            const fastjet::PseudoJet& pythia, double pythia_area,
+                            const std::vector<fastjet::PseudoJet>& pythia_constituents ) {
+  jet_pair pair;
+  pair.geant = &geant;
+  pair.pythia = &pythia;
+  pair.geant_area = geant_area;
+  pair.pythia_area = pythia_area;
+  pair.geant_constituents = &geant_constituents;
+  pair.pythia_constituents = &pythia_constituents;
+  sum_constituents( geant, geant_constituents, pair.geant_sums );
+  sum_constituents( pythia, pythia_constituents, pair.pythia_sums );
+
+  for ( unsigned i = 0; i < features_.size(); ++i )
+    values_[i] = features_[i]( pair );
+}
+
+void jet_features::sum_constituents( const fastjet::PseudoJet& jet,
+                                     const std::vector<fastjet::PseudoJet>& constituents,
+                                     constituent_sums& sums ) {
+  const unsigned n = constituents.size();
+  pt_.resize( n );
+  dr_.resize( n );
+  charged_.resize( n );
+
+  // the user index holds the charge
+  for ( unsigned i = 0; i < n; ++i ) {
+    pt_[i] = constituents[i].pt();
+    dr_[i] = constituents[i].delta_R( jet );
+    charged_[i] = constituents[i].user_index() != 0 ? 1.0 : 0.0;
+  }
+
+  double sum_pt = 0, sum_pt2 = 0, charged_pt = 0, ncharge = 0, max_pt = 0, sum_pt_dr = 0;
+  const double* pt = pt_.data();
+  const double* dr = dr_.data();
+  const double* charged = charged_.data();
+  for ( unsigned i = 0; i < n; ++i ) {
+    sum_pt += pt[i];
+    sum_pt2 += pt[i] * pt[i];
+    charged_pt += pt[i] * charged[i];
+    ncharge += charged[i];
+    max_pt = std::max( max_pt, pt[i] );
+    sum_pt_dr += pt[i] * dr[i];
+  }
+
+  sums.n = n;
+  sums.ncharge = int( ncharge );
+  sums.sum_pt = sum_pt;
+  sums.sum_pt2 = sum_pt2;
+  sums.charged_pt = charged_pt;
+  sums.max_pt = max_pt;
+  sums.sum_pt_dr = sum_pt_dr;
+}
@@ -0,0 +1,127 @@
+/*  The per jet features the correction models are trained on, computed
+    in C++ as the matched jet pairs are written, instead of being rebuilt
+    from the constituents in python. Every feature is a named function of
+    a matched jet pair; the constituents of both jets are summarized in a
+    single pass first ( multiplicities, pt sums, the leading pt, the pt
+    weighted distance to the axis ), so that a feature built from those
+    sums costs nothing extra. Each feature is written as its own float
+    branch ( or numpy column ), and new ones are registered with add() -
+    nothing in the tree filling has to change.
+ */
+
+#include "npy_writer.hh"
+
+#include "TTree.h"
+
+#include "fastjet/PseudoJet.hh"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef JETFINDING_JET_FEATURES_HH
+#define JETFINDING_JET_FEATURES_HH
+
+/** the sums over one jet's constituents */
+struct constituent_sums {
+
+  constituent_sums() : n(0), ncharge(0), sum_pt(0), sum_pt2(0), charged_pt(0), max_pt(0), sum_pt_dr(0) {};
+
+  /** constituent & charged constituent multiplicity */
+  int n, ncharge;
+
+  /** sum of pt, sum of pt^2, pt of the charged constituents,
+      the leading constituent pt, and sum of pt * delta R to the jet axis
+   */
+  double sum_pt, sum_pt2, charged_pt, max_pt, sum_pt_dr;
+};
+
+/** everything a feature is computed from: the matched geant & pythia
+    jets, their areas & selected constituents, and the constituent sums
+ */
+struct jet_pair {
+
+  const fastjet::PseudoJet* geant;
+  const fastjet::PseudoJet* pythia;
+  double geant_area, pythia_area;
+  const std::vector<fastjet::PseudoJet>* geant_constituents;
+  const std::vector<fastjet::PseudoJet>* pythia_constituents;
+  constituent_sums geant_sums, pythia_sums;
+};
+
+class jet_features {
+
+public:
+
+  typedef std::function<double( const jet_pair& )> feature;
+
+  jet_features();
+
+  /** default destructor */
+  ~jet_features() {};
+
+  /** registers the standard set, for the detector level jet:
+      pt, eta, phi, area, nconst, ncharge, charge_frac ( the charged
+      fraction of the constituent pt ), width ( the pt weighted distance
+      of the constituents to the axis, over the jet pt ), lead_frac ( the
+      leading constituent's fraction of the jet pt ), dispersion
+      ( sqrt( sum pt^2 ) / sum pt ), and the training label reco_pt -
+      the matched pythia jet's pt
+   */
+  void add_defaults();
+
+  /** registers feature f as branch name. Must be called before branch()
+      or column() - throws if the name is already taken, or if the
+      features have already been attached to an output
+   */
+  void add( const std::string& name, feature f );
+
+  unsigned size() const                              { return names_.size(); }
+  const std::string& name( unsigned idx ) const      { return names_[idx]; }
+  Float_t value( unsigned idx ) const                { return values_[idx]; }
+  const Float_t* values() const                      { return values_.data(); }
+
+  /** creates a name/F branch for every feature on tree */
+  void branch( TTree* tree );
+
+  /** adds a column for every feature to a numpy table */
+  bool column( npy_table& table );
+
+  /** copies size() values into the branch buffers. compute() does not
+      touch them, so that the output can be filled on another thread
+      while the next pair is computed
+   */
+  void store( const Float_t* values );
+
+  /** sums the constituents of both jets, and evaluates every feature
+      of the pair into values()
+   */
+  void compute( const fastjet::PseudoJet& geant, double geant_area,
+                const std::vector<fastjet::PseudoJet>& geant_constituents,
+                const fastjet::PseudoJet& pythia, double pythia_area,
+                const std::vector<fastjet::PseudoJet>& pythia_constituents );
+
+  /** the single pass over a jet's constituents. The kinematics are first
+      gathered into flat arrays, so that the sums are branch free loops
+      the compiler can vectorize. The arrays are kept between calls
+   */
+  void sum_constituents( const fastjet::PseudoJet& jet, const std::vector<fastjet::PseudoJet>& constituents,
+                         constituent_sums& sums );
+
+private:
+
+  std::vector<std::string> names_;
+  std::vector<feature> features_;
+
+  /** the values of the last computed pair, and the branch
+      buffers - fixed once attached to an output
+   */
+  std::vector<Float_t> values_, buffers_;
+  bool attached_;
+
+  /** scratch for sum_constituents */
+  std::vector<double> pt_, dr_, charged_;
+
+};
+
+#endif // JETFINDING_JET_FEATURES_HH
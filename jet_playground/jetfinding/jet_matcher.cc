@@ -0,0 +1,224 @@
+// implementation for jet_matcher class
+
+#include "jet_matcher.hh"
+
+#include "base.hh"
+
+#include <iostream>
+#include <exception>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+  const double two_pi = 2.0 * pi;
+
+  /** maps phi into [0, 2pi) */
+  double wrap_phi( double phi ) {
+    phi = std::fmod( phi, two_pi );
+    return phi < 0.0 ? phi + two_pi : phi;
+  }
+}
+
+jet_matcher::match_mode jet_matcher::parse_mode( const std::string& mode ) {
+  if ( mode == "greedy" ) return greedy;
+  if ( mode == "bidirectional" ) return bidirectional;
+  std::string msg = "unrecognized match mode: " + mode; __ERR( msg.c_str() )
+  throw std::exception();
+}
+
+jet_matcher::jet_matcher( double radius, match_mode mode ) : radius_( radius ), mode_( mode ),
+              geant_grid_(), pythia_grid_(), used_(), candidates_(), best_geant_() { }
+
+unsigned jet_matcher::match( const std::vector<fastjet::PseudoJet>& pythia_jets,
+                             const std::vector<fastjet::PseudoJet>& geant_jets,
+                             std::vector<std::pair<unsigned, unsigned> >& matches ) {
+  matches.clear();
+  if ( pythia_jets.size() == 0 || geant_jets.size() == 0 ) return 0;
+
+  geant_grid_.build( geant_jets, radius_ );
+
+  if ( mode_ == bidirectional ) match_bidirectional( pythia_jets, geant_jets, matches );
+  else                          match_greedy( pythia_jets, geant_jets, matches );
+
+  return matches.size();
+}
+
+int jet_matcher::match_leading( const std::vector<fastjet::PseudoJet>& pythia_jets, unsigned leading,
+                                const std::vector<fastjet::PseudoJet>& geant_jets ) const {
+  const double radius2 = radius_ * radius_;
+  const fastjet::PseudoJet& pythia_jet = pythia_jets[leading];
+
+  /** greedy: the leading jet is matched first, so it always gets the
+      highest pt geant jet in range. bidirectional: the closest geant jet,
+      if the leading jet is also the closest pythia jet to it
+   */
+  int best = -1;
+  double best_value = 0.0;
+  for ( unsigned i = 0; i < geant_jets.size(); ++i ) {
+    double distance2 = pythia_jet.squared_distance( geant_jets[i] );
+    if ( distance2 > radius2 ) continue;
+    if ( mode_ == greedy ) {
+      if ( best < 0 || geant_jets[i].pt2() > best_value ) { best = i; best_value = geant_jets[i].pt2(); }
+    }
+    // ties go to the higher pt jet, as in closest()
+    else if ( best < 0 || distance2 < best_value ||
+              ( distance2 == best_value && geant_jets[i].pt2() > geant_jets[best].pt2() ) ) { best = i; best_value = distance2; }
+  }
+
+  if ( best < 0 || mode_ == greedy ) return best;
+
+  double leading_distance2 = pythia_jet.squared_distance( geant_jets[best] );
+  for ( unsigned i = 0; i < pythia_jets.size(); ++i )
+    if ( i != leading && pythia_jets[i].squared_distance( geant_jets[best] ) < leading_distance2 ) return -1;
+  return best;
+}
+
+void jet_matcher::match_greedy( const std::vector<fastjet::PseudoJet>& pythia_jets,
+                                const std::vector<fastjet::PseudoJet>& geant_jets,
+                                std::vector<std::pair<unsigned, unsigned> >& matches ) {
+  /** match jets such that the highest pt jets are matched preferentially,
+      such that delta_R < resolution. Since the geant jets are sorted by pt,
+      the highest pt candidate is the one with the lowest index
+   */
+  used_.assign( ( geant_jets.size() + 63 ) / 64, 0ULL );
+  const double radius2 = radius_ * radius_;
+
+  for ( unsigned i = 0; i < pythia_jets.size(); ++i ) {
+    geant_grid_.neighbours( pythia_jets[i].rap(), pythia_jets[i].phi(), radius2, candidates_ );
+
+    int best = -1;
+    for ( unsigned j = 0; j < candidates_.size(); ++j ) {
+      unsigned idx = candidates_[j];
+      if ( is_used( idx ) ) continue;
+      if ( best < 0 || int( idx ) < best ) best = idx;
+    }
+
+    // if no match exists, skip
+    if ( best < 0 ) continue;
+
+    set_used( best );
+    matches.push_back( std::make_pair( i, unsigned( best ) ) );
+  }
+}
+
+void jet_matcher::match_bidirectional( const std::vector<fastjet::PseudoJet>& pythia_jets,
+                                       const std::vector<fastjet::PseudoJet>& geant_jets,
+                                       std::vector<std::pair<unsigned, unsigned> >& matches ) {
+  pythia_grid_.build( pythia_jets, radius_ );
+
+  // the closest geant jet to each pythia jet
+  best_geant_.resize( pythia_jets.size() );
+  for ( unsigned i = 0; i < pythia_jets.size(); ++i )
+    best_geant_[i] = closest( geant_grid_, pythia_grid_.rap( i ), pythia_grid_.phi( i ) );
+
+  // and keep the pair only if that pythia jet is also the
+  // closest to the geant jet
+  for ( unsigned i = 0; i < pythia_jets.size(); ++i ) {
+    if ( best_geant_[i] < 0 ) continue;
+    unsigned geant_idx = best_geant_[i];
+    if ( closest( pythia_grid_, geant_grid_.rap( geant_idx ), geant_grid_.phi( geant_idx ) ) != int( i ) ) continue;
+    matches.push_back( std::make_pair( i, geant_idx ) );
+  }
+}
+
+int jet_matcher::closest( const eta_phi_grid& grid, double rap, double phi ) {
+  grid.neighbours( rap, phi, radius_ * radius_, candidates_ );
+
+  int best = -1;
+  double best_dist = 0.0;
+  for ( unsigned j = 0; j < candidates_.size(); ++j ) {
+    unsigned idx = candidates_[j];
+    double drap = rap - grid.rap( idx );
+    double dphi = std::fabs( wrap_phi( phi ) - grid.phi( idx ) );
+    if ( dphi > pi ) dphi = two_pi - dphi;
+    double dist = drap * drap + dphi * dphi;
+    // ties go to the higher pt ( lower index ) jet
+    if ( best < 0 || dist < best_dist || ( dist == best_dist && int( idx ) < best ) ) {
+      best = idx;
+      best_dist = dist;
+    }
+  }
+  return best;
+}
+
+//---------------------------------------------------
+/** implementation of the eta-phi grid
+ */
+void jet_matcher::eta_phi_grid::build( const std::vector<fastjet::PseudoJet>& jets, double radius ) {
+  unsigned n = jets.size();
+  rap_.resize( n );
+  phi_.resize( n );
+  cell_of_.resize( n );
+  cell_jets_.resize( n );
+
+  if ( radius <= 0.0 ) radius = 1e-3;
+
+  double rap_max = 0.0;
+  rap_min_ = 0.0;
+  for ( unsigned i = 0; i < n; ++i ) {
+    rap_[i] = jets[i].rap();
+    phi_[i] = wrap_phi( jets[i].phi() );
+    if ( i == 0 || rap_[i] < rap_min_ ) rap_min_ = rap_[i];
+    if ( i == 0 || rap_[i] > rap_max ) rap_max = rap_[i];
+  }
+
+  // cells are at least radius wide in both directions
+  rap_width_ = radius;
+  n_rap_ = int( ( rap_max - rap_min_ ) / rap_width_ ) + 1;
+  n_phi_ = std::max( 1, int( two_pi / radius ) );
+  phi_width_ = two_pi / n_phi_;
+
+  // counting sort of the jets into their cells - count,
+  // prefix sum to get each cell's offset, then place
+  unsigned n_cells = n_rap_ * n_phi_;
+  cell_start_.assign( n_cells + 1, 0 );
+  for ( unsigned i = 0; i < n; ++i ) {
+    cell_of_[i] = rap_cell( rap_[i] ) * n_phi_ + phi_cell( phi_[i] );
+    cell_start_[cell_of_[i] + 1]++;
+  }
+  for ( unsigned c = 0; c < n_cells; ++c )
+    cell_start_[c + 1] += cell_start_[c];
+
+  cell_fill_.assign( cell_start_.begin(), cell_start_.end() - 1 );
+  for ( unsigned i = 0; i < n; ++i )
+    cell_jets_[cell_fill_[cell_of_[i]]++] = i;
+}
+
+void jet_matcher::eta_phi_grid::neighbours( double rap, double phi, double radius2,
+                                            std::vector<unsigned>& candidates ) const {
+  candidates.clear();
+  if ( n_rap_ == 0 ) return;
+
+  phi = wrap_phi( phi );
+  int rap_center = int( std::floor( ( rap - rap_min_ ) / rap_width_ ) );
+  int phi_center = phi_cell( phi );
+
+  // with fewer than three phi cells, the 3x3 block would visit
+  // the same cells twice - just visit all of them
+  int phi_lo = n_phi_ < 3 ? 0 : phi_center - 1;
+  int phi_hi = n_phi_ < 3 ? n_phi_ - 1 : phi_center + 1;
+
+  for ( int r = rap_center - 1; r <= rap_center + 1; ++r ) {
+    if ( r < 0 || r >= n_rap_ ) continue;
+    for ( int p = phi_lo; p <= phi_hi; ++p ) {
+      int cell = r * n_phi_ + ( ( p % n_phi_ ) + n_phi_ ) % n_phi_;
+      for ( unsigned k = cell_start_[cell]; k < cell_start_[cell + 1]; ++k ) {
+        unsigned idx = cell_jets_[k];
+        double drap = rap - rap_[idx];
+        double dphi = std::fabs( phi - phi_[idx] );
+        if ( dphi > pi ) dphi = two_pi - dphi;
+        if ( drap * drap + dphi * dphi <= radius2 ) candidates.push_back( idx );
+      }
+    }
+  }
+}
+
+int jet_matcher::eta_phi_grid::rap_cell( double rap ) const {
+  int cell = int( ( rap - rap_min_ ) / rap_width_ );
+  return std::min( std::max( cell, 0 ), n_rap_ - 1 );
+}
+
+int jet_matcher::eta_phi_grid::phi_cell( double phi ) const {
+  int cell = int( phi / phi_width_ );
+  return std::min( std::max( cell, 0 ), n_phi_ - 1 );
+}
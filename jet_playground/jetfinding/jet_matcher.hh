@@ -0,0 +1,134 @@
+/*  Matches pythia ( truth ) jets to geant ( detector ) jets with a
+    radial distance metric in rapidity-phi. The candidate jets are
+    binned in an eta-phi grid with cells at least as large as the
+    matching radius, so each lookup only visits the 3x3 neighbouring
+    cells instead of every jet, and a bitset records which jets have
+    already been used. All the index buffers are kept between events,
+    so matching does not allocate in the steady state.
+ */
+
+#include "fastjet/PseudoJet.hh"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#ifndef JETFINDING_JET_MATCHER_HH
+#define JETFINDING_JET_MATCHER_HH
+
+class jet_matcher {
+
+public:
+
+  /** greedy: pythia jets are matched in order of decreasing pt, each to
+               the highest pt unused geant jet within the radius ( this is
+               the original event::match_jets behaviour )
+      bidirectional: a pair is matched only if each jet is the other's
+               closest jet within the radius
+   */
+  enum match_mode { greedy, bidirectional };
+
+  /** converts "greedy" or "bidirectional" to a match_mode.
+      Throws on an unrecognized string
+   */
+  static match_mode parse_mode( const std::string& mode );
+
+  jet_matcher( double radius = 0.4, match_mode mode = greedy );
+
+  /** default destructor */
+  ~jet_matcher() {};
+
+  void set_radius( double radius )              { radius_ = radius; }
+  void set_mode( match_mode mode )              { mode_ = mode; }
+
+  double radius() const                         { return radius_; }
+  match_mode mode() const                       { return mode_; }
+
+  /** matches the pythia jets to the geant jets - both are assumed to be
+      sorted by pt. matches is filled with ( pythia index, geant index )
+      pairs, in order of the pythia jets. Returns the number of matches
+   */
+  unsigned match( const std::vector<fastjet::PseudoJet>& pythia_jets,
+                  const std::vector<fastjet::PseudoJet>& geant_jets,
+                  std::vector<std::pair<unsigned, unsigned> >& matches );
+
+  /** matches only the leading pythia jet, pythia_jets[leading], and returns
+      the index of its geant match, or -1 if it has none - the same pair
+      match() would give the leading jet. Neither list has to be sorted,
+      the jets are scanned directly instead of building the grids
+   */
+  int match_leading( const std::vector<fastjet::PseudoJet>& pythia_jets, unsigned leading,
+                     const std::vector<fastjet::PseudoJet>& geant_jets ) const;
+
+private:
+
+  /** a uniform grid in rapidity & phi over a set of jets. Cells are at
+      least radius wide, so every jet within radius of a point lies in
+      the 3x3 block of cells around it. The jets are stored in cell order
+      ( a counting sort ) with rapidity & phi kept in flat arrays
+   */
+  class eta_phi_grid {
+
+  public:
+
+    eta_phi_grid() : n_rap_(0), n_phi_(0), rap_min_(0.0), rap_width_(1.0), phi_width_(1.0) {};
+
+    /** rebuilds the grid over jets - reuses the existing buffers */
+    void build( const std::vector<fastjet::PseudoJet>& jets, double radius );
+
+    /** fills candidates with the indices of every jet within radius of
+        ( rap, phi ) - candidates is cleared first
+     */
+    void neighbours( double rap, double phi, double radius2, std::vector<unsigned>& candidates ) const;
+
+    double rap( unsigned idx ) const             { return rap_[idx]; }
+    double phi( unsigned idx ) const             { return phi_[idx]; }
+
+  private:
+
+    int n_rap_, n_phi_;
+    double rap_min_, rap_width_, phi_width_;
+
+    std::vector<double> rap_, phi_;
+    std::vector<unsigned> cell_of_;
+    std::vector<unsigned> cell_start_;
+    std::vector<unsigned> cell_fill_;
+    std::vector<unsigned> cell_jets_;
+
+    int rap_cell( double rap ) const;
+    int phi_cell( double phi ) const;
+
+  };
+
+  double radius_;
+  match_mode mode_;
+
+  eta_phi_grid geant_grid_;
+  eta_phi_grid pythia_grid_;
+
+  /** bitset of geant jets that have already been matched */
+  std::vector<unsigned long long> used_;
+
+  /** scratch space for the candidate lookups and best matches */
+  std::vector<unsigned> candidates_;
+  std::vector<int> best_geant_;
+
+  /** the two matching strategies */
+  void match_greedy( const std::vector<fastjet::PseudoJet>& pythia_jets,
+                     const std::vector<fastjet::PseudoJet>& geant_jets,
+                     std::vector<std::pair<unsigned, unsigned> >& matches );
+  void match_bidirectional( const std::vector<fastjet::PseudoJet>& pythia_jets,
+                            const std::vector<fastjet::PseudoJet>& geant_jets,
+                            std::vector<std::pair<unsigned, unsigned> >& matches );
+
+  /** returns the index of the closest jet in grid to ( rap, phi ) within
+      the radius, or -1 if there is none
+   */
+  int closest( const eta_phi_grid& grid, double rap, double phi );
+
+  bool is_used( unsigned idx ) const            { return ( used_[idx >> 6] >> ( idx & 63 ) ) & 1ULL; }
+  void set_used( unsigned idx )                 { used_[idx >> 6] |= 1ULL << ( idx & 63 ); }
+
+};
+
+#endif // JETFINDING_JET_MATCHER_HH
@@ -0,0 +1,351 @@
+// implementation for jet_stream
+
+#include "jet_stream.hh"
+
+#include "base.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+  /** the ring header - see jet_stream.hh */
+  const char ring_magic[8] = "JETRING";
+  const uint32_t ring_version = 1;
+  const uint32_t ring_data_offset = 4096;
+  const size_t ring_capacity_offset = 16, ring_dropped_offset = 24, ring_closed_offset = 32,
+               ring_head_offset = 64, ring_tail_offset = 128;
+
+  /** a constituent, as it is streamed */
+  struct stream_particle {
+    float pt, eta, phi, e;
+    int32_t charge;
+  };
+  static_assert( sizeof( stream_particle ) == 20, "stream particles are 20 bytes" );
+
+  void append_jet( std::vector<char>& frame, const fastjet::PseudoJet& jet, double area ) {
+    float values[5] = { float( jet.pt() ), float( jet.eta() ), float( jet.phi_std() ), float( jet.m() ), float( area ) };
+    frame.insert( frame.end(), (const char*) values, (const char*) values + sizeof( values ) );
+  }
+
+  void append_constituents( std::vector<char>& frame, const std::vector<fastjet::PseudoJet>& constituents ) {
+    for ( unsigned i = 0; i < constituents.size(); ++i ) {
+      stream_particle particle = { float( constituents[i].pt() ), float( constituents[i].eta() ),
+                                   float( constituents[i].phi_std() ), float( constituents[i].E() ),
+                                   int32_t( constituents[i].user_index() ) };
+      frame.insert( frame.end(), (const char*) &particle, (const char*) &particle + sizeof( particle ) );
+    }
+  }
+
+}
+
+stream_type parse_stream_type( const std::string& type ) {
+  if ( type == "ring" ) return stream_ring;
+  if ( type == "pipe" ) return stream_pipe;
+  __ERR( "unrecognized stream type: " << type ) throw std::exception();
+}
+
+stream_policy parse_stream_policy( const std::string& policy ) {
+  if ( policy == "block" ) return stream_block;
+  if ( policy == "drop" ) return stream_drop;
+  __ERR( "unrecognized stream policy: " << policy ) throw std::exception();
+}
+
+jet_stream::jet_stream() : path_(), type_(stream_ring), policy_(stream_block), ring_(nullptr), ring_size_(0),
+                           capacity_(0), fd_(-1), pipe_open_(false), created_(false), pipe_size_(0),
+                           next_connect_(), pending_(), schema_(), frame_(), mutex_(), published_(0), dropped_(0), bytes_(0),
+                           oversize_(0) { }
+
+jet_stream::~jet_stream() {
+  close();
+}
+
+bool jet_stream::open( const std::string& path, stream_type type, stream_policy policy, size_t size ) {
+  if ( is_open() ) { __ERR( "the stream is already open" ) return false; }
+  path_ = path;
+  type_ = type;
+  policy_ = policy;
+
+  if ( type_ == stream_pipe ) {
+    struct stat status;
+    if ( stat( path_.c_str(), &status ) == 0 ) {
+      if ( !S_ISFIFO( status.st_mode ) ) { __ERR( path_ << " exists, and is not a named pipe" ) return false; }
+    }
+    else if ( mkfifo( path_.c_str(), 0644 ) != 0 ) { __ERR( "can't create the named pipe " << path_ ) return false; }
+    else created_ = true;
+
+    // a consumer that goes away must not kill production - the
+    // failed write is handled instead
+    std::signal( SIGPIPE, SIG_IGN );
+    pipe_size_ = size;
+    pipe_open_ = true;
+    if ( policy_ == stream_block ) {
+      std::cout << "waiting for a consumer on " << path_ << std::endl;
+      if ( !connect_pipe( true ) ) { __ERR( "can't open the named pipe " << path_ ) close(); return false; }
+    }
+    else connect_pipe( false );
+    return true;
+  }
+
+  // the capacity is a power of 2, so that positions wrap with a mask
+  capacity_ = 4096;
+  while ( capacity_ < ( size > 0 ? size : size_t( 64 ) << 20 ) ) {
+    if ( capacity_ > std::numeric_limits<size_t>::max() / 4 ) { __ERR( "the ring size " << size << " is too large" ) return false; }
+    capacity_ <<= 1;
+  }
+  ring_size_ = ring_data_offset + capacity_;
+
+  int fd = ::open( path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+  if ( fd < 0 ) { __ERR( "can't create the ring " << path_ ) return false; }
+  if ( ftruncate( fd, ring_size_ ) != 0 ) { __ERR( "can't size the ring " << path_ ) ::close( fd ); return false; }
+  void* map = mmap( nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if ( map == MAP_FAILED ) { __ERR( "can't map the ring " << path_ ) return false; }
+  ring_ = (char*) map;
+
+  std::memset( ring_, 0, ring_data_offset );
+  std::memcpy( ring_, ring_magic, sizeof( ring_magic ) );
+  std::memcpy( ring_ + 8, &ring_version, 4 );
+  std::memcpy( ring_ + 12, &ring_data_offset, 4 );
+  std::memcpy( ring_ + ring_capacity_offset, &capacity_, 8 );
+  return true;
+}
+
+bool jet_stream::begin( const std::vector<std::string>& configs, const std::vector<std::string>& features ) {
+  std::lock_guard<std::mutex> lock( mutex_ );
+  if ( !is_open() || !schema_.empty() ) return true;
+
+  std::ostringstream text;
+  text << "jet_stream 1\n";
+  text << "configs " << configs.size() << "\n";
+  for ( unsigned i = 0; i < configs.size(); ++i )
+    text << configs[i] << "\n";
+  text << "features " << features.size() << "\n";
+  for ( unsigned i = 0; i < features.size(); ++i )
+    text << features[i] << "\n";
+
+  std::string payload = text.str();
+  start_frame( schema_ );
+  append( schema_, payload.data(), payload.size() );
+  finish_frame( schema_, frame_schema );
+
+  // a pipe consumer that is already connected gets it now, later
+  // ones when they connect
+  if ( type_ == stream_ring ) return send_ring( schema_, true );
+  if ( fd_ >= 0 ) send_pipe( schema_ );
+  return true;
+}
+
+bool jet_stream::publish( unsigned config, int partition, unsigned long long event_id, double weight,
+                          const jet_pair& pair, const Float_t* features, unsigned n_features ) {
+  std::lock_guard<std::mutex> lock( mutex_ );
+  if ( !is_open() ) return false;
+
+  const std::vector<fastjet::PseudoJet>& geant_constituents = *pair.geant_constituents;
+  const std::vector<fastjet::PseudoJet>& pythia_constituents = *pair.pythia_constituents;
+
+  uint32_t header[2] = { uint32_t( config ), uint32_t( partition ) };
+  uint64_t id = event_id;
+  uint32_t counts[4] = { uint32_t( n_features ), uint32_t( geant_constituents.size() ),
+                         uint32_t( pythia_constituents.size() ), 0 };
+
+  start_frame( frame_ );
+  append( frame_, header, sizeof( header ) );
+  append( frame_, &id, sizeof( id ) );
+  append( frame_, &weight, sizeof( weight ) );
+  append( frame_, counts, sizeof( counts ) );
+  append( frame_, features, n_features * sizeof( Float_t ) );
+  append_jet( frame_, *pair.geant, pair.geant_area );
+  append_jet( frame_, *pair.pythia, pair.pythia_area );
+  append_constituents( frame_, geant_constituents );
+  append_constituents( frame_, pythia_constituents );
+  finish_frame( frame_, frame_jet );
+
+  // a frame larger than the ring can never be sent, however long we wait
+  if ( type_ == stream_ring && frame_.size() > capacity_ ) {
+    if ( policy_ == stream_block ) {
+      __ERR( "a " << frame_.size() << " byte record doesn't fit in the " << capacity_
+             << " byte ring " << path_ << " - increase --stream-size" ) throw std::exception();
+    }
+    if ( oversize_++ == 0 )
+      __ERR( "records larger than the " << capacity_ << " byte ring " << path_
+             << " are dropped - increase --stream-size" )
+  }
+
+  bool sent = type_ == stream_ring ? send_ring( frame_, policy_ == stream_block ) : send_pipe( frame_ );
+  if ( !sent ) {
+    ++dropped_;
+    if ( ring_ != nullptr ) __atomic_store_n( (uint64_t*) ( ring_ + ring_dropped_offset ), dropped_, __ATOMIC_RELAXED );
+    return false;
+  }
+  ++published_;
+  bytes_ += frame_.size();
+  return true;
+}
+
+void jet_stream::close() {
+  std::lock_guard<std::mutex> lock( mutex_ );
+
+  std::vector<char> end;
+  start_frame( end );
+  finish_frame( end, frame_end );
+
+  if ( ring_ != nullptr ) {
+    // the closed flag is what the consumer relies on - the end frame
+    // is only written if there is room for it
+    send_ring( end, false );
+    __atomic_store_n( (uint32_t*) ( ring_ + ring_closed_offset ), uint32_t( 1 ), __ATOMIC_RELEASE );
+    munmap( ring_, ring_size_ );
+    ring_ = nullptr;
+  }
+
+  if ( pipe_open_ ) {
+    // the rest of the stream is written out, however long it takes
+    if ( fd_ >= 0 ) {
+      fcntl( fd_, F_SETFL, fcntl( fd_, F_GETFL ) & ~O_NONBLOCK );
+      if ( write_pipe( pending_.data(), pending_.size() ) )
+        write_pipe( end.data(), end.size() );
+    }
+    disconnect_pipe();
+    if ( created_ ) unlink( path_.c_str() );
+    pipe_open_ = false;
+    created_ = false;
+  }
+}
+
+void jet_stream::start_frame( std::vector<char>& frame ) {
+  frame.assign( 8, 0 );
+}
+
+void jet_stream::append( std::vector<char>& frame, const void* data, size_t size ) {
+  frame.insert( frame.end(), (const char*) data, (const char*) data + size );
+}
+
+void jet_stream::finish_frame( std::vector<char>& frame, frame_kind kind ) {
+  uint32_t header[2] = { uint32_t( frame.size() - 8 ), uint32_t( kind ) };
+  std::memcpy( frame.data(), header, sizeof( header ) );
+  frame.resize( ( frame.size() + 7 ) & ~size_t( 7 ), 0 );
+}
+
+bool jet_stream::send_ring( const std::vector<char>& frame, bool wait ) {
+  const uint64_t size = frame.size();
+  if ( size > capacity_ ) return false;
+
+  uint64_t* head = (uint64_t*) ( ring_ + ring_head_offset );
+  const uint64_t* tail = (const uint64_t*) ( ring_ + ring_tail_offset );
+  char* data = ring_ + ring_data_offset;
+
+  // we are the only writer of head
+  const uint64_t position = *head;
+  while ( capacity_ - ( position - __atomic_load_n( tail, __ATOMIC_ACQUIRE ) ) < size ) {
+    if ( !wait ) return false;
+    std::this_thread::sleep_for( std::chrono::microseconds( 50 ) );
+  }
+
+  // frames are 8 byte aligned, so only the payload can wrap
+  uint64_t offset = position & ( capacity_ - 1 );
+  uint64_t first = std::min( size, capacity_ - offset );
+  std::memcpy( data + offset, frame.data(), first );
+  std::memcpy( data, frame.data() + first, size - first );
+
+  // the frame is only visible to the consumer once it is complete
+  __atomic_store_n( head, position + size, __ATOMIC_RELEASE );
+  return true;
+}
+
+bool jet_stream::send_pipe( const std::vector<char>& frame ) {
+  if ( fd_ < 0 ) {
+    if ( policy_ == stream_block ) {
+      std::cout << "waiting for a consumer on " << path_ << std::endl;
+      if ( !connect_pipe( true ) ) return false;
+    }
+    else {
+      // looking for a consumer is a system call - not on every record
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if ( now < next_connect_ ) return false;
+      next_connect_ = now + std::chrono::milliseconds( 100 );
+      if ( !connect_pipe( false ) ) return false;
+    }
+  }
+
+  if ( policy_ == stream_drop ) {
+    // records are dropped until the last partial frame is through
+    if ( !flush_pending() ) return false;
+    return queue_pipe( frame.data(), frame.size() );
+  }
+
+  if ( !write_pipe( frame.data(), frame.size() ) ) {
+    // the consumer went away mid frame - the next one starts over
+    disconnect_pipe();
+    return false;
+  }
+  return true;
+}
+
+bool jet_stream::connect_pipe( bool wait ) {
+  // stream_drop keeps the descriptor non-blocking
+  int fd = ::open( path_.c_str(), O_WRONLY | ( wait ? 0 : O_NONBLOCK ) );
+  if ( fd < 0 ) return false;
+  if ( pipe_size_ > 0 ) fcntl( fd, F_SETPIPE_SZ, int( pipe_size_ ) );
+  fd_ = fd;
+
+  if ( schema_.empty() ) return true;
+  if ( policy_ == stream_drop ) return queue_pipe( schema_.data(), schema_.size() );
+  if ( !write_pipe( schema_.data(), schema_.size() ) ) {
+    disconnect_pipe();
+    return false;
+  }
+  return true;
+}
+
+void jet_stream::disconnect_pipe() {
+  if ( fd_ >= 0 ) ::close( fd_ );
+  fd_ = -1;
+  pending_.clear();
+}
+
+bool jet_stream::write_pipe( const char* data, size_t size ) {
+  while ( size > 0 ) {
+    ssize_t written = write( fd_, data, size );
+    if ( written < 0 ) {
+      if ( errno == EINTR ) continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool jet_stream::queue_pipe( const char* data, size_t size ) {
+  ssize_t written = write( fd_, data, size );
+  if ( written < 0 ) {
+    if ( errno != EAGAIN && errno != EINTR ) { disconnect_pipe(); return false; }
+    written = 0;
+  }
+  pending_.assign( data + written, data + size );
+  return true;
+}
+
+bool jet_stream::flush_pending() {
+  if ( pending_.empty() ) return true;
+  ssize_t written = write( fd_, pending_.data(), pending_.size() );
+  if ( written < 0 ) {
+    if ( errno != EAGAIN && errno != EINTR ) disconnect_pipe();
+    return false;
+  }
+  pending_.erase( pending_.begin(), pending_.begin() + written );
+  return pending_.empty();
+}
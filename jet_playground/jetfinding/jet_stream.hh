@@ -0,0 +1,180 @@
+/*  Streams the matched jet pairs to a concurrent consumer on the same
+    machine as they are produced, so that training can start reading
+    before process_geant is done. The records go through either
+
+    a ring:  a memory mapped file ( e.g. in /dev/shm ) holding a single
+             producer, single consumer ring buffer. The producer advances
+             head once a frame is complete, the consumer advances tail
+             once it has read one. Layout, all little endian:
+               0   char[8]  magic "JETRING"
+               8   uint32   version ( 1 )
+               12  uint32   data offset ( 4096 )
+               16  uint64   capacity of the data region ( a power of 2 )
+               24  uint64   frames dropped by the producer
+               32  uint32   closed - set once the end frame is written
+               64  uint64   head: bytes written ( producer )
+               128 uint64   tail: bytes read ( consumer )
+             byte n of the stream is at data offset + n % capacity
+    a pipe:  a named pipe ( created if it does not exist ), read with
+             ordinary blocking reads
+
+    Both carry the same frames: a uint32 payload size, a uint32 kind,
+    then the payload, padded to a multiple of 8 bytes.
+      kind 1 ( schema ):  text - "jet_stream 1", then "configs N" & "features K"
+                          lines, each followed by the names, one per line
+      kind 2 ( jet ):     uint32 config, int32 partition, uint64 eventID,
+                          float64 weight, uint32 n_features, n_geant, n_pythia,
+                          uint32 0, float32 features[n_features],
+                          float32 geant jet[5] & pythia jet[5] ( pt, eta,
+                          phi, m, area ), then the geant & pythia constituents,
+                          n_geant & n_pythia of { float32 pt, eta, phi, e;
+                          int32 charge }
+      kind 3 ( end ):     no payload - the producer is done
+    python reads them with models/jet_stream.py.
+
+    When the consumer falls behind, the producer either blocks until
+    there is room ( stream_block ), or drops the record and counts it
+    ( stream_drop ) - production never waits on the consumer. A pipe is
+    then written without blocking, and a frame it only took part of is
+    finished before any other is sent. Without a consumer on the pipe,
+    stream_block waits for one to connect, and stream_drop drops every
+    record until one does; each new consumer is sent the schema first.
+    A ring keeps its oldest frames, so the schema is always the first
+    frame a consumer reads. A record larger than the whole ring is an
+    error with stream_block, and is dropped ( and reported once ) with
+    stream_drop.
+ */
+
+#include "jet_features.hh"
+
+#include "fastjet/PseudoJet.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef JETFINDING_JET_STREAM_HH
+#define JETFINDING_JET_STREAM_HH
+
+enum stream_type { stream_ring, stream_pipe };
+enum stream_policy { stream_block, stream_drop };
+
+/** convert "ring" or "pipe", "block" or "drop". Throw on
+    an unrecognized string
+ */
+stream_type parse_stream_type( const std::string& type );
+stream_policy parse_stream_policy( const std::string& policy );
+
+class jet_stream {
+
+public:
+
+  enum frame_kind { frame_schema = 1, frame_jet = 2, frame_end = 3 };
+
+  jet_stream();
+
+  /** closes the stream, if it was not closed yet */
+  ~jet_stream();
+
+  /** creates the ring file ( size bytes of data, rounded up to a power
+      of 2 - 0 for 64 MB ), or the named pipe ( size sets the pipe
+      buffer - 0 keeps the system default ). With stream_block, opening a
+      pipe waits for the consumer. Returns false on failure
+   */
+  bool open( const std::string& path, stream_type type, stream_policy policy, size_t size = 0 );
+
+  /** sends the schema: the configuration & feature names. Only the first
+      call does anything, so every event sharing the stream can call it
+   */
+  bool begin( const std::vector<std::string>& configs, const std::vector<std::string>& features );
+
+  /** publishes one matched pair, with its features. Returns false if
+      the record was dropped. Thread safe. Throws if the record can never
+      fit in the ring, and the policy is stream_block
+   */
+  bool publish( unsigned config, int partition, unsigned long long event_id, double weight,
+                const jet_pair& pair, const Float_t* features, unsigned n_features );
+
+  /** sends the end frame, and releases the ring or pipe */
+  void close();
+
+  bool is_open() const                           { return type_ == stream_pipe ? pipe_open_ : ring_ != nullptr; }
+
+  unsigned long long published() const           { return published_; }
+  unsigned long long dropped() const             { return dropped_; }
+  unsigned long long bytes() const               { return bytes_; }
+
+private:
+
+  std::string path_;
+  stream_type type_;
+  stream_policy policy_;
+
+  /** ring: the mapping & its data region */
+  char* ring_;
+  size_t ring_size_;
+  uint64_t capacity_;
+
+  /** pipe: the descriptor, -1 while no consumer is connected. A pipe
+      we created is removed again on close()
+   */
+  int fd_;
+  bool pipe_open_;
+  bool created_;
+  size_t pipe_size_;
+  std::chrono::steady_clock::time_point next_connect_;
+  
+  /** stream_drop writes to the pipe without blocking - the part of a
+      frame the pipe didn't take is kept here, and sent before anything
+      else, so the consumer never sees a partial frame
+   */
+  std::vector<char> pending_;
+
+  /** the schema frame, resent to every new pipe consumer */
+  std::vector<char> schema_;
+
+  /** the frame being built - publish() holds the lock */
+  std::vector<char> frame_;
+  std::mutex mutex_;
+
+  unsigned long long published_, dropped_, bytes_;
+
+  /** records dropped because they are larger than the ring */
+  unsigned long long oversize_;
+
+  /** frames are built in place: start_frame() leaves room for the
+      header, the payload is appended, and finish_frame() fills in the
+      header & pads the frame to 8 bytes
+   */
+  static void start_frame( std::vector<char>& frame );
+  static void append( std::vector<char>& frame, const void* data, size_t size );
+  static void finish_frame( std::vector<char>& frame, frame_kind kind );
+
+  /** writes a complete frame, or drops it - false if dropped. wait
+      selects whether a full ring is waited on
+   */
+  bool send_ring( const std::vector<char>& frame, bool wait );
+  bool send_pipe( const std::vector<char>& frame );
+
+  /** connects to a pipe consumer, and sends it the schema. wait selects
+      a blocking open - otherwise it fails while there is no consumer
+   */
+  bool connect_pipe( bool wait );
+  void disconnect_pipe();
+
+  /** writes all of size bytes to the pipe, blocking */
+  bool write_pipe( const char* data, size_t size );
+  
+  /** stream_drop: writes what the pipe takes now, and keeps the rest in
+      pending_ - false if the consumer is gone
+   */
+  bool queue_pipe( const char* data, size_t size );
+  
+  /** stream_drop: sends what it can of pending_ - true once it is empty */
+  bool flush_pending();
+
+};
+
+#endif // JETFINDING_JET_STREAM_HH
@@ -0,0 +1,98 @@
+// merges the output of a sharded production: for every
+// configuration, the <name>_shard_I.root files written by
+// process_geant --shard I are merged into <name>.root
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "TFileMerger.h"
+#include "TSystem.h"
+
+/** reads n_shards from the plan.txt written by plan_shards,
+    returns 0 if the plan can't be read
+ */
+unsigned read_n_shards( const std::string& plan_file );
+
+int main( int argc, const char** argv ) {
+
+  /** merge_shards takes 1 or 2 arguments -
+   [1]: the manifest directory used for the production
+   [2]: the directory holding the shard output ( default: training/ )
+   */
+
+  std::string manifest;
+  std::string training_dir = "${CMAKE_BINARY_DIR}/training";
+
+  switch ( argc ) {
+    case 3 :
+      training_dir = argv[2];
+    case 2 :
+      manifest = argv[1];
+      break;
+    default :
+      std::cerr << "usage: merge_shards manifest_dir [output_dir]" << std::endl;
+      return -1;
+  }
+
+  unsigned n_shards = read_n_shards( manifest + "/plan.txt" );
+  if ( n_shards == 0 ) { std::cerr << "Error: could not read the shard count from " << manifest << "/plan.txt" << std::endl; return -1; }
+
+  /** every configuration's output set is found through its shard 0 file */
+  const std::string first_shard = "_shard_0.root";
+  std::vector<std::string> names;
+  void* dir = gSystem->OpenDirectory( training_dir.c_str() );
+  if ( dir == nullptr ) { std::cerr << "Error: can't open " << training_dir << std::endl; return -1; }
+  while ( const char* entry = gSystem->GetDirEntry( dir ) ) {
+    std::string file = entry;
+    if ( file.size() > first_shard.size() &&
+         file.compare( file.size() - first_shard.size(), first_shard.size(), first_shard ) == 0 )
+      names.push_back( file.substr( 0, file.size() - first_shard.size() ) );
+  }
+  gSystem->FreeDirectory( dir );
+
+  if ( names.empty() ) { std::cerr << "Error: no shard output found in " << training_dir << std::endl; return -1; }
+
+  int status = 0;
+  for ( unsigned i = 0; i < names.size(); ++i ) {
+    std::string base = training_dir + "/" + names[i];
+
+    // a missing shard means a failed job - don't write a partial merge
+    std::vector<std::string> inputs;
+    for ( unsigned j = 0; j < n_shards; ++j ) {
+      std::ostringstream input;
+      input << base << "_shard_" << j << ".root";
+      if ( gSystem->AccessPathName( input.str().c_str() ) ) {
+        std::cerr << "Error: missing " << input.str() << ", not merging " << names[i] << std::endl;
+        inputs.clear();
+        break;
+      }
+      inputs.push_back( input.str() );
+    }
+    if ( inputs.empty() ) { status = -1; continue; }
+
+    TFileMerger merger( false );
+    merger.OutputFile( ( base + ".root" ).c_str(), "RECREATE" );
+    for ( unsigned j = 0; j < inputs.size(); ++j )
+      merger.AddFile( inputs[j].c_str() );
+
+    if ( !merger.Merge() ) { std::cerr << "Error: merging " << names[i] << " failed" << std::endl; status = -1; continue; }
+    std::cout << "merged " << inputs.size() << " shards into " << base << ".root" << std::endl;
+  }
+
+  return status;
+}
+
+unsigned read_n_shards( const std::string& plan_file ) {
+  std::ifstream plan( plan_file );
+  std::string line;
+  while ( std::getline( plan, line ) ) {
+    if ( line.compare( 0, 8, "n_shards" ) != 0 ) continue;
+    std::string::size_type equals = line.find( '=' );
+    if ( equals == std::string::npos ) return 0;
+    return std::stoi( line.substr( equals + 1 ) );
+  }
+  return 0;
+}
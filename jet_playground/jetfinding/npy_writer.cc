@@ -0,0 +1,213 @@
+// implementation for npy_writer
+
+#include "npy_writer.hh"
+
+#include "base.hh"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+namespace {
+  /** the fixed header length: room for the largest dtype & shape we write,
+      and a multiple of 64 so that the data is aligned for mapping
+   */
+  const size_t header_size = 128;
+
+  /** creates every missing directory along path */
+  bool make_directory( const std::string& path ) {
+    for ( size_t pos = path.find( '/', 1 ); ; pos = path.find( '/', pos + 1 ) ) {
+      std::string dir = path.substr( 0, pos );
+      if ( dir != "" && mkdir( dir.c_str(), 0755 ) != 0 && errno != EEXIST ) return false;
+      if ( pos == std::string::npos ) return true;
+    }
+  }
+
+  /** the zip crc-32 */
+  uint32_t crc32_update( uint32_t crc, const char* data, size_t n ) {
+    static uint32_t table[256] = { 0 };
+    if ( table[1] == 0 ) {
+      for ( uint32_t i = 0; i < 256; ++i ) {
+        uint32_t c = i;
+        for ( int k = 0; k < 8; ++k ) c = c & 1 ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+        table[i] = c;
+      }
+    }
+    crc = ~crc;
+    for ( size_t i = 0; i < n; ++i )
+      crc = table[( crc ^ uint8_t( data[i] ) ) & 0xFF] ^ ( crc >> 8 );
+    return ~crc;
+  }
+
+  /** little endian integers for the zip records */
+  void put16( std::string& out, uint16_t v ) { out += char( v & 0xFF ); out += char( v >> 8 ); }
+  void put32( std::string& out, uint32_t v ) { put16( out, v & 0xFFFF ); put16( out, v >> 16 ); }
+}
+
+npy_writer::npy_writer( size_t buffer_size ) : out_(), path_(), descr_(), width_(0), row_bytes_(0),
+              rows_(0), buffer_(), buffer_size_( buffer_size ) { }
+
+npy_writer::~npy_writer() {
+  if ( out_.is_open() ) close();
+}
+
+bool npy_writer::open( const std::string& path, const std::string& descr, unsigned item_size, unsigned width ) {
+  path_ = path;
+  descr_ = descr;
+  width_ = width;
+  row_bytes_ = size_t( item_size ) * ( width > 0 ? width : 1 );
+  rows_ = 0;
+  buffer_.clear();
+  buffer_.reserve( buffer_size_ );
+
+  out_.open( path_, std::ios::binary | std::ios::trunc );
+  if ( !out_.is_open() ) { __ERR( "can't open " << path_ ) return false; }
+  out_.write( header().data(), header_size );
+  return bool( out_ );
+}
+
+void npy_writer::append( const void* row ) {
+  if ( buffer_.size() + row_bytes_ > buffer_size_ ) flush();
+  const char* bytes = static_cast<const char*>( row );
+  buffer_.insert( buffer_.end(), bytes, bytes + row_bytes_ );
+  ++rows_;
+}
+
+void npy_writer::flush() {
+  out_.write( buffer_.data(), buffer_.size() );
+  buffer_.clear();
+}
+
+bool npy_writer::close() {
+  if ( !out_.is_open() ) return false;
+  flush();
+  out_.seekp( 0 );
+  out_.write( header().data(), header_size );
+  bool status = bool( out_ );
+  out_.close();
+  if ( !status ) __ERR( "failed writing " << path_ )
+  return status;
+}
+
+std::string npy_writer::header() const {
+  std::ostringstream dict;
+  dict << "{'descr': '" << descr_ << "', 'fortran_order': False, 'shape': (" << rows_ << ",";
+  if ( width_ > 0 ) dict << " " << width_;
+  dict << "), }";
+
+  // magic, version 1.0, the dict length, and the dict padded
+  // with spaces & a newline to the fixed header size
+  std::string header( "\x93NUMPY\x01\x00", 8 );
+  put16( header, header_size - 10 );
+  header += dict.str();
+  header.resize( header_size - 1, ' ' );
+  header += '\n';
+  return header;
+}
+
+npy_table::npy_table() : directory_(), files_(), sources_(), columns_(), entries_(0) { }
+
+bool npy_table::open( const std::string& directory ) {
+  directory_ = directory;
+  if ( !make_directory( directory_ ) ) { __ERR( "can't create " << directory_ ) return false; }
+  return true;
+}
+
+bool npy_table::add_column( const std::string& name, const char* descr, unsigned item_size,
+                            unsigned width, const void* source ) {
+  std::unique_ptr<npy_writer> column( new npy_writer() );
+  if ( !column->open( directory_ + "/" + name + ".npy", descr, item_size, width ) ) return false;
+  files_.push_back( name + ".npy" );
+  sources_.push_back( source );
+  columns_.push_back( std::move( column ) );
+  return true;
+}
+
+void npy_table::fill() {
+  for ( unsigned i = 0; i < columns_.size(); ++i )
+    columns_[i]->append( sources_[i] );
+  ++entries_;
+}
+
+bool npy_table::close() {
+  bool status = true;
+  for ( unsigned i = 0; i < columns_.size(); ++i )
+    status = columns_[i]->close() && status;
+  return status;
+}
+
+bool npz_pack( const std::string& path, const std::vector<std::string>& files,
+               const std::vector<std::string>& names ) {
+  const uint64_t zip32_max = 0xFFFFFFFFu;
+
+  std::ofstream out( path, std::ios::binary | std::ios::trunc );
+  if ( !out.is_open() ) { __ERR( "can't open " << path ) return false; }
+
+  // each member is a local header ( its crc is patched in once the
+  // data has been copied ), followed by the file itself
+  std::string central;
+  std::vector<char> buffer( 1 << 20 );
+  for ( unsigned i = 0; i < files.size(); ++i ) {
+    std::ifstream in( files[i], std::ios::binary );
+    if ( !in.is_open() ) { __ERR( "can't read " << files[i] ) return false; }
+    in.seekg( 0, std::ios::end );
+    uint64_t size = in.tellg();
+    in.seekg( 0 );
+    uint64_t offset = out.tellp();
+    if ( size >= zip32_max || offset >= zip32_max ) {
+      __ERR( path << " would need zip64 - use the .npy files instead" ) return false;
+    }
+
+    std::string local;
+    put32( local, 0x04034b50 );
+    put16( local, 20 ); put16( local, 0 ); put16( local, 0 );   // version, flags, stored
+    put16( local, 0 ); put16( local, 0x21 );                    // time & date: 1980-01-01
+    put32( local, 0 ); put32( local, size ); put32( local, size );
+    put16( local, names[i].size() ); put16( local, 0 );
+    local += names[i];
+    out.write( local.data(), local.size() );
+
+    uint32_t crc = 0;
+    while ( in ) {
+      in.read( buffer.data(), buffer.size() );
+      std::streamsize n = in.gcount();
+      crc = crc32_update( crc, buffer.data(), n );
+      out.write( buffer.data(), n );
+    }
+    uint64_t end = out.tellp();
+    std::string crc_bytes;
+    put32( crc_bytes, crc );
+    out.seekp( offset + 14 );
+    out.write( crc_bytes.data(), 4 );
+    out.seekp( end );
+
+    put32( central, 0x02014b50 );
+    put16( central, 20 ); put16( central, 20 ); put16( central, 0 ); put16( central, 0 );
+    put16( central, 0 ); put16( central, 0x21 );
+    put32( central, crc ); put32( central, size ); put32( central, size );
+    put16( central, names[i].size() ); put16( central, 0 ); put16( central, 0 );
+    put16( central, 0 ); put16( central, 0 ); put32( central, 0 );
+    put32( central, offset );
+    central += names[i];
+  }
+
+  uint64_t central_offset = out.tellp();
+  if ( central_offset + central.size() >= zip32_max || files.size() >= 0xFFFF ) {
+    __ERR( path << " would need zip64 - use the .npy files instead" ) return false;
+  }
+  std::string end;
+  put32( end, 0x06054b50 );
+  put16( end, 0 ); put16( end, 0 );
+  put16( end, files.size() ); put16( end, files.size() );
+  put32( end, central.size() ); put32( end, central_offset );
+  put16( end, 0 );
+  out.write( central.data(), central.size() );
+  out.write( end.data(), end.size() );
+
+  if ( !out ) { __ERR( "failed writing " << path ) return false; }
+  return true;
+}
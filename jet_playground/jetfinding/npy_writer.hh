@@ -0,0 +1,127 @@
+/*  Streaming writers for NumPy's .npy format, so that the training data
+    can be loaded with numpy.load( mmap_mode='r' ) - no ROOT, and nothing
+    to parse on the python side. Rows are appended through a fixed size
+    buffer, so memory stays bounded however many rows are written: the
+    header is written up front with room for any row count, and patched
+    with the final shape when the file is closed. npz_pack() bundles a
+    set of .npy files into a single, uncompressed .npz.
+
+    Values are written in native byte order, and the headers declare
+    little endian data - the only hosts we run on.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef JETFINDING_NPY_WRITER_HH
+#define JETFINDING_NPY_WRITER_HH
+
+/** the numpy dtype string for each element type we write */
+inline const char* npy_descr( const float* )    { return "<f4"; }
+inline const char* npy_descr( const double* )   { return "<f8"; }
+inline const char* npy_descr( const int32_t* )  { return "<i4"; }
+inline const char* npy_descr( const uint64_t* ) { return "<u8"; }
+
+/** a single .npy file of shape ( rows ) or ( rows, width ) */
+class npy_writer {
+
+public:
+
+  /** rows are written to disk in chunks of at most buffer_size bytes */
+  explicit npy_writer( size_t buffer_size = 1 << 20 );
+
+  /** closes the file, if it was not closed yet */
+  ~npy_writer();
+
+  /** creates path, for elements of type descr ( see npy_descr() ) and
+      item_size bytes, width elements per row - width 0 writes a one
+      dimensional array. Returns false if the file can't be opened
+   */
+  bool open( const std::string& path, const std::string& descr, unsigned item_size, unsigned width );
+
+  /** appends one row: width elements ( or one, for a 1D array ) from row */
+  void append( const void* row );
+
+  /** flushes the buffer & writes the final shape into the header */
+  bool close();
+
+  unsigned long long rows() const              { return rows_; }
+
+private:
+
+  std::ofstream out_;
+  std::string path_;
+  std::string descr_;
+  unsigned width_;
+  size_t row_bytes_;
+  unsigned long long rows_;
+  std::vector<char> buffer_;
+  size_t buffer_size_;
+
+  /** the header for the current row count, always header_size bytes */
+  std::string header() const;
+
+  void flush();
+
+};
+
+/** a set of .npy files with one row per entry, filled from fixed
+    addresses - the numpy equivalent of a TTree with leaf branches:
+    add the columns, then fill() appends the current values of every
+    column. Column name.npy is written to the table's directory
+ */
+class npy_table {
+
+public:
+
+  npy_table();
+
+  /** creates directory ( if needed ) - must be called before adding columns */
+  bool open( const std::string& directory );
+
+  /** adds column name, read from source on every fill(): one value, or
+      width values for a fixed width array column. source must stay valid
+      until the table is closed
+   */
+  template <typename T>
+  bool add_column( const std::string& name, const T* source, unsigned width = 0 ) {
+    return add_column( name, npy_descr( source ), sizeof( T ), width, source );
+  }
+
+  /** appends a row to every column */
+  void fill();
+
+  /** closes every column - returns false if any of them failed */
+  bool close();
+
+  unsigned long long entries() const           { return entries_; }
+
+  /** the directory, and the file name of each column in it */
+  const std::string& directory() const         { return directory_; }
+  const std::vector<std::string>& files() const { return files_; }
+
+private:
+
+  std::string directory_;
+  std::vector<std::string> files_;
+  std::vector<const void*> sources_;
+  std::vector<std::unique_ptr<npy_writer> > columns_;
+  unsigned long long entries_;
+
+  bool add_column( const std::string& name, const char* descr, unsigned item_size,
+                   unsigned width, const void* source );
+
+};
+
+/** writes the files ( paths ) into a stored ( uncompressed ) zip at path,
+    under the given member names - a .npz when the members are .npy files.
+    Returns false on an I/O error, or if the archive would need zip64
+    ( a member or the archive over 4 GB ) - use the .npy files directly then
+ */
+bool npz_pack( const std::string& path, const std::vector<std::string>& files,
+               const std::vector<std::string>& names );
+
+#endif // JETFINDING_NPY_WRITER_HH
@@ -0,0 +1,126 @@
+// implementation for output_writer
+
+#include "output_writer.hh"
+
+#include "base.hh"
+
+#include "TBranch.h"
+#include "TObjArray.h"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+int parse_output_codec( const std::string& codec ) {
+  std::string profile = codec.substr( 0, codec.find( ':' ) );
+
+  // ROOT's algorithm numbers: 1 zlib, 2 lzma, 4 lz4, 5 zstd
+  int algorithm = -1, level = 0;
+  if      ( codec == "default" ) return -1;
+  else if ( codec == "none" )    return 0;
+  else if ( profile == "zlib" )  { algorithm = 1; level = 1; }
+  else if ( profile == "lzma" )  { algorithm = 2; level = 7; }
+  else if ( profile == "lz4" )   { algorithm = 4; level = 4; }
+  else if ( profile == "zstd" )  { algorithm = 5; level = 5; }
+
+  if ( algorithm >= 0 && profile.size() < codec.size() ) {
+    std::string value = codec.substr( profile.size() + 1 );
+    level = value.size() == 1 && value[0] >= '1' && value[0] <= '9' ? value[0] - '0' : -1;
+  }
+  if ( algorithm < 0 || level < 0 ) {
+    __ERR( "unrecognized output codec: " << codec ) throw std::exception();
+  }
+  return 100 * algorithm + level;
+}
+
+void output_settings::apply( TTree* tree ) const {
+  if ( basket_size > 0 ) tree->SetBasketSize( "*", basket_size );
+  if ( autoflush != 0 ) tree->SetAutoFlush( autoflush );
+  if ( compression >= 0 ) {
+    // sets the sub-branches of the split object branches as well
+    TObjArray* branches = tree->GetListOfBranches();
+    for ( Int_t i = 0; i < branches->GetEntriesFast(); ++i )
+      static_cast<TBranch*>( branches->At( i ) )->SetCompressionSettings( compression );
+  }
+}
+
+output_writer::output_writer( unsigned depth, consumer write ) : write_( write ), ring_( depth > 0 ? depth : 1 ),
+              head_(0), tail_(0), count_(0), stop_(false), error_(), n_records_(0), write_ns_(0), n_waits_(0),
+              lock_(), not_empty_(), not_full_(), empty_(), thread_()
+{ }
+
+output_writer::~output_writer() {
+  {
+    std::lock_guard<std::mutex> guard( lock_ );
+    stop_ = true;
+  }
+  not_empty_.notify_all();
+  if ( thread_.joinable() )
+    thread_.join();
+}
+
+void output_writer::start() {
+  if ( !thread_.joinable() )
+    thread_ = std::thread( &output_writer::run, this );
+}
+
+output_record& output_writer::acquire() {
+  std::unique_lock<std::mutex> guard( lock_ );
+  if ( count_ == ring_.size() && !error_ ) {
+    ++n_waits_;
+    not_full_.wait( guard, [this] { return count_ < ring_.size() || error_; } );
+  }
+  if ( error_ ) std::rethrow_exception( error_ );
+  // the tail slot is free until push(), so it is filled without the lock
+  return ring_[tail_];
+}
+
+void output_writer::push() {
+  std::lock_guard<std::mutex> guard( lock_ );
+  if ( error_ ) return;
+  tail_ = ( tail_ + 1 ) % ring_.size();
+  ++count_;
+  not_empty_.notify_one();
+}
+
+void output_writer::drain() {
+  std::unique_lock<std::mutex> guard( lock_ );
+  empty_.wait( guard, [this] { return count_ == 0 || error_; } );
+  if ( error_ ) std::rethrow_exception( error_ );
+}
+
+void output_writer::run() {
+  while ( true ) {
+    {
+      // stop_ only ends the loop once everything queued is written
+      std::unique_lock<std::mutex> guard( lock_ );
+      not_empty_.wait( guard, [this] { return count_ > 0 || stop_; } );
+      if ( count_ == 0 ) return;
+    }
+
+    // the head record stays queued while it is written, so it is not reused
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+      write_( ring_[head_] );
+    } catch ( ... ) {
+      // the output is unusable from here on - the rest of the queue is
+      // dropped, and the exception is thrown again on the event thread
+      std::lock_guard<std::mutex> guard( lock_ );
+      error_ = std::current_exception();
+      count_ = 0;
+      head_ = tail_;
+      not_full_.notify_all();
+      empty_.notify_all();
+      return;
+    }
+    write_ns_.fetch_add( std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start ).count(), std::memory_order_relaxed );
+    n_records_.fetch_add( 1, std::memory_order_relaxed );
+
+    std::lock_guard<std::mutex> guard( lock_ );
+    head_ = ( head_ + 1 ) % ring_.size();
+    --count_;
+    not_full_.notify_one();
+    if ( count_ == 0 ) empty_.notify_all();
+  }
+}
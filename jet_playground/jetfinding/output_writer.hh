@@ -0,0 +1,160 @@
+/*  Moves the tree filling, and with it the basket compression, off of
+    the event loop. The event thread copies every completed output record
+    - a matched jet pair, or the summary of an event for the event tree -
+    into a slot of a bounded ring, and a dedicated writer thread takes
+    them in order, sets the branch buffers & fills the trees, so that
+    compressing the baskets overlaps with clustering the next events.
+    When the ring is full the event thread waits, so memory stays bounded.
+    The slots are allocated once, and their vectors keep their capacity
+    as they are recycled.
+
+    output_settings holds the on disk layout of the trees: the codec, the
+    auto flush interval & the basket size.
+ */
+
+#include "TTree.h"
+
+#include "fastjet/PseudoJet.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef JETFINDING_OUTPUT_WRITER_HH
+#define JETFINDING_OUTPUT_WRITER_HH
+
+/** converts a codec profile to ROOT compression settings
+    ( 100 * algorithm + level ):
+      lz4:  LZ4, level 4 - fast to write & read, for intermediate output
+      zstd: ZSTD, level 5 - smaller than zlib, and faster to read
+      lzma: LZMA, level 7 - the smallest files, for archival
+      zlib: ZLIB, level 1 - ROOT's traditional default
+      none: uncompressed
+    "default" keeps the settings of the file ( -1 ). A level can be given
+    as profile:level, e.g. zstd:9. Throws on an unrecognized string
+ */
+int parse_output_codec( const std::string& codec );
+
+/** how the output trees are laid out on disk. The defaults
+    leave ROOT's settings alone
+ */
+struct output_settings {
+
+  output_settings() : compression(-1), autoflush(0), basket_size(0) {};
+
+  /** compression settings from parse_output_codec() - set on
+      every branch, -1 for the file's
+   */
+  int compression;
+
+  /** TTree::SetAutoFlush: > 0 flushes the baskets every autoflush entries,
+      < 0 every -autoflush bytes, 0 keeps ROOT's default ( 30 MB )
+   */
+  Long64_t autoflush;
+
+  /** the basket size of every branch in bytes - 0 keeps ROOT's default */
+  Int_t basket_size;
+
+  /** applies the settings to a tree - after its branches are created */
+  void apply( TTree* tree ) const;
+};
+
+/** everything written for one matched pair ( pair is true ), or for one
+    event ( the event tree's row ). The jets & constituents are plain
+    copies - momentum & charge, without the cluster sequence - so the
+    writer thread never touches the event thread's fastjet structures
+ */
+struct output_record {
+
+  output_record() : pair(false), analysis(0), partition(0), eventID(0), run_id(0), event_id(0),
+                    refmult(0), n_matched(0), vz(0.0), weight(1.0), geant(), pythia(), geant_area(0.0),
+                    pythia_area(0.0), geant_constituents(), pythia_constituents(), features() {};
+
+  bool pair;
+
+  /** the configuration, and the partition of the event */
+  unsigned analysis;
+  int partition;
+
+  unsigned long eventID;
+  int run_id, event_id, refmult, n_matched;
+  float vz;
+  double weight;
+
+  fastjet::PseudoJet geant, pythia;
+  double geant_area, pythia_area;
+  std::vector<fastjet::PseudoJet> geant_constituents, pythia_constituents;
+  std::vector<Float_t> features;
+};
+
+class output_writer {
+
+public:
+
+  /** writes a record to the output - called on the writer thread */
+  typedef std::function<void( output_record& )> consumer;
+
+  /** up to depth records can be queued ahead of the writer */
+  output_writer( unsigned depth, consumer write );
+
+  /** writes everything still queued, and joins the writer thread */
+  ~output_writer();
+
+  /** starts the writer thread */
+  void start();
+
+  /** blocks until a slot is free, and returns it - the record
+      is queued by the following push(). If writing a record threw on
+      the writer thread, the exception is thrown here instead
+   */
+  output_record& acquire();
+  void push();
+
+  /** blocks until every queued record has been written, so that
+      the output can be used from the calling thread - throws the
+      writer thread's exception, as acquire()
+   */
+  void drain();
+
+  /** the queue depth, the records written, the time the writer spent
+      writing them, and the number of times acquire() had to wait on
+      the writer - if that is a large fraction of the records, the
+      loop is bound by the output
+   */
+  unsigned depth() const                          { return ring_.size(); }
+  unsigned long long n_records() const            { return n_records_.load( std::memory_order_relaxed ); }
+  unsigned long long write_ns() const             { return write_ns_.load( std::memory_order_relaxed ); }
+  unsigned long n_waits() const                   { return n_waits_; }
+
+private:
+
+  /** the writer thread's loop */
+  void run();
+
+  consumer write_;
+  std::vector<output_record> ring_;
+
+  /** head_ is the oldest queued record, tail_ the next slot acquire()
+      returns. count_ includes the record being written
+   */
+  unsigned head_, tail_, count_;
+  bool stop_;
+
+  /** what the consumer threw - the writer thread stops at the first */
+  std::exception_ptr error_;
+
+  std::atomic<unsigned long long> n_records_, write_ns_;
+  unsigned long n_waits_;
+
+  std::mutex lock_;
+  std::condition_variable not_empty_, not_full_, empty_;
+  std::thread thread_;
+
+};
+
+#endif // JETFINDING_OUTPUT_WRITER_HH
@@ -0,0 +1,43 @@
+/*  Kinematic & charge cuts on the jet constituents, applied while the
+    reader converts its TStarJetVectors to pseudojets. Kept separate
+    from the reader so that the jet configurations ( and the benchmarks,
+    which have no STAR dependencies ) can carry them around.
+ */
+
+#include <cmath>
+
+#ifndef JETFINDING_PARTICLE_CUTS_HH
+#define JETFINDING_PARTICLE_CUTS_HH
+
+/** the particle lists come out of the conversion ready for
+    clustering, without further selector passes.
+    pt_min < pt < pt_max, |rap| < abs_rap_max, and if charged_only
+    is set, only particles with charge +-1 or +-2 are kept
+ */
+struct particle_cuts {
+  
+  particle_cuts( double pt_min_ = 0.0, double pt_max_ = 1e10,
+                 double abs_rap_max_ = 1e10, bool charged_only_ = false ) :
+                 pt_min( pt_min_ ), pt_max( pt_max_ ), abs_rap_max( abs_rap_max_ ),
+                 charged_only( charged_only_ ) {};
+  
+  double pt_min;
+  double pt_max;
+  double abs_rap_max;
+  bool charged_only;
+  
+  /** the charge cut, and the pt & rapidity cuts */
+  bool accept_charge( int charge ) const {
+    return !charged_only || charge == -1 || charge == 1 || charge == -2 || charge == 2;
+  }
+  bool accept_kinematics( double pt, double rap ) const {
+    return pt >= pt_min && pt <= pt_max && std::fabs( rap ) <= abs_rap_max;
+  }
+  
+  bool operator==( const particle_cuts& rhs ) const {
+    return pt_min == rhs.pt_min && pt_max == rhs.pt_max &&
+           abs_rap_max == rhs.abs_rap_max && charged_only == rhs.charged_only;
+  }
+};
+
+#endif // JETFINDING_PARTICLE_CUTS_HH
@@ -0,0 +1,237 @@
+// plans a multi-node production: splits a list of input files
+// into shards of roughly equal processing time, and writes one
+// file list per shard that process_geant can read with
+// --manifest DIR --shard I
+
+#include "event.hh"
+#include "jet_config.hh"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+#include "TChain.h"
+#include "TSystem.h"
+
+/** one input file: its entry count, its pt-hat bin and its
+    estimated processing cost ( in seconds )
+ */
+struct input_file {
+  std::string path;
+  std::string bin;
+  long long entries;
+  double cost;
+};
+
+/** reads the ( one per line ) file paths from a .list/.txt file */
+std::vector<std::string> read_file_list( const std::string& list );
+
+/** splits a comma separated list of values */
+std::vector<std::string> parse_list( const std::string& list );
+
+/** runs the full event processing for every configuration over the
+    first n_probe entries of file, and returns the time per entry in
+    seconds. The files are grouped by geant_reader::xsec_bin - all the
+    files in a pt-hat bin have the same per event cost
+ */
+double probe_file( const std::string& file, const std::string& settings,
+                   const std::vector<jet_config>& configs, unsigned n_probe );
+
+int main( int argc, const char** argv ) {
+
+  /** plan_shards takes 3 to 9 arguments -
+   [1]: the list of input files ( the same .list used for a single job )
+   [2]: the number of shards
+   [3]: the manifest directory - shard_I.list & plan.txt are written here
+   [4]: number of entries processed per pt-hat bin to estimate the cost
+        per entry ( default 200 )
+   [5]: reader settings file
+   [6-9]: the jet configurations the production runs, in process_geant's
+        order - algorithms, radii, inclusive, charged. Algorithms, radii
+        & charged take comma separated lists, as process_geant's sweep
+        options do ( default antikt 0.4 false false )
+   */
+
+  std::string file_list;
+  unsigned n_shards;
+  std::string manifest;
+  unsigned n_probe      = 200;
+  std::string settings  = "${CMAKE_BINARY_DIR}/settings/reader.txt";
+  std::string algorithms = "antikt";
+  std::string radii     = "0.4";
+  std::string inclusive = "false";
+  std::string charged   = "false";
+
+  switch ( argc ) {
+    case 10 :
+      charged = argv[9];
+    case 9 :
+      inclusive = argv[8];
+    case 8 :
+      radii = argv[7];
+    case 7 :
+      algorithms = argv[6];
+    case 6 :
+      settings = argv[5];
+    case 5 :
+      n_probe = std::stoi( argv[4] );
+    case 4 :
+      file_list = argv[1];
+      n_shards = std::stoi( argv[2] );
+      manifest = argv[3];
+      break;
+    default :
+      std::cerr << "usage: plan_shards file_list n_shards manifest_dir [probe_entries] [settings] "
+                << "[algorithms] [radii] [inclusive] [charged]" << std::endl;
+      return -1;
+  }
+  if ( n_shards == 0 ) { std::cerr << "Error: need at least one shard" << std::endl; return -1; }
+
+  /** the probe runs the same configurations as the production, so
+      that a sweep is costed as one
+   */
+  std::vector<bool> charge_modes;
+  std::vector<std::string> values = parse_list( charged );
+  for ( unsigned i = 0; i < values.size(); ++i ) {
+    if ( values[i] != "true" && values[i] != "false" ) {
+      std::cerr << "Error unrecognized argument for charged jets ( true or false ) " << std::endl;
+      return -1;
+    }
+    charge_modes.push_back( values[i] == "true" );
+  }
+  if ( inclusive != "true" && inclusive != "false" ) {
+    std::cerr << "Error unrecognized argument for inclusive ( true or false ) " << std::endl;
+    return -1;
+  }
+
+  std::vector<jet_config> configs;
+  try {
+    std::vector<double> radius_list;
+    values = parse_list( radii );
+    for ( unsigned i = 0; i < values.size(); ++i ) radius_list.push_back( std::stod( values[i] ) );
+    configs = make_jet_configs( parse_list( algorithms ), radius_list, charge_modes, inclusive == "true" );
+  } catch ( std::exception& e ) {
+    std::cerr << "unrecognized jet algorithm or radius, exiting" << std::endl;
+    return -1;
+  }
+  if ( configs.empty() ) { std::cerr << "Error: no jet configurations to probe" << std::endl; return -1; }
+
+  std::vector<std::string> paths = read_file_list( file_list );
+  if ( paths.empty() ) { std::cerr << "Error: no input files found in " << file_list << std::endl; return -1; }
+
+  /** cost per entry is probed once per pt-hat bin, and scaled
+      by the number of entries in each file
+   */
+  std::map<std::string, double> bin_cost;
+  std::vector<input_file> files;
+  for ( unsigned i = 0; i < paths.size(); ++i ) {
+    input_file file;
+    file.path = paths[i];
+    file.bin = geant_reader::xsec_bin( paths[i] );
+
+    TChain chain( "JetTree" );
+    chain.Add( file.path.c_str() );
+    file.entries = chain.GetEntries();
+
+    if ( bin_cost.find( file.bin ) == bin_cost.end() ) {
+      bin_cost[file.bin] = probe_file( file.path, settings, configs, n_probe );
+      std::cout << "bin " << file.bin << ": " << 1.0e3 * bin_cost[file.bin] << " ms/entry" << std::endl;
+    }
+    file.cost = file.entries * bin_cost[file.bin];
+    files.push_back( file );
+  }
+
+  /** longest processing time first: take the files from most to least
+      expensive, and always give the next one to the cheapest shard
+   */
+  std::sort( files.begin(), files.end(),
+             []( const input_file& a, const input_file& b ) { return a.cost > b.cost; } );
+
+  std::vector<double> shard_cost( n_shards, 0.0 );
+  std::vector<long long> shard_entries( n_shards, 0 );
+  std::vector<std::vector<unsigned> > shard_files( n_shards );
+  for ( unsigned i = 0; i < files.size(); ++i ) {
+    unsigned shard = std::min_element( shard_cost.begin(), shard_cost.end() ) - shard_cost.begin();
+    shard_cost[shard] += files[i].cost;
+    shard_entries[shard] += files[i].entries;
+    shard_files[shard].push_back( i );
+  }
+
+  /** write the manifest - one file list per shard, and a summary */
+  gSystem->mkdir( manifest.c_str(), true );
+
+  for ( unsigned i = 0; i < n_shards; ++i ) {
+    std::ostringstream name;
+    name << manifest << "/shard_" << i << ".list";
+    std::ofstream list( name.str() );
+    for ( unsigned j = 0; j < shard_files[i].size(); ++j )
+      list << files[shard_files[i][j]].path << "\n";
+  }
+
+  std::ofstream plan( manifest + "/plan.txt" );
+  plan << "# written by plan_shards from " << file_list << "\n";
+  plan << "# shard  estimated_seconds  n_files  n_entries\n";
+  plan << "n_shards = " << n_shards << "\n";
+  for ( unsigned i = 0; i < n_shards; ++i )
+    plan << "shard " << i << " " << shard_cost[i] << " " << shard_files[i].size() << " " << shard_entries[i] << "\n";
+  plan << "# file  pt_hat_bin  entries  estimated_seconds\n";
+  for ( unsigned i = 0; i < files.size(); ++i )
+    plan << "file " << files[i].path << " " << files[i].bin << " " << files[i].entries << " " << files[i].cost << "\n";
+
+  double max_cost = *std::max_element( shard_cost.begin(), shard_cost.end() );
+  double min_cost = *std::min_element( shard_cost.begin(), shard_cost.end() );
+  std::cout << "planned " << files.size() << " files into " << n_shards << " shards: estimated "
+            << min_cost << " - " << max_cost << " s per shard" << std::endl;
+
+  return 0;
+}
+
+std::vector<std::string> read_file_list( const std::string& list ) {
+  std::vector<std::string> paths;
+  std::ifstream in( list );
+  std::string line;
+  while ( std::getline( in, line ) ) {
+    line.erase( std::remove( line.begin(), line.end(), ' ' ), line.end() );
+    if ( line.empty() || line[0] == '#' ) continue;
+    paths.push_back( line );
+  }
+  return paths;
+}
+
+std::vector<std::string> parse_list( const std::string& list ) {
+  std::vector<std::string> values;
+  std::string::size_type base = 0;
+  while ( base <= list.size() ) {
+    std::string::size_type comma = list.find( ',', base );
+    if ( comma == std::string::npos ) comma = list.size();
+    if ( comma > base ) values.push_back( list.substr( base, comma - base ) );
+    base = comma + 1;
+  }
+  return values;
+}
+
+double probe_file( const std::string& file, const std::string& settings,
+                   const std::vector<jet_config>& configs, unsigned n_probe ) {
+
+  event probe( file, settings );
+  for ( unsigned i = 0; i < configs.size(); ++i )
+    probe.add_config( configs[i] );
+  probe.init_tree();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while ( probe.next() ) {
+    probe.process_event();
+    if ( probe.current_event() + 1 >= n_probe ) break;
+  }
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+  // rejected entries are read too, so the cost is per entry scanned
+  double n_scanned = probe.current_event() + 1;
+  return seconds / n_scanned;
+}
@@ -4,15 +4,88 @@
 // also extracts event information like refmult, etc
 
 #include "event.hh"
+#include "jet_config.hh"
+#include "work_queue.hh"
+#include "checkpoint.hh"
+#include "run_stats.hh"
 
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <limits>
+#include <cmath>
 
 #include "TFile.h"
+#include "TFileMerger.h"
+#include "TROOT.h"
 
 /** used to create the full path + name of output files */
 std::string create_file_name(const std::string& algorithm, double resolution, bool inclusive,
-                      bool charged );
+                      bool charged, const std::string& suffix = "", const std::string& extension = ".root" );
+
+/** pulls the optional "--option value" pairs out of the command line,
+    and returns the remaining positional arguments in order
+ */
+std::vector<std::string> parse_options( int argc, const char** argv,
+                                        std::map<std::string, std::string>& options );
+
+/** prints the bytes read from the input files & the number of read calls,
+    in total and per accepted event ( the counters are process wide )
+ */
+void print_read_stats( const event& event, unsigned long n_events );
+
+/** the heap allocations the event loop made per processed event -
+    once the reused buffers have grown, this is what is left: mostly
+    fastjet's own, for the cluster sequences
+ */
+double allocations_per_event( const event& event );
+
+/** the body of each worker thread in parallel mode: pulls chunks of
+    chain entries from the shared queue and processes them with the
+    worker's own event/reader. Entries that fail to read are counted
+    in n_errors
+ */
+void process_worker( unsigned worker, work_queue& queue, event& worker_event,
+                     unsigned long& n_processed, unsigned long& n_errors,
+                     std::atomic<unsigned>& n_finished );
+
+/** writes the per stage statistics of the given events as JSON - to path
+    if it isn't empty, otherwise to stdout
+ */
+void report_stats( const std::string& path, const std::vector<const event*>& events,
+                   std::chrono::steady_clock::time_point start );
+
+/** splits a comma separated list of values */
+std::vector<std::string> parse_list( const std::string& list );
+
+/** parses a non-negative integer option value - false for anything
+    else ( a sign, trailing characters or out of range ), instead of
+    letting a negative value wrap around
+ */
+bool parse_count( const std::string& value, unsigned long& count );
+bool parse_count( const std::string& value, unsigned& count );
+
+/** parses a non-negative, finite decimal option value, e.g. a size in
+    MB - false for anything else
+ */
+bool parse_amount( const std::string& value, double& amount );
+
+/** sends the end of the stream, and reports what was streamed */
+void close_stream( jet_stream& stream, const std::string& path );
+
+/** prints the bytes written to the output files & the rate over the run,
+    the compression of the trees ( tree_bytes uncompressed, zip_bytes on
+    disk ), and what the events' writer threads did
+ */
+void print_write_stats( const std::vector<const event*>& events, Long64_t tree_bytes, Long64_t zip_bytes,
+                        std::chrono::steady_clock::time_point start );
 
 /** the grid does not have std::to_string() for some ungodly reason
     replacing it here. Simply ostringstream
@@ -30,6 +103,98 @@ int main ( int argc, const char** argv ) {
        4: charged or full ( if we're looking at charged jets or full jets )
        5: path to the settings file for the reader
        6: path to the data the reader will use ( .root, .list, .txt)
+       
+       Options ( can be placed anywhere on the command line )
+       --threads N : number of worker threads, each with its own reader.
+                     chain entries are handed out in chunks through a
+                     work-stealing queue. Each thread writes its trees to
+                     a temporary <output>.workerN file, merged into the
+                     output file at the end ( default 1 )
+       --chunk N   : number of chain entries per work chunk ( default 500 )
+       --manifest DIR, --shard I: process shard I of a production planned
+                     by plan_shards - the input files are read from
+                     DIR/shard_I.list ( replacing the data argument ), and
+                     the output files are suffixed with _shard_I
+       --checkpoint N: single threaded only - every N accepted events, flush
+                     the output trees to disk & record the chain entry
+                     reached in <first output>.checkpoint ( default 0: off )
+       --resume true: single threaded only - continue an interrupted run
+                     with the same arguments from its last checkpoint
+       --stats FILE: write the per stage timing & counters as JSON to FILE
+                     every stats-interval seconds while running, and at the
+                     end. The final report is always printed to stdout
+       --stats-interval S: seconds between reports to the stats file ( default 10 )
+       --prefetch N: single threaded only - decode up to N events ahead on a
+                     background thread, so reading overlaps with clustering.
+                     0 disables prefetching ( default 0 )
+       --area MODE : jet area estimation - none, voronoi ( passive ) or active.
+                     active ghosts are generated once and reused for every
+                     event ( default active )
+       --output SCHEMA: layout of the output trees - object ( TLorentzVector &
+                     TClonesArray branches ) or flat ( split per jet floats,
+                     variable length constituent arrays and an event level
+                     tree keyed by eventID ) ( default object ). flat keeps
+                     at most 512 constituents per jet ( flat_jet in
+                     event.hh ) - jets with more are counted & reported
+                     at the end of the run. npy writes the flat columns
+                     as .npy files in a directory per configuration
+                     instead of a ROOT file, npz packs them into one .npz
+                     per configuration ( single threaded, no checkpointing
+                     - see output_schema in event.hh )
+       --npy-width N: width of the npy/npz constituent arrays - the hardest
+                     N constituents of each jet are kept, the jets cut
+                     short are counted in the same report ( default 64 )
+       --features true/false: write the per jet features ( pt, eta, phi, area,
+                     nconst, ncharge, charge_frac, width, lead_frac, dispersion
+                     & reco_pt - see jet_features.hh ) as flat branches in
+                     every output schema ( default true )
+       --partition TRAIN,VALIDATION,TEST: split the jet pairs by event into
+                     train, validation & test partitions of these relative
+                     sizes, from a stable hash of the run & event id ( see
+                     event_partition.hh ). The train partition is written to
+                     the training tree, the others to validation & test
+                     trees ( or tables ) in the same output. Not with
+                     checkpointing ( default: off, everything is training )
+       --stream PATH: also publish every matched pair ( features & constituents )
+                     to PATH as it is produced, for a consumer that reads
+                     while the run goes on - see jet_stream.hh for the framing,
+                     and models/jet_stream.py for a reader
+       --stream-type TYPE: ring ( a shared memory ring buffer in the file PATH,
+                     e.g. in /dev/shm ) or pipe ( a named pipe ) ( default ring )
+       --stream-policy POLICY: when the consumer falls behind, block until it
+                     catches up, or drop the record ( default block )
+       --stream-size MB: ring capacity ( default 64 ), or the pipe buffer size
+                     ( default: the system's )
+       --codec PROFILE: compression of the output trees - lz4 ( fast, for
+                     intermediate files ), zstd, lzma ( smallest, for archival ),
+                     zlib or none, optionally with a level, e.g. zstd:9 - see
+                     output_writer.hh ( default: ROOT's )
+       --autoflush MB: flush the tree baskets to disk every MB of filled data
+                     ( default: ROOT's, 30 MB )
+       --basket-size KB: the basket size of every branch ( default: ROOT's )
+       --async-output N: fill & compress the output on a writer thread per
+                     event loop, with up to N jet pairs queued behind the
+                     clustering. 0 fills on the event loop ( default 0 )
+       --match MODE: geant to pythia jet matching - greedy ( highest pt first )
+                     or bidirectional ( mutual closest pairs ) ( default greedy )
+       --small-n N : with --area none, events with at most N particles are
+                     clustered by the built-in small_n_clusterer instead of
+                     fastjet ( same jets, less overhead ). 0 always uses
+                     fastjet ( default 0 )
+       --skim FILE : no jet finding - read the data once with the reader
+                     cuts, and write every accepted event's header & particles
+                     to the event cache FILE
+       --cache FILE: read the events from an event cache written by --skim
+                     instead of the data argument. The reader cuts were
+                     applied by the skim
+       
+       Sweep options - each replaces the corresponding positional argument
+       with a comma separated list. Every combination of algorithm x radius x
+       charge mode is run off of the same decoded event, and written to its
+       own output file, named as if it had been run on its own
+       --algorithms antikt,kt,CA
+       --radii      0.2,0.3,0.4,0.5
+       --charged    true,false
    */
   
   std::string algorithm = "antikt";
@@ -38,27 +203,56 @@ int main ( int argc, const char** argv ) {
   bool charged_jets     = false;
   std::string settings  = "${CMAKE_BINARY_DIR}/settings/reader.txt";
   std::string data      = "${CMAKE_SOURCE_DIR}/test_data/picoDst_25_35_0.root";
+  unsigned n_threads    = 1;
+  long long chunk_size  = 500;
+  unsigned prefetch     = 0;
+  std::string manifest  = "";
+  unsigned long checkpoint_every = 0;
+  bool resume           = false;
+  std::string stats_file = "";
+  double stats_interval = 10.0;
+  int shard             = -1;
+  std::string area      = "active";
+  std::string match     = "greedy";
+  unsigned small_n      = 0;
+  std::string schema    = "object";
+  std::string skim_file = "";
+  std::string cache_file = "";
+  unsigned npy_width    = 64;
+  bool features         = true;
+  event_partition partitions;
+  std::string stream_path = "";
+  std::string stream_kind = "ring";
+  std::string stream_mode = "block";
+  double stream_size    = 0;
+  std::string codec     = "default";
+  double autoflush      = 0;
+  double basket_size    = 0;
+  unsigned async_output = 0;
   
-  switch ( argc ) {
-    case 7 :
-      algorithm = argv[1];
-      resolution = std::stof( std::string(argv[2]) );
+  std::map<std::string, std::string> options;
+  std::vector<std::string> args = parse_options( argc, argv, options );
+  
+  switch ( args.size() ) {
+    case 6 :
+      algorithm = args[0];
+      resolution = std::stof( args[1] );
       
-      if      ( std::string( argv[3] ) == "true"   ) inclusive_jets = true;
-      else if ( std::string( argv[3] ) == "false"  ) inclusive_jets = false;
+      if      ( args[2] == "true"   ) inclusive_jets = true;
+      else if ( args[2] == "false"  ) inclusive_jets = false;
       else { std::cerr << "Error unrecognized argument for inclusive jets ( true or false ) " << std::endl;
              return -1; }
       
-      if      ( std::string( argv[4] ) == "true"   ) charged_jets = true;
-      else if ( std::string( argv[4] ) == "false"  ) charged_jets = false;
+      if      ( args[3] == "true"   ) charged_jets = true;
+      else if ( args[3] == "false"  ) charged_jets = false;
       else { std::cerr << "Error unrecognized argument for charged jets ( true or false ) " << std::endl;
         return -1; }
       
-      settings = argv[5];
-      data     = argv[6];
+      settings = args[4];
+      data     = args[5];
       
       break;
-    case 1 :
+    case 0 :
       /** use defaults */
       break;
     default :
@@ -67,107 +261,633 @@ int main ( int argc, const char** argv ) {
       return -1;
   }
   
-  std::cout<<"algorithm: "<< algorithm << " R: "<<resolution <<std::endl;
-  std::cout<<"inclusive jets: "<< inclusive_jets<<std::endl;
-  std::cout<<"charged jets: "<< charged_jets<<std::endl;
-  std::cout<<"settings: "<<settings<<std::endl;
-  std::cout<<"data: "<<data<<std::endl;
+  /** the positional arguments define a single configuration - the sweep
+      options replace one axis of it with a list
+   */
+  std::vector<std::string> algorithms { algorithm };
+  std::vector<double> radii { resolution };
+  std::vector<bool> charge_modes { charged_jets };
   
-  /** set some constants that won't need to be changed -
-      kinemantic cuts for fastjet: jet pt cut,
-      constituent pt cut, and eta acceptance, and settings
-      for the area definition
+  for ( std::map<std::string, std::string>::iterator it = options.begin(); it != options.end(); ++it ) {
+    bool valid = true;
+    std::string expected = "a non-negative integer";
+    if      ( it->first == "threads" ) valid = parse_count( it->second, n_threads );
+    else if ( it->first == "chunk"   ) {
+      unsigned long chunk = 0;
+      valid = parse_count( it->second, chunk );
+      chunk_size = chunk;
+    }
+    else if ( it->first == "prefetch" ) valid = parse_count( it->second, prefetch );
+    else if ( it->first == "manifest" ) manifest = it->second;
+    else if ( it->first == "checkpoint" ) valid = parse_count( it->second, checkpoint_every );
+    else if ( it->first == "stats"   ) stats_file = it->second;
+    else if ( it->first == "stats-interval" ) {
+      // the reports are scheduled by adding the interval, which must advance
+      stats_interval = std::stod( it->second );
+      if ( !( stats_interval > 0 ) ) { std::cerr << "Error: --stats-interval must be positive" << std::endl;
+                                       return -1; }
+    }
+    else if ( it->first == "resume"  ) {
+      if      ( it->second == "true"  ) resume = true;
+      else if ( it->second == "false" ) resume = false;
+      else { std::cerr << "Error unrecognized argument for resume ( true or false ) " << std::endl;
+             return -1; }
+    }
+    else if ( it->first == "shard"   ) shard = std::stoi( it->second );
+    else if ( it->first == "area"    ) area = it->second;
+    else if ( it->first == "match"   ) match = it->second;
+    else if ( it->first == "small-n" ) valid = parse_count( it->second, small_n );
+    else if ( it->first == "output"  ) schema = it->second;
+    else if ( it->first == "skim"    ) skim_file = it->second;
+    else if ( it->first == "cache"   ) cache_file = it->second;
+    else if ( it->first == "npy-width" ) valid = parse_count( it->second, npy_width );
+    else if ( it->first == "features" ) {
+      if      ( it->second == "true"  ) features = true;
+      else if ( it->second == "false" ) features = false;
+      else { std::cerr << "Error unrecognized argument for features ( true or false ) " << std::endl;
+             return -1; }
+    }
+    else if ( it->first == "partition" ) {
+      if ( !partitions.parse( it->second ) ) {
+        std::cerr << "Error unrecognized argument for partition ( train,validation,test fractions ) " << std::endl;
+        return -1;
+      }
+    }
+    else if ( it->first == "stream"  ) stream_path = it->second;
+    else if ( it->first == "stream-type" ) stream_kind = it->second;
+    else if ( it->first == "stream-policy" ) stream_mode = it->second;
+    else if ( it->first == "stream-size" ) {
+      // the size is in MB, up to a 2^40 byte ring
+      if ( !parse_amount( it->second, stream_size ) || !( stream_size > 0 ) || stream_size > double( 1 << 20 ) ) {
+        std::cerr << "Error: --stream-size takes a size in MB, above 0 and up to " << ( 1 << 20 ) << std::endl;
+        return -1;
+      }
+    }
+    else if ( it->first == "codec"   ) codec = it->second;
+    else if ( it->first == "autoflush" ) {
+      expected = "a non-negative number";
+      valid = parse_amount( it->second, autoflush );
+    }
+    else if ( it->first == "basket-size" ) {
+      // the size in bytes has to fit an Int_t
+      expected = "a non-negative number, below 2 GB";
+      valid = parse_amount( it->second, basket_size ) && basket_size < double( 1 << 21 );
+    }
+    else if ( it->first == "async-output" ) valid = parse_count( it->second, async_output );
+    else if ( it->first == "algorithms" ) algorithms = parse_list( it->second );
+    else if ( it->first == "radii" ) {
+      radii.clear();
+      std::vector<std::string> values = parse_list( it->second );
+      for ( unsigned i = 0; i < values.size(); ++i ) radii.push_back( std::stof( values[i] ) );
+    }
+    else if ( it->first == "charged" ) {
+      charge_modes.clear();
+      std::vector<std::string> values = parse_list( it->second );
+      for ( unsigned i = 0; i < values.size(); ++i ) {
+        if      ( values[i] == "true"  ) charge_modes.push_back( true );
+        else if ( values[i] == "false" ) charge_modes.push_back( false );
+        else { std::cerr << "Error unrecognized argument for charged jets ( true or false ) " << std::endl;
+               return -1; }
+      }
+    }
+    else { std::cerr << "Error: unrecognized option --" << it->first << std::endl;
+           return -1; }
+    if ( !valid ) { std::cerr << "Error: --" << it->first << " takes " << expected << ", not "
+                              << it->second << std::endl;
+                    return -1; }
+  }
+  if ( n_threads == 0 ) n_threads = std::thread::hardware_concurrency();
+  
+  const std::chrono::steady_clock::duration report_interval =
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( stats_interval ) );
+  
+  /** a shard of a planned production reads its file list from the
+      manifest directory, and tags its output files with the shard index
+      so that merge_shards can find them
+   */
+  std::string output_suffix = "";
+  if ( shard >= 0 ) {
+    if ( manifest == "" ) { std::cerr << "Error: --shard requires --manifest" << std::endl; return -1; }
+    data = manifest + "/shard_" + patch::to_string( shard ) + ".list";
+    output_suffix = "_shard_" + patch::to_string( shard );
+  }
+  
+  /** build the jet definitions, area definitions & selectors
+      for every requested configuration
    */
+  std::vector<jet_config> configs;
+  output_schema tree_schema;
+  stream_type stream_transport;
+  stream_policy stream_backpressure;
+  output_settings tree_settings;
+  try {
+    tree_schema = parse_output_schema( schema );
+    tree_settings.compression = parse_output_codec( codec );
+    stream_transport = parse_stream_type( stream_kind );
+    stream_backpressure = parse_stream_policy( stream_mode );
+    configs = make_jet_configs( algorithms, radii, charge_modes, inclusive_jets, parse_area_mode( area ),
+                                jet_matcher::parse_mode( match ) );
+  } catch ( std::exception& e ) {
+    std::cerr << "unrecognized jet algorithm, area mode, match mode, output schema, codec or stream option, exiting" << std::endl;
+    return -1;
+  }
+  tree_settings.autoflush = -Long64_t( autoflush * 1.0e6 );
+  tree_settings.basket_size = Int_t( basket_size * 1024 );
+  for ( unsigned i = 0; i < configs.size(); ++i )
+    configs[i].small_n_max = small_n;
   
-  /** eta acceptance ( STAR-like, |eta| < 1.0 ) */
-  const double eta_acceptance_max   = 1.0;
+  std::cout<<"configurations: "<< configs.size() <<std::endl;
+  for ( unsigned i = 0; i < configs.size(); ++i )
+    std::cout<<"  algorithm: "<< configs[i].algorithm << " R: "<<configs[i].resolution
+             <<" charged jets: "<<configs[i].charged<<std::endl;
+  std::cout<<"inclusive jets: "<< inclusive_jets<<std::endl;
+  std::cout<<"area: "<< area<<std::endl;
+  std::cout<<"matching: "<< match<<std::endl;
+  std::cout<<"small-n clustering up to: "<< small_n<<std::endl;
+  std::cout<<"output schema: "<< schema<<std::endl;
+  if ( !( tree_schema == schema_npy || tree_schema == schema_npz ) )
+    std::cout<<"codec: "<< codec <<", autoflush: "<< autoflush <<" MB, basket size: "<< basket_size <<" kB"<<std::endl;
+  std::cout<<"async output: "<< async_output<<std::endl;
+  std::cout<<"features: "<< features<<std::endl;
+  if ( partitions.enabled() )
+    std::cout<<"partitions ( train, validation, test ): "<< partitions.fraction( event_partition::train ) <<", "
+             << partitions.fraction( event_partition::validation ) <<", "<< partitions.fraction( event_partition::test )<<std::endl;
   
-  /** these are used to set up the active ghost area specification
-      used to calculate jet areas. See fastjet manual for explanations,
-      but its pretty self explanatory - ghosts should extend past the 
-      acceptance by at least R, to keep area calculations robust
+  /** the numpy schemas write a directory ( npy ) or an archive ( npz )
+      per configuration in place of the ROOT file
    */
-  const double ghost_rap_max        = eta_acceptance_max + resolution;
-  const int ghost_repeat            = 1;
-  const double ghost_area           = 0.01;
-  
-  /** kinematic limits for jet and their constituents.
-      constituents: |eta| < 1.0 ( STAR acceptance ), 
-                     0.2 < | pt | < 30 GeV ( normal cuts for our analyses )
-      jets:         |eta| < 1.0 - R ( normal, avoid boundary effects ) 
-                     1.0 < | pt | < 100 GeV ( arbitrary, shouldn't hit upper bound )
+  bool numpy_output = tree_schema == schema_npy || tree_schema == schema_npz;
+  std::string output_extension = tree_schema == schema_npy ? "" : tree_schema == schema_npz ? ".npz" : ".root";
+  if ( numpy_output && ( n_threads != 1 || checkpoint_every > 0 || resume ) ) {
+    std::cerr << "Error: npy & npz output are only supported single threaded, without checkpointing" << std::endl;
+    return -1;
+  }
+  /** the checkpoint only records the training & event tree entries */
+  if ( partitions.enabled() && ( checkpoint_every > 0 || resume ) ) {
+    std::cerr << "Error: partitioned output can't be checkpointed" << std::endl;
+    return -1;
+  }
+  std::cout<<"settings: "<<settings<<std::endl;
+  std::cout<<"data: "<<( cache_file != "" ? cache_file : data )<<std::endl;
+  std::cout<<"threads: "<<n_threads<<std::endl;
+  std::cout<<"prefetch: "<<prefetch<<std::endl;
+  
+  /** a skim reads the trees once, and writes the accepted events to the cache -
+      later runs with --cache skip the decoding & the reader cuts
    */
-  const double const_eta_max = eta_acceptance_max;
-  const double const_pt_min = 0.2;
-  const double const_pt_max = 30.0;
-  const double jet_eta_max = eta_acceptance_max - resolution;
-  const double jet_pt_min = 1.0;
-  const double jet_pt_max = 100.0;
-  
-  /** setup Fastjet - first, jet definition
-      the clustering algorithm that is used to decide
-      which pairs of pseudojets are combined at which step
-      the three choices are all sequential recombination
-      with different weightings by pT of the tracks - see
-      FastJet manual online
+  if ( skim_file != "" ) {
+    if ( cache_file != "" ) { std::cerr << "Error: --skim reads the data, not a cache" << std::endl; return -1; }
+    
+    geant_reader reader( settings, data );
+    if ( !reader.init() ) { std::cerr << "Error: failed to initialize the reader" << std::endl; return -1; }
+    
+    event_cache_writer writer;
+    if ( !writer.open( skim_file ) ) { std::cerr << "Error: can't open " << skim_file << std::endl; return -1; }
+    while ( reader.next() )
+      reader.write_cache_event( writer );
+    
+    unsigned long long n_events = writer.n_events();
+    if ( !writer.close() ) { std::cerr << "Error: failed to write " << skim_file << std::endl; return -1; }
+    std::cout << "wrote " << n_events << " events to " << skim_file << std::endl;
+    return 0;
+  }
+  
+  /** one stream is shared by every event, and closed once they are done */
+  jet_stream stream;
+  if ( stream_path != "" ) {
+    std::cout<<"stream: "<< stream_path <<" ( "<< stream_kind <<", "<< stream_mode <<" )"<<std::endl;
+    if ( !stream.open( stream_path, stream_transport, stream_backpressure, size_t( stream_size * ( 1 << 20 ) ) ) ) {
+      std::cerr << "Error: can't open the stream " << stream_path << std::endl;
+      return -1;
+    }
+  }
+  
+  if ( n_threads == 1 ) {
+    
+    /** the output files are opened up front, so the trees are written out
+        as they fill. With checkpointing, their headers are autosaved every
+        checkpoint_every events, with the entry reached recorded next to
+        the first output file
+     */
+    std::vector<std::string> output_names;
+    for ( unsigned i = 0; i < configs.size(); ++i )
+      output_names.push_back( create_file_name( configs[i].algorithm, configs[i].resolution,
+                                                configs[i].inclusive, configs[i].charged, output_suffix,
+                                                output_extension ) );
+    std::string checkpoint_file = output_names[0] + ".checkpoint";
+    
+    /** when resuming, the partial output is moved aside - its checkpointed
+        entries are copied into the new output before the loop starts
+     */
+    checkpoint state;
+    if ( resume ) {
+      if ( !state.read( checkpoint_file ) || state.outputs != output_names ) {
+        std::cerr << "Error: no checkpoint for this configuration in " << checkpoint_file << std::endl;
+        return -1;
+      }
+      if ( !state.from_resume_files ) {
+        for ( unsigned i = 0; i < output_names.size(); ++i )
+          if ( std::rename( output_names[i].c_str(), ( output_names[i] + ".resume" ).c_str() ) != 0 ) {
+            std::cerr << "Error: can't move " << output_names[i] << " aside to resume" << std::endl;
+            return -1;
+          }
+        state.from_resume_files = true;
+        state.write( checkpoint_file );
+      }
+      std::cout << "resuming from entry " << state.entry << std::endl;
+    }
+    
+    std::vector<std::unique_ptr<TFile> > outputs;
+    for ( unsigned i = 0; i < output_names.size() && !numpy_output; ++i ) {
+      outputs.push_back( std::unique_ptr<TFile>( new TFile( output_names[i].c_str(), "RECREATE" ) ) );
+      if ( outputs.back()->IsZombie() ) { std::cerr << "Error: can't open " << output_names[i] << std::endl; return -1; }
+      if ( tree_settings.compression >= 0 ) outputs.back()->SetCompressionSettings( tree_settings.compression );
+    }
+    
+    /** the event is scoped so that its trees are deleted before the
+        files holding them are closed
+     */
+    bool read_error = false;
+    {
+      /** setup reader - its using the options from the default reader settings file
+          to initialize the chain & event cuts
+       */
+      event event( data, settings );
+      if ( cache_file != "" ) event.set_cache( cache_file );
+      for ( unsigned i = 0; i < configs.size(); ++i ) {
+        event.add_config( configs[i] );
+        if ( numpy_output ) event.set_numpy_output( i, output_names[i] );
+        else                event.set_output_directory( i, outputs[i].get() );
+      }
+      event.set_output_schema( tree_schema );
+      event.set_numpy_width( npy_width );
+      event.set_features( features );
+      event.set_partitions( partitions );
+      event.set_output_settings( tree_settings );
+      event.set_async_output( async_output );
+      if ( stream.is_open() ) event.set_stream( &stream );
+      
+      /** the prefetch thread reads ROOT files while we fill trees, and
+          the writer thread fills them while we read
+       */
+      if ( prefetch > 0 || async_output > 0 )
+        ROOT::EnableThreadSafety();
+      if ( prefetch > 0 )
+        event.set_prefetch( prefetch );
+      event.init_tree();
+      if ( cache_file != "" && !event.cached() ) { std::cerr << "Error: can't read the event cache " << cache_file << std::endl; return -1; }
+      
+      if ( resume ) {
+        for ( unsigned i = 0; i < output_names.size(); ++i ) {
+          TFile partial( ( output_names[i] + ".resume" ).c_str(), "READ" );
+          event.restore_tree( i, (TTree*) partial.Get( "training" ), (TTree*) partial.Get( "event" ),
+                              state.train_entries[i], state.event_entries[i] );
+          partial.Close();
+        }
+        event.set_first_entry( state.entry );
+      }
+      
+      /** loop over events - process_event runs every configuration
+          and fills their trees with every matched jet pair
+       */
+      std::vector<const class event*> stats_events { &event };
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      std::chrono::steady_clock::time_point next_report = start;
+      
+      unsigned long n_events = 0;
+      while ( event.next() ) {
+        event.process_event();
+        ++n_events;
+        
+        if ( stats_file != "" && std::chrono::steady_clock::now() >= next_report ) {
+          report_stats( stats_file, stats_events, start );
+          next_report += report_interval;
+        }
+        
+        if ( checkpoint_every > 0 && n_events % checkpoint_every == 0 ) {
+          event.autosave_trees();
+          
+          state.entry = event.current_event() + 1;
+          state.from_resume_files = false;
+          state.outputs = output_names;
+          state.train_entries.clear();
+          state.event_entries.clear();
+          for ( unsigned i = 0; i < configs.size(); ++i ) {
+            state.train_entries.push_back( event.get_train_tree( i )->GetEntries() );
+            state.event_entries.push_back( event.get_event_tree( i ) ? event.get_event_tree( i )->GetEntries() : 0 );
+          }
+          if ( !state.write( checkpoint_file ) )
+            std::cerr << "Error: failed to write checkpoint " << checkpoint_file << std::endl;
+        }
+      }
+      
+      std::cout << "particle list allocations: " << event.particle_allocations() << ", allocations per event: "
+                << allocations_per_event( event ) << std::endl;
+      print_read_stats( event, n_events );
+      report_stats( "", stats_events, start );
+      if ( stats_file != "" ) report_stats( stats_file, stats_events, start );
+      if ( prefetch > 0 )
+        std::cout << "waited on the prefetch thread " << event.prefetch_waits() << " times" << std::endl;
+      read_error = event.read_error();
+      
+      /** write the final trees - one file per configuration */
+      for ( unsigned i = 0; i < configs.size(); ++i ) {
+        if ( !numpy_output ) outputs[i]->cd();
+        event.write_tree( i );
+      }
+      
+      Long64_t tree_bytes, zip_bytes;
+      event.output_bytes( tree_bytes, zip_bytes );
+      print_write_stats( stats_events, tree_bytes, zip_bytes, start );
+    }
+    close_stream( stream, stream_path );
+    outputs.clear();
+    
+    /** the loop stopped on a read error, not the end of the input - the
+        checkpoint & partial output are kept so the run can be resumed
+     */
+    if ( read_error ) {
+      std::cerr << "Error: reading the input failed, the output is incomplete - any checkpoint in "
+                << checkpoint_file << " is kept for --resume" << std::endl;
+      return -1;
+    }
+    
+    /** the run is complete, the checkpoint & any partial output are obsolete */
+    std::remove( checkpoint_file.c_str() );
+    for ( unsigned i = 0; i < output_names.size(); ++i )
+      std::remove( ( output_names[i] + ".resume" ).c_str() );
+    
+    return 0;
+  }
+  
+  /** parallel mode: every worker owns its own reader & event, so the
+      only shared state is the work queue. ROOT has to be told that
+      it is being used from several threads before anything is opened
    */
-  fastjet::JetDefinition jet_def;
-  if ( algorithm == "antikt" )
-    jet_def = fastjet::JetDefinition( fastjet::antikt_algorithm, resolution );
-  else if ( algorithm == "kt" )
-    jet_def = fastjet::JetDefinition( fastjet::kt_algorithm, resolution );
-  else if ( algorithm == "CA" )
-    jet_def = fastjet::JetDefinition( fastjet::cambridge_algorithm, resolution );
-  else { std::cerr << "unrecognized jet algorithm, exiting" << std::endl; return -1; }
-  
-  /** create a default area definition
-   used to estimate the area of the jet cone
-   using a large number of soft "ghosts"
-   the fraction of ghosts in the clustered jet / total area = jet area
+  ROOT::EnableThreadSafety();
+  
+  if ( prefetch > 0 )
+    std::cout << "prefetch is only used by the single threaded loop - ignoring" << std::endl;
+  if ( checkpoint_every > 0 || resume ) {
+    std::cerr << "Error: checkpointing & resuming are only supported single threaded" << std::endl;
+    return -1;
+  }
+  
+  std::vector<std::string> output_names;
+  for ( unsigned i = 0; i < configs.size(); ++i )
+    output_names.push_back( create_file_name( configs[i].algorithm, configs[i].resolution,
+                                              configs[i].inclusive, configs[i].charged, output_suffix ) );
+  
+  /** each worker writes its trees to its own temporary file per output,
+      <output>.worker<N>, so that the baskets go to disk as they fill -
+      the files are merged into the outputs once the workers are done.
+      The files are declared before the workers, so that the workers'
+      trees are deleted before the files holding them are closed
    */
-  fastjet::GhostedAreaSpec ghost_area_spec( ghost_rap_max, ghost_repeat, ghost_area );
-  fastjet::AreaDefinition area_def(  fastjet::active_area_explicit_ghosts, ghost_area_spec );
+  std::vector<std::vector<std::string> > worker_names( n_threads );
+  std::vector<std::unique_ptr<TFile> > worker_files;
+  std::vector<std::unique_ptr<event> > workers;
+  for ( unsigned i = 0; i < n_threads; ++i ) {
+    workers.push_back( std::unique_ptr<event>( new event( data, settings ) ) );
+    if ( cache_file != "" ) workers.back()->set_cache( cache_file );
+    for ( unsigned j = 0; j < configs.size(); ++j ) {
+      worker_names[i].push_back( output_names[j] + ".worker" + patch::to_string( i ) );
+      worker_files.push_back( std::unique_ptr<TFile>( new TFile( worker_names[i][j].c_str(), "RECREATE" ) ) );
+      if ( worker_files.back()->IsZombie() ) { std::cerr << "Error: can't open " << worker_names[i][j] << std::endl; return -1; }
+      if ( tree_settings.compression >= 0 ) worker_files.back()->SetCompressionSettings( tree_settings.compression );
+      workers.back()->add_config( configs[j] );
+      workers.back()->set_output_directory( j, worker_files.back().get() );
+    }
+    workers.back()->set_output_schema( tree_schema );
+    workers.back()->set_features( features );
+    workers.back()->set_partitions( partitions );
+    workers.back()->set_output_settings( tree_settings );
+    workers.back()->set_async_output( async_output );
+    if ( stream.is_open() ) workers.back()->set_stream( &stream );
+    workers.back()->init_tree();
+    if ( cache_file != "" && !workers.back()->cached() ) { std::cerr << "Error: can't read the event cache " << cache_file << std::endl; return -1; }
+  }
+  
+  work_queue queue( n_threads, 0, workers[0]->total_events(), chunk_size );
+  std::vector<unsigned long> n_processed( n_threads, 0 );
+  std::vector<unsigned long> n_errors( n_threads, 0 );
+  
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  
+  std::atomic<unsigned> n_finished( 0 );
+  std::vector<std::thread> threads;
+  for ( unsigned i = 0; i < n_threads; ++i )
+    threads.push_back( std::thread( process_worker, i, std::ref( queue ), std::ref( *workers[i] ),
+                                    std::ref( n_processed[i] ), std::ref( n_errors[i] ), std::ref( n_finished ) ) );
   
-  /** track / jet selectors
-   applied before clustering to tracks to select "good" tracks
-   jet selector is applied to the clustered inclusive jets to
-   select jets in our acceptance within a reasonable pt range
+  /** the main thread only reports progress while the workers run -
+      the statistics are atomics, so they can be read at any time
    */
-  fastjet::Selector jet_selector    = fastjet::SelectorPtMin( jet_pt_min )   * fastjet::SelectorPtMax( jet_pt_max )   * fastjet::SelectorAbsRapMax( jet_eta_max );
-  fastjet::Selector track_selector  = fastjet::SelectorPtMin( const_pt_min ) * fastjet::SelectorPtMax( const_pt_max ) * fastjet::SelectorAbsRapMax( const_eta_max );
+  std::vector<const event*> stats_events;
+  for ( unsigned i = 0; i < n_threads; ++i )
+    stats_events.push_back( workers[i].get() );
   
-  /** setup reader - its using the options from the default reader settings file
-      to initialize the chain & event cuts
+  std::chrono::steady_clock::time_point next_report = start;
+  while ( n_finished.load() < n_threads ) {
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+    if ( stats_file != "" && std::chrono::steady_clock::now() >= next_report ) {
+      report_stats( stats_file, stats_events, start );
+      next_report += report_interval;
+    }
+  }
+  for ( unsigned i = 0; i < threads.size(); ++i )
+    threads[i].join();
+  for ( unsigned i = 0; i < n_threads; ++i )
+    workers[i]->flush_output();
+  
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  unsigned long total_processed = 0, total_errors = 0;
+  for ( unsigned i = 0; i < n_threads; ++i ) {
+    std::cout << "worker " << i << ": " << n_processed[i] << " accepted events, "
+              << workers[i]->particle_allocations() << " particle list allocations, "
+              << allocations_per_event( *workers[i] ) << " allocations per event" << std::endl;
+    total_processed += n_processed[i];
+    total_errors += n_errors[i];
+  }
+  std::cout << "processed " << queue.n_chunks() << " chunks ( " << queue.n_stolen() << " stolen ) in "
+            << seconds << " s: " << total_processed / seconds << " accepted events/s" << std::endl;
+  print_read_stats( *workers[0], total_processed );
+  close_stream( stream, stream_path );
+  report_stats( "", stats_events, start );
+  if ( stats_file != "" ) report_stats( stats_file, stats_events, start );
+  
+  /** write the workers' trees to their files, then delete the workers
+      & close the files before they are merged
    */
-  event event( data, settings );
-  event.init_tree();
+  Long64_t tree_bytes = 0, zip_bytes = 0;
+  for ( unsigned i = 0; i < n_threads; ++i ) {
+    for ( unsigned j = 0; j < configs.size(); ++j ) {
+      worker_files[i * configs.size() + j]->cd();
+      workers[i]->write_tree( j );
+    }
+    Long64_t worker_tree_bytes, worker_zip_bytes;
+    workers[i]->output_bytes( worker_tree_bytes, worker_zip_bytes );
+    tree_bytes += worker_tree_bytes;
+    zip_bytes += worker_zip_bytes;
+  }
+  print_write_stats( stats_events, tree_bytes, zip_bytes, start );
+  stats_events.clear();
+  workers.clear();
+  worker_files.clear();
   
-  /** loop over events */
-  while ( event.next() ) {
-    event.process_event( jet_def, area_def, track_selector, jet_selector, charged_jets  );
-    event.fill_trees();
+  /** merge the per-thread files into a single file per output - the
+      baskets are copied, so the merged branches keep the workers'
+      compression settings. A read error fails the run, without an output
+   */
+  int status = 0;
+  if ( total_errors > 0 ) {
+    std::cerr << "Error: " << total_errors << " entries failed to read, not writing the output" << std::endl;
+    status = -1;
+  }
+  for ( unsigned i = 0; i < configs.size() && status == 0; ++i ) {
+    TFileMerger merger( false );
+    if ( tree_settings.compression >= 0 )
+      merger.OutputFile( output_names[i].c_str(), "RECREATE", tree_settings.compression );
+    else
+      merger.OutputFile( output_names[i].c_str(), "RECREATE" );
+    for ( unsigned j = 0; j < n_threads; ++j )
+      merger.AddFile( worker_names[j][i].c_str(), false );
+    
+    if ( !merger.Merge() ) { std::cerr << "Error: failed to merge the worker files into " << output_names[i] << std::endl; status = -1; }
   }
   
-  /** now build the paths for output */
-  std::string output_name = create_file_name( algorithm, resolution, inclusive_jets,
-                                             charged_jets  );
-  TFile out( output_name.c_str(), "RECREATE" );
+  for ( unsigned i = 0; i < n_threads; ++i )
+    for ( unsigned j = 0; j < configs.size(); ++j )
+      std::remove( worker_names[i][j].c_str() );
   
-  event.write_tree();
+  return status;
+}
+
+void process_worker( unsigned worker, work_queue& queue, event& worker_event,
+                     unsigned long& n_processed, unsigned long& n_errors,
+                     std::atomic<unsigned>& n_finished ) {
+  
+  long long begin, end;
+  while ( queue.next_chunk( worker, begin, end ) ) {
+    for ( long long i = begin; i < end; ++i ) {
+      /** read_entry returns 1 only if both geant & pythia pass the cuts,
+          and -1 if either failed to read
+       */
+      int status = worker_event.read_entry( i );
+      if ( status == -1 ) ++n_errors;
+      if ( status != 1 ) continue;
+      worker_event.process_event();
+      ++n_processed;
+    }
+  }
+  ++n_finished;
+}
+
+void close_stream( jet_stream& stream, const std::string& path ) {
+  if ( !stream.is_open() ) return;
+  stream.close();
+  std::cout << "streamed " << stream.published() << " jet pairs ( " << stream.bytes() << " bytes ) to " << path
+            << ", dropped " << stream.dropped() << std::endl;
+}
+
+void print_write_stats( const std::vector<const event*>& events, Long64_t tree_bytes, Long64_t zip_bytes,
+                        std::chrono::steady_clock::time_point start ) {
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  double megabytes = TFile::GetFileBytesWritten() / 1.0e6;
+  if ( megabytes > 0 )
+    std::cout << "wrote " << megabytes << " MB in " << seconds << " s: " << megabytes / seconds << " MB/s" << std::endl;
+  if ( zip_bytes > 0 )
+    std::cout << "trees: " << tree_bytes / 1.0e6 << " MB uncompressed, " << zip_bytes / 1.0e6 << " MB on disk ( "
+              << double( tree_bytes ) / zip_bytes << "x )" << std::endl;
   
-  out.Close();
+  unsigned long truncated = 0;
+  for ( unsigned i = 0; i < events.size(); ++i )
+    truncated += events[i]->truncated_jets();
+  if ( truncated > 0 )
+    std::cout << "warning: " << truncated << " jets had more constituents than the flat or numpy arrays hold, "
+              << "only the first were written" << std::endl;
   
+  for ( unsigned i = 0; i < events.size(); ++i ) {
+    const output_writer* writer = events[i]->get_writer();
+    if ( writer == nullptr ) continue;
+    std::cout << "output writer " << i << ": " << writer->n_records() << " records in "
+              << writer->write_ns() / 1.0e9 << " s, the event loop waited on it " << writer->n_waits() << " times" << std::endl;
+  }
+}
+
+void report_stats( const std::string& path, const std::vector<const event*>& events,
+                   std::chrono::steady_clock::time_point start ) {
+  std::vector<const run_stats*> stats;
+  for ( unsigned i = 0; i < events.size(); ++i )
+    stats.push_back( &events[i]->stats() );
   
-  return 0;
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  if ( path == "" )
+    run_stats::write_json( std::cout, stats, seconds, events[0]->bytes_read(), TFile::GetFileBytesWritten() );
+  else if ( !run_stats::write_json_file( path, stats, seconds, events[0]->bytes_read(), TFile::GetFileBytesWritten() ) )
+    std::cerr << "Error: can't write the run statistics to " << path << std::endl;
+}
+
+std::vector<std::string> parse_options( int argc, const char** argv,
+                                        std::map<std::string, std::string>& options ) {
+  std::vector<std::string> args;
+  for ( int i = 1; i < argc; ++i ) {
+    std::string arg = argv[i];
+    if ( arg.size() > 2 && arg.substr( 0, 2 ) == "--" ) {
+      std::string value = ( i + 1 < argc ) ? argv[++i] : "";
+      options[arg.substr( 2 )] = value;
+    }
+    else args.push_back( arg );
+  }
+  return args;
+}
+
+std::vector<std::string> parse_list( const std::string& list ) {
+  std::vector<std::string> values;
+  std::string::size_type base = 0;
+  while ( base <= list.size() ) {
+    std::string::size_type comma = list.find( ',', base );
+    if ( comma == std::string::npos ) comma = list.size();
+    if ( comma > base ) values.push_back( list.substr( base, comma - base ) );
+    base = comma + 1;
+  }
+  return values;
+}
+
+bool parse_count( const std::string& value, unsigned long& count ) {
+  // strtoul would accept a sign & leading space, and wrap a negative value
+  if ( value.empty() || value.find_first_not_of( "0123456789" ) != std::string::npos )
+    return false;
+  errno = 0;
+  count = std::strtoul( value.c_str(), nullptr, 10 );
+  return errno == 0;
+}
+
+bool parse_count( const std::string& value, unsigned& count ) {
+  unsigned long full;
+  if ( !parse_count( value, full ) || full > std::numeric_limits<unsigned>::max() )
+    return false;
+  count = full;
+  return true;
+}
+
+bool parse_amount( const std::string& value, double& amount ) {
+  // strtod would accept a sign, leading space, inf & nan
+  if ( value.empty() || value.find_first_not_of( "0123456789." ) == 0 )
+    return false;
+  char* end = nullptr;
+  errno = 0;
+  amount = std::strtod( value.c_str(), &end );
+  return errno == 0 && *end == '\0' && std::isfinite( amount );
 }
 
 /** used to create the full path + name of output files */
 std::string create_file_name( const std::string& algorithm, double resolution, bool inclusive,
-                       bool charged ) {
+                       bool charged, const std::string& suffix, const std::string& extension ) {
   
   std::string base_dir = "${CMAKE_BINARY_DIR}/training/";
   
-  return base_dir + algorithm + "_R_" + patch::to_string(resolution) + "_inc_" + patch::to_string(inclusive) + "_charged_" + patch::to_string(charged) + ".root";
+  return base_dir + algorithm + "_R_" + patch::to_string(resolution) + "_inc_" + patch::to_string(inclusive) + "_charged_" + patch::to_string(charged) + suffix + extension;
   
   
 }
@@ -183,3 +903,17 @@ namespace patch {
     return stm.str() ;
   }
 }
+
+double allocations_per_event( const event& event ) {
+  const run_stats& stats = event.stats();
+  return stats.events() > 0 ? double( stats.allocations() ) / stats.events() : 0.0;
+}
+
+void print_read_stats( const event& event, unsigned long n_events ) {
+  double megabytes = event.bytes_read() / 1.0e6;
+  std::cout << "read " << megabytes << " MB in " << event.read_calls() << " read calls";
+  if ( n_events > 0 )
+    std::cout << ": " << 1.0e3 * megabytes / n_events << " kB & "
+              << double( event.read_calls() ) / n_events << " read calls per accepted event";
+  std::cout << std::endl;
+}
@@ -0,0 +1,80 @@
+// implementation for run_stats
+
+#include "run_stats.hh"
+
+#include <cstdio>
+#include <fstream>
+
+const char* run_stats::stage_name( stage s ) {
+  switch ( s ) {
+    case read :    return "read";
+    case convert : return "convert";
+    case cluster : return "cluster";
+    case select :  return "select";
+    case match :   return "match";
+    case fill :    return "fill";
+    default :      return "unknown";
+  }
+}
+
+run_stats::run_stats() : events_(0), particles_(0), jets_(0), allocations_(0) {
+  for ( int i = 0; i < n_stages; ++i ) {
+    time_[i].store( 0 );
+    calls_[i].store( 0 );
+  }
+}
+
+void run_stats::write_json( std::ostream& out, const std::vector<const run_stats*>& stats,
+                            double wall_seconds, long long bytes_read, long long bytes_written ) {
+  
+  unsigned long long events = 0, particles = 0, jets = 0, allocations = 0;
+  unsigned long long time[n_stages] = { 0 };
+  unsigned long long calls[n_stages] = { 0 };
+  for ( unsigned i = 0; i < stats.size(); ++i ) {
+    events += stats[i]->events();
+    particles += stats[i]->particles();
+    jets += stats[i]->jets();
+    allocations += stats[i]->allocations();
+    for ( int j = 0; j < n_stages; ++j ) {
+      time[j] += stats[i]->time( stage( j ) );
+      calls[j] += stats[i]->calls( stage( j ) );
+    }
+  }
+  
+  // per event values are 0 until the first event is done
+  double per_event = events > 0 ? 1.0 / events : 0.0;
+  
+  out << "{\n";
+  out << "  \"wall_seconds\": " << wall_seconds << ",\n";
+  out << "  \"workers\": " << stats.size() << ",\n";
+  out << "  \"events\": " << events << ",\n";
+  out << "  \"events_per_second\": " << ( wall_seconds > 0 ? events / wall_seconds : 0.0 ) << ",\n";
+  out << "  \"particles_per_event\": " << particles * per_event << ",\n";
+  out << "  \"jets_per_event\": " << jets * per_event << ",\n";
+  out << "  \"allocations_per_event\": " << allocations * per_event << ",\n";
+  out << "  \"bytes_read\": " << bytes_read << ",\n";
+  out << "  \"bytes_written\": " << bytes_written << ",\n";
+  out << "  \"bytes_read_per_event\": " << bytes_read * per_event << ",\n";
+  out << "  \"bytes_written_per_event\": " << bytes_written * per_event << ",\n";
+  out << "  \"bytes_written_per_second\": " << ( wall_seconds > 0 ? bytes_written / wall_seconds : 0.0 ) << ",\n";
+  out << "  \"stages\": {\n";
+  for ( int j = 0; j < n_stages; ++j ) {
+    out << "    \"" << stage_name( stage( j ) ) << "\": { \"calls\": " << calls[j]
+        << ", \"total_ns\": " << time[j] << ", \"ns_per_event\": " << time[j] * per_event << " }"
+        << ( j + 1 < n_stages ? ",\n" : "\n" );
+  }
+  out << "  }\n";
+  out << "}\n";
+}
+
+bool run_stats::write_json_file( const std::string& path, const std::vector<const run_stats*>& stats,
+                                 double wall_seconds, long long bytes_read, long long bytes_written ) {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out( tmp );
+    if ( !out.is_open() ) return false;
+    write_json( out, stats, wall_seconds, bytes_read, bytes_written );
+    if ( !out ) return false;
+  }
+  return std::rename( tmp.c_str(), path.c_str() ) == 0;
+}
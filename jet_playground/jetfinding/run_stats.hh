@@ -0,0 +1,107 @@
+/*  Low overhead instrumentation of the event loop: the time spent
+    in each pipeline stage, and per event counters. Stages are timed
+    with scoped_timer ( two steady_clock reads per stage per event ),
+    and the counters are relaxed atomics, so a monitoring thread can
+    take a snapshot while a worker is filling them without locking.
+    The report is written as JSON.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef JETFINDING_RUN_STATS_HH
+#define JETFINDING_RUN_STATS_HH
+
+class run_stats {
+
+public:
+  
+  /** the pipeline stages, in order:
+      read:    reading & decoding the next entry ( or waiting on the prefetch thread )
+      convert: building the particle lists
+      cluster: clustering, for every configuration
+      select:  applying the jet selector & sorting the jets
+      match:   geant to pythia jet matching
+      fill:    filling the output trees, or queuing the records for the
+               writer thread ( see output_writer )
+   */
+  enum stage { read, convert, cluster, select, match, fill, n_stages };
+  
+  static const char* stage_name( stage s );
+  
+  run_stats();
+  
+  /** default destructor */
+  ~run_stats() {};
+  
+  void add_time( stage s, unsigned long long ns ) {
+    time_[s].fetch_add( ns, std::memory_order_relaxed );
+    calls_[s].fetch_add( 1, std::memory_order_relaxed );
+  }
+  
+  /** counts one processed event, with its particle & matched jet counts,
+      and the heap allocations the event thread made for it ( see
+      alloc_counter )
+   */
+  void add_event( unsigned long long particles, unsigned long long jets, unsigned long long allocations ) {
+    events_.fetch_add( 1, std::memory_order_relaxed );
+    particles_.fetch_add( particles, std::memory_order_relaxed );
+    jets_.fetch_add( jets, std::memory_order_relaxed );
+    allocations_.fetch_add( allocations, std::memory_order_relaxed );
+  }
+  
+  unsigned long long events() const             { return events_.load( std::memory_order_relaxed ); }
+  unsigned long long particles() const          { return particles_.load( std::memory_order_relaxed ); }
+  unsigned long long jets() const               { return jets_.load( std::memory_order_relaxed ); }
+  unsigned long long allocations() const        { return allocations_.load( std::memory_order_relaxed ); }
+  unsigned long long time( stage s ) const      { return time_[s].load( std::memory_order_relaxed ); }
+  unsigned long long calls( stage s ) const     { return calls_[s].load( std::memory_order_relaxed ); }
+  
+  /** writes the summed statistics of one or more workers as a JSON object.
+      bytes_read & bytes_written are the file totals for the run
+   */
+  static void write_json( std::ostream& out, const std::vector<const run_stats*>& stats,
+                          double wall_seconds, long long bytes_read, long long bytes_written );
+  
+  /** write_json to a temporary file, renamed over path, so a monitor
+      reading path never sees a partial report
+   */
+  static bool write_json_file( const std::string& path, const std::vector<const run_stats*>& stats,
+                               double wall_seconds, long long bytes_read, long long bytes_written );
+  
+private:
+  
+  std::atomic<unsigned long long> time_[n_stages];
+  std::atomic<unsigned long long> calls_[n_stages];
+  std::atomic<unsigned long long> events_;
+  std::atomic<unsigned long long> particles_;
+  std::atomic<unsigned long long> jets_;
+  std::atomic<unsigned long long> allocations_;
+  
+};
+
+/** adds the time between its construction & destruction to a stage */
+class scoped_timer {
+  
+public:
+  
+  scoped_timer( run_stats& stats, run_stats::stage s ) : stats_( stats ), stage_( s ),
+                start_( std::chrono::steady_clock::now() ) {};
+  
+  ~scoped_timer() {
+    stats_.add_time( stage_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start_ ).count() );
+  }
+  
+private:
+  
+  run_stats& stats_;
+  run_stats::stage stage_;
+  std::chrono::steady_clock::time_point start_;
+  
+};
+
+#endif // JETFINDING_RUN_STATS_HH
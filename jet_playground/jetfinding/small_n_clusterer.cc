@@ -0,0 +1,172 @@
+// implementation for small_n_clusterer
+
+#include "small_n_clusterer.hh"
+
+#include "base.hh"
+
+#include <cmath>
+#include <algorithm>
+
+small_n_clusterer::small_n_clusterer() : px_(), py_(), pz_(), e_(), rap_(), phi_(), scale_(), nn_(),
+              nn_dist_(), dij_(), head_(), tail_(), next_(), dist_(), update_(), pieces_(), n_(0), r2_(0.0),
+              algorithm_( fastjet::antikt_algorithm ) { }
+
+bool small_n_clusterer::supports( const fastjet::JetDefinition& jet_def ) {
+  fastjet::JetAlgorithm algorithm = jet_def.jet_algorithm();
+  return ( algorithm == fastjet::kt_algorithm || algorithm == fastjet::antikt_algorithm ||
+           algorithm == fastjet::cambridge_algorithm ) &&
+         jet_def.recombination_scheme() == fastjet::E_scheme;
+}
+
+void small_n_clusterer::cluster( const fastjet::JetDefinition& jet_def,
+                                 const std::vector<fastjet::PseudoJet>& particles,
+                                 std::vector<fastjet::PseudoJet>& jets ) {
+  jets.clear();
+
+  algorithm_ = jet_def.jet_algorithm();
+  r2_ = jet_def.R() * jet_def.R();
+  n_ = particles.size();
+
+  px_.resize( n_ ); py_.resize( n_ ); pz_.resize( n_ ); e_.resize( n_ );
+  rap_.resize( n_ ); phi_.resize( n_ ); scale_.resize( n_ );
+  nn_.resize( n_ ); nn_dist_.resize( n_ ); dij_.resize( n_ );
+  head_.resize( n_ ); tail_.resize( n_ ); next_.resize( n_ );
+  dist_.resize( n_ ); update_.resize( n_ );
+
+  for ( int i = 0; i < n_; ++i ) {
+    px_[i] = particles[i].px();
+    py_[i] = particles[i].py();
+    pz_[i] = particles[i].pz();
+    e_[i]  = particles[i].E();
+    set_kinematics( i );
+    head_[i] = tail_[i] = i;
+    next_[i] = -1;
+  }
+  for ( int i = 0; i < n_; ++i )
+    set_nn( i );
+
+  while ( n_ > 0 ) {
+
+    // the smallest d_iJ - either a pair, or a jet & the beam
+    int i = 0;
+    for ( int k = 1; k < n_; ++k )
+      if ( dij_[k] < dij_[i] ) i = k;
+    int j = nn_[i];
+
+    if ( j < 0 ) {
+      // no neighbour within R: i becomes an inclusive jet
+      jets.push_back( make_jet( i, particles ) );
+      for ( int k = 0; k < n_; ++k )
+        update_[k] = nn_[k] == i;
+      remove_slot( i );
+      for ( int k = 0; k < n_; ++k )
+        if ( update_[k] ) set_nn( k );
+      continue;
+    }
+
+    // merge the pair into the lower slot, and remove the upper one
+    int a = std::min( i, j );
+    int b = std::max( i, j );
+    px_[a] += px_[b];
+    py_[a] += py_[b];
+    pz_[a] += pz_[b];
+    e_[a]  += e_[b];
+    set_kinematics( a );
+    next_[tail_[a]] = head_[b];
+    tail_[a] = tail_[b];
+
+    for ( int k = 0; k < n_; ++k )
+      update_[k] = nn_[k] == a || nn_[k] == b;
+    remove_slot( b );
+
+    // jets that pointed at either half look again, the rest
+    // only have to check whether the new jet is closer
+    set_nn( a );
+    for ( int k = 0; k < n_; ++k ) {
+      if ( k == a ) continue;
+      if ( update_[k] ) { set_nn( k ); continue; }
+      double drap = rap_[k] - rap_[a];
+      double dphi = pi - std::fabs( pi - std::fabs( phi_[k] - phi_[a] ) );
+      double dist = drap * drap + dphi * dphi;
+      if ( dist < nn_dist_[k] ) {
+        nn_[k] = a;
+        nn_dist_[k] = dist;
+        set_dij( k );
+      }
+    }
+  }
+}
+
+void small_n_clusterer::set_kinematics( int idx ) {
+  // the same rapidity, phi & kt2 as fastjet computes for the pseudojet
+  fastjet::PseudoJet jet( px_[idx], py_[idx], pz_[idx], e_[idx] );
+  rap_[idx] = jet.rap();
+  phi_[idx] = jet.phi();
+  double kt2 = jet.kt2();
+  switch ( algorithm_ ) {
+    case fastjet::kt_algorithm :
+      scale_[idx] = kt2;
+      break;
+    case fastjet::cambridge_algorithm :
+      scale_[idx] = 1.0;
+      break;
+    default :
+      scale_[idx] = kt2 > 1e-300 ? 1.0 / kt2 : 1e300;
+  }
+}
+
+void small_n_clusterer::set_nn( int idx ) {
+  const double rap = rap_[idx];
+  const double phi = phi_[idx];
+  const double* raps = rap_.data();
+  const double* phis = phi_.data();
+  double* dist = dist_.data();
+
+  // the distances are computed in one branch-free pass over the flat
+  // arrays, so that the compiler can vectorize it, and the minimum is
+  // found in a second pass
+  for ( int k = 0; k < n_; ++k ) {
+    double drap = rap - raps[k];
+    double dphi = pi - std::fabs( pi - std::fabs( phi - phis[k] ) );
+    dist[k] = drap * drap + dphi * dphi;
+  }
+
+  int nn = -1;
+  double nn_dist = r2_;
+  for ( int k = 0; k < n_; ++k ) {
+    if ( k != idx && dist[k] < nn_dist ) {
+      nn = k;
+      nn_dist = dist[k];
+    }
+  }
+
+  nn_[idx] = nn;
+  nn_dist_[idx] = nn_dist;
+  set_dij( idx );
+}
+
+void small_n_clusterer::set_dij( int idx ) {
+  int nn = nn_[idx];
+  dij_[idx] = nn_dist_[idx] * ( nn >= 0 ? std::min( scale_[idx], scale_[nn] ) : scale_[idx] );
+}
+
+void small_n_clusterer::remove_slot( int idx ) {
+  int last = n_ - 1;
+  if ( idx != last ) {
+    px_[idx] = px_[last]; py_[idx] = py_[last]; pz_[idx] = pz_[last]; e_[idx] = e_[last];
+    rap_[idx] = rap_[last]; phi_[idx] = phi_[last]; scale_[idx] = scale_[last];
+    nn_[idx] = nn_[last]; nn_dist_[idx] = nn_dist_[last]; dij_[idx] = dij_[last];
+    head_[idx] = head_[last]; tail_[idx] = tail_[last];
+    update_[idx] = update_[last];
+    for ( int k = 0; k < last; ++k )
+      if ( nn_[k] == last ) nn_[k] = idx;
+  }
+  --n_;
+}
+
+fastjet::PseudoJet small_n_clusterer::make_jet( int idx, const std::vector<fastjet::PseudoJet>& particles ) {
+  pieces_.clear();
+  for ( int p = head_[idx]; p >= 0; p = next_[p] )
+    pieces_.push_back( particles[p] );
+  return fastjet::join( pieces_ );
+}
@@ -0,0 +1,89 @@
+/*  A sequential recombination clustering for the small events we see in
+    pp - tens of particles per event, where the strategy selection and the
+    history bookkeeping in fastjet::ClusterSequence cost more than the
+    clustering itself. Implements the same N^2 nearest neighbour algorithm
+    as fastjet's N2Plain strategy, for the kt, anti-kt and Cambridge/Aachen
+    algorithms with E-scheme recombination, over flat per-particle arrays.
+    The jets are returned as fastjet::join()s of the input particles, so
+    constituents() works without a cluster sequence. There are no areas -
+    those configurations always use fastjet
+ */
+
+#include "fastjet/PseudoJet.hh"
+#include "fastjet/JetDefinition.hh"
+
+#include <vector>
+
+#ifndef JETFINDING_SMALL_N_CLUSTERER_HH
+#define JETFINDING_SMALL_N_CLUSTERER_HH
+
+class small_n_clusterer {
+
+public:
+
+  small_n_clusterer();
+
+  /** default destructor */
+  ~small_n_clusterer() {};
+
+  /** true if the jet definition can be clustered here: the kt, anti-kt
+      & Cambridge/Aachen algorithms with E-scheme recombination
+   */
+  static bool supports( const fastjet::JetDefinition& jet_def );
+
+  /** clusters particles with jet_def, and fills jets ( which is cleared
+      first ) with the inclusive jets - the same jets as
+      ClusterSequence( particles, jet_def ).inclusive_jets(), in no
+      particular order. jet_def must be supported. The buffers are kept
+      between calls, so that clustering doesn't allocate once they have
+      grown to the largest event
+   */
+  void cluster( const fastjet::JetDefinition& jet_def, const std::vector<fastjet::PseudoJet>& particles,
+                std::vector<fastjet::PseudoJet>& jets );
+
+private:
+
+  /** the active pseudojets, one entry per slot: momentum, rapidity,
+      phi, the momentum factor of the distance measure ( kt^2p ), and
+      the geometric nearest neighbour with its distance & the resulting
+      d_iJ. Slots are kept dense - a removed slot is refilled from the end
+   */
+  std::vector<double> px_, py_, pz_, e_;
+  std::vector<double> rap_, phi_, scale_;
+  std::vector<int> nn_;
+  std::vector<double> nn_dist_, dij_;
+
+  /** the input particles in each slot, as a linked list:
+      head_/tail_ per slot, next_ per particle
+   */
+  std::vector<int> head_, tail_, next_;
+
+  /** scratch space for the distance search & the update flags */
+  std::vector<double> dist_;
+  std::vector<char> update_;
+  std::vector<fastjet::PseudoJet> pieces_;
+
+  int n_;
+  double r2_;
+  fastjet::JetAlgorithm algorithm_;
+
+  /** sets the rapidity, phi & momentum factor of slot idx from its momentum */
+  void set_kinematics( int idx );
+
+  /** finds the nearest neighbour of slot idx within R, and its d_iJ */
+  void set_nn( int idx );
+
+  /** recomputes d_iJ for slot idx from its current nearest neighbour */
+  void set_dij( int idx );
+
+  /** moves the last slot into slot idx, and relabels any
+      nearest neighbour pointers to it
+   */
+  void remove_slot( int idx );
+
+  /** builds the jet in slot idx from its particles */
+  fastjet::PseudoJet make_jet( int idx, const std::vector<fastjet::PseudoJet>& particles );
+
+};
+
+#endif // JETFINDING_SMALL_N_CLUSTERER_HH
@@ -0,0 +1,79 @@
+// implementation for work_queue class
+
+#include "work_queue.hh"
+
+work_queue::work_queue( unsigned n_workers, long long first, long long last, long long chunk_size ) : n_chunks_(0) {
+
+  if ( n_workers == 0 ) n_workers = 1;
+  if ( chunk_size < 1 ) chunk_size = 1;
+
+  for ( unsigned i = 0; i < n_workers; ++i ) {
+    queues_.push_back( std::unique_ptr<worker_deque>( new worker_deque ) );
+    queues_.back()->stolen = 0;
+  }
+
+  if ( last <= first ) return;
+
+  // build the chunks in entry order, then hand them out in contiguous
+  // blocks so each worker starts out reading sequentially
+  std::vector<chunk> chunks;
+  for ( long long begin = first; begin < last; begin += chunk_size )
+    chunks.push_back( chunk( begin, std::min( begin + chunk_size, last ) ) );
+
+  n_chunks_ = chunks.size();
+
+  for ( unsigned long i = 0; i < chunks.size(); ++i ) {
+    unsigned owner = i * n_workers / chunks.size();
+    queues_[owner]->chunks.push_back( chunks[i] );
+  }
+}
+
+bool work_queue::next_chunk( unsigned worker, long long& begin, long long& end ) {
+
+  worker = worker % queues_.size();
+  chunk c;
+
+  // first, try our own deque
+  {
+    std::lock_guard<std::mutex> guard( queues_[worker]->lock );
+    if ( !queues_[worker]->chunks.empty() ) {
+      c = queues_[worker]->chunks.front();
+      queues_[worker]->chunks.pop_front();
+      begin = c.first;
+      end = c.second;
+      return true;
+    }
+  }
+
+  // our own work is done - steal from the other workers, starting with
+  // our neighbour so that thieves spread out over the victims
+  for ( unsigned i = 1; i < queues_.size(); ++i ) {
+    unsigned victim = ( worker + i ) % queues_.size();
+    if ( steal( victim, c ) ) {
+      std::lock_guard<std::mutex> guard( queues_[worker]->lock );
+      queues_[worker]->stolen++;
+      begin = c.first;
+      end = c.second;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+unsigned long work_queue::n_stolen() {
+  unsigned long total = 0;
+  for ( unsigned i = 0; i < queues_.size(); ++i ) {
+    std::lock_guard<std::mutex> guard( queues_[i]->lock );
+    total += queues_[i]->stolen;
+  }
+  return total;
+}
+
+bool work_queue::steal( unsigned victim, chunk& c ) {
+  std::lock_guard<std::mutex> guard( queues_[victim]->lock );
+  if ( queues_[victim]->chunks.empty() ) return false;
+  c = queues_[victim]->chunks.back();
+  queues_[victim]->chunks.pop_back();
+  return true;
+}
@@ -0,0 +1,69 @@
+/*  A work-stealing queue of chain entry ranges, used to split
+    the event loop over several worker threads. Each worker is
+    handed a contiguous block of chunks up front ( so that it
+    reads its files mostly sequentially ), and once its own
+    block is exhausted it steals chunks from the back of the
+    other workers' blocks, so no core sits idle while
+    expensive ( high pT-hat ) entries remain elsewhere.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#ifndef JETFINDING_WORK_QUEUE_HH
+#define JETFINDING_WORK_QUEUE_HH
+
+class work_queue {
+
+public:
+
+  /** splits the entries [first, last) into chunks of chunk_size
+      entries, and distributes them in contiguous blocks over
+      n_workers worker deques
+   */
+  work_queue( unsigned n_workers, long long first, long long last, long long chunk_size = 500 );
+
+  /** default destructor */
+  ~work_queue() {};
+
+  /** pulls the next range of entries [begin, end) for worker. A worker
+      first drains its own deque from the front, then steals from the back
+      of the other deques. Returns false once there is no work left
+      anywhere in the queue.
+   */
+  bool next_chunk( unsigned worker, long long& begin, long long& end );
+
+  /** access to the number of workers, the number of chunks
+      initially queued, and the number that have been stolen
+   */
+  unsigned n_workers() const                      { return queues_.size(); }
+  unsigned long n_chunks() const                  { return n_chunks_; }
+  unsigned long n_stolen();
+
+private:
+
+  typedef std::pair<long long, long long> chunk;
+
+  /** each worker owns a deque of chunks and a lock - the owner pops
+      from the front, thieves pop from the back
+   */
+  struct worker_deque {
+    std::mutex lock;
+    std::deque<chunk> chunks;
+    unsigned long stolen;
+  };
+
+  std::vector<std::unique_ptr<worker_deque> > queues_;
+
+  unsigned long n_chunks_;
+
+  /** tries to take a chunk from the back of victim's deque */
+  bool steal( unsigned victim, chunk& c );
+
+};
+
+#endif // JETFINDING_WORK_QUEUE_HH
@@ -0,0 +1,57 @@
+import numpy as np
+
+from sklearn.linear_model import LinearRegression
+from sklearn.tree import DecisionTreeRegressor
+from sklearn.ensemble import RandomForestRegressor
+
+''' writes a trained linear regression, decision tree or random forest
+    to the text format read by jetfinding/correction_model, so that the
+    correction can be applied in C++ ( see apply_model ). features are
+    the names of the input columns, in the order the model was trained
+    on them, and poly the fitted PolynomialFeatures transform that was
+    applied to them ( if any ) '''
+def export_model( model, path, features, poly=None ):
+
+    n_features = len(features)
+    if poly is not None:
+        powers = np.asarray( poly.powers_ )
+    else:
+        powers = np.identity( n_features, dtype=int )
+    if powers.shape[1] != n_features:
+        raise ValueError('Error: the polynomial transform expects {} features, not {}'.format(powers.shape[1], n_features))
+
+    with open( path, 'w' ) as out:
+        out.write( 'jet_model 1\n' )
+
+        if isinstance( model, LinearRegression ):
+            out.write( 'type linear\n' )
+        elif isinstance( model, DecisionTreeRegressor ):
+            out.write( 'type tree\n' )
+        elif isinstance( model, RandomForestRegressor ):
+            out.write( 'type forest\n' )
+        else:
+            raise ValueError('Error: can only export linear, tree & forest regressors, not {}'.format(type(model).__name__))
+
+        out.write( 'features {} {}\n'.format( n_features, ' '.join(features) ) )
+        out.write( 'terms {}\n'.format( powers.shape[0] ) )
+        for term in powers:
+            out.write( ' '.join( str(int(p)) for p in term ) + '\n' )
+
+        if isinstance( model, LinearRegression ):
+            coefficients = np.ravel( model.coef_ )
+            intercept = np.ravel( model.intercept_ ) if np.ndim( model.intercept_ ) else [ model.intercept_ ]
+            if len(coefficients) != powers.shape[0]:
+                raise ValueError('Error: the model has {} coefficients for {} terms'.format(len(coefficients), powers.shape[0]))
+            out.write( 'intercept {!r}\n'.format( float(intercept[0]) ) )
+            out.write( 'coefficients {} {}\n'.format( len(coefficients), ' '.join( repr(float(c)) for c in coefficients ) ) )
+            return
+
+        estimators = model.estimators_ if isinstance( model, RandomForestRegressor ) else [ model ]
+        out.write( 'trees {}\n'.format( len(estimators) ) )
+        for estimator in estimators:
+            tree = estimator.tree_
+            out.write( 'nodes {}\n'.format( tree.node_count ) )
+            for i in range( tree.node_count ):
+                out.write( '{} {} {} {!r} {!r}\n'.format( tree.children_left[i], tree.children_right[i],
+                                                          max( tree.feature[i], -1 ), float(tree.threshold[i]),
+                                                          float(tree.value[i].ravel()[0]) ) )
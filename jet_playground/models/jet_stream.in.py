@@ -0,0 +1,165 @@
+import os
+import stat
+import struct
+import time
+import mmap
+import numpy as np
+
+''' reads the matched jet pairs process_geant --stream publishes while
+    it runs, from a ring buffer file ( --stream-type ring ) or a named
+    pipe ( --stream-type pipe ) - the framing is described in
+    jetfinding/jet_stream.hh. Only one consumer may read a stream.
+
+      stream = jet_stream( '/dev/shm/jets' )
+      for batch in stream.batches( 4096 ):
+          model.partial_fit( batch['features'], ... )
+
+    the record dtype of the constituents '''
+particle_dtype = np.dtype( [ ('pt', '<f4'), ('eta', '<f4'), ('phi', '<f4'), ('e', '<f4'), ('charge', '<i4') ] )
+
+class jet_stream():
+
+    frame_schema = 1
+    frame_jet = 2
+    frame_end = 3
+
+    ''' path is the stream; poll is how long to sleep ( in seconds ) while
+        waiting on the producer of a ring '''
+    def __init__( self, path, poll=0.001 ):
+        self.path = path
+        self.poll = poll
+        self.configs = []
+        self.features = []
+        self.ring = None
+        self.pipe = None
+
+        if stat.S_ISFIFO( os.stat(path).st_mode ):
+            self.pipe = open( path, 'rb', buffering=1 << 20 )
+        else:
+            with open( path, 'r+b' ) as f:
+                self.ring = mmap.mmap( f.fileno(), 0 )
+            if self.ring[:7] != b'JETRING':
+                raise ValueError('Error: {} is not a jet stream ring'.format(path))
+            self.data_offset, = struct.unpack_from( '<I', self.ring, 12 )
+            self.capacity, = struct.unpack_from( '<Q', self.ring, 16 )
+            ## the counters the producer updates while we read are
+            ## accessed through aligned numpy views - single loads &
+            ## stores, where struct would copy them a byte at a time
+            self._dropped = np.frombuffer( self.ring, '<u8', 1, 24 )
+            self._closed = np.frombuffer( self.ring, '<u4', 1, 32 )
+            self._head = np.frombuffer( self.ring, '<u8', 1, 64 )
+            self._tail = np.frombuffer( self.ring, '<u8', 1, 128 )
+
+    ''' the number of records the producer has dropped so far ( ring only ) '''
+    def dropped( self ):
+        return int( self._dropped[0] ) if self.ring is not None else None
+
+    def close( self ):
+        if self.ring is not None:
+            del self._dropped, self._closed, self._head, self._tail
+            self.ring.close()
+            self.ring = None
+        if self.pipe is not None:
+            self.pipe.close()
+            self.pipe = None
+
+    ''' reads exactly size bytes from the ring, starting at stream position tail '''
+    def _ring_read( self, tail, size ):
+        offset = self.data_offset + tail % self.capacity
+        first = min( size, self.data_offset + self.capacity - offset )
+        data = self.ring[offset:offset+first]
+        if first < size:
+            data += self.ring[self.data_offset:self.data_offset+size-first]
+        return data
+
+    ''' yields ( kind, payload ) for every frame, until the end of the stream '''
+    def frames( self ):
+        while True:
+            if self.pipe is not None:
+                header = self.pipe.read( 8 )
+                if len(header) < 8:
+                    return
+                size, kind = struct.unpack( '<II', header )
+                padded = ( size + 7 ) & ~7
+                payload = self.pipe.read( padded )[:size]
+            else:
+                tail = int( self._tail[0] )
+                head = int( self._head[0] )
+                if head == tail:
+                    ## head is written before closed - check again
+                    if self._closed[0] and int( self._head[0] ) == tail:
+                        return
+                    time.sleep( self.poll )
+                    continue
+                size, kind = struct.unpack( '<II', self._ring_read( tail, 8 ) )
+                padded = ( size + 7 ) & ~7
+                payload = self._ring_read( tail + 8, size )
+                ## hands the space back to the producer
+                self._tail[0] = tail + 8 + padded
+
+            if kind == jet_stream.frame_end:
+                return
+            if kind == jet_stream.frame_schema:
+                self._read_schema( payload.decode() )
+            yield kind, payload
+
+    def _read_schema( self, text ):
+        lines = text.splitlines()
+        if not lines or lines[0] != 'jet_stream 1':
+            raise ValueError('Error: unknown stream schema {}'.format(lines[:1]))
+        n_configs = int( lines[1].split()[1] )
+        self.configs = lines[2:2+n_configs]
+        n_features = int( lines[2+n_configs].split()[1] )
+        self.features = lines[3+n_configs:3+n_configs+n_features]
+
+    ''' yields every jet pair as a dict: config, partition, eventID, weight,
+        features ( keyed by name ), djet & pjet ( pt, eta, phi, m, area )
+        and dconst & pconst ( arrays of particle_dtype ) '''
+    def records( self ):
+        for kind, payload in self.frames():
+            if kind != jet_stream.frame_jet:
+                continue
+            config, partition, event_id, weight, n_features, n_geant, n_pythia, _ = \
+                struct.unpack_from( '<IiQdIIII', payload, 0 )
+            offset = 40
+            features = np.frombuffer( payload, '<f4', n_features, offset )
+            offset += 4 * n_features
+            jets = np.frombuffer( payload, '<f4', 10, offset )
+            offset += 40
+            dconst = np.frombuffer( payload, particle_dtype, n_geant, offset )
+            offset += particle_dtype.itemsize * n_geant
+            pconst = np.frombuffer( payload, particle_dtype, n_pythia, offset )
+            yield { 'config': config, 'partition': partition, 'eventID': event_id, 'weight': weight,
+                    'features': dict( zip( self.features, features ) ),
+                    'djet': jets[:5], 'pjet': jets[5:], 'dconst': dconst, 'pconst': pconst }
+
+    ''' groups the records into batches of up to size jet pairs, as numpy
+        arrays: config, partition, eventID & weight ( size ), features
+        ( size, n_features - the columns in the order of self.features ),
+        djet & pjet ( size, 5 ), and dconst & pconst as lists of arrays.
+        config & partition select one configuration or partition '''
+    def batches( self, size, config=None, partition=None ):
+        batch = []
+        for record in self.records():
+            if config is not None and record['config'] != config:
+                continue
+            if partition is not None and record['partition'] != partition:
+                continue
+            batch.append( record )
+            if len(batch) == size:
+                yield self._stack( batch )
+                batch = []
+        if batch:
+            yield self._stack( batch )
+
+    def _stack( self, batch ):
+        out = {}
+        for key in [ 'config', 'partition', 'eventID', 'weight' ]:
+            out[key] = np.array( [ r[key] for r in batch ] )
+        out['features'] = np.array( [ [ r['features'][name] for name in self.features ] for r in batch ],
+                                    dtype=np.float32 ).reshape( len(batch), len(self.features) )
+        out['djet'] = np.array( [ r['djet'] for r in batch ] )
+        out['pjet'] = np.array( [ r['pjet'] for r in batch ] )
+        out['dconst'] = [ r['dconst'] for r in batch ]
+        out['pconst'] = [ r['pconst'] for r in batch ]
+        return out
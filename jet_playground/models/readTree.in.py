@@ -1,7 +1,6 @@
 import sys
 import os
 import re
-import ROOT
 import numpy as np
 import pandas
 import hashlib
@@ -146,6 +145,68 @@ def load_root_tree(files, tree=None, columns=None, ignore=None, *kargs, **kwargs
         df = DataFrame.from_records(arr)
     return df
 
+## loads the per-jet training tree written with --output flat, and joins
+## the event level tree onto each jet through the shared eventID column.
+## The variable length constituent branches ( *_const_* ) come back as
+## per-row numpy arrays; pass ignore='*_const_*' to skip them
+def load_flat_tree(files, columns=None, ignore=None, *kargs, **kwargs):
+
+    jets = load_root_tree( files, 'training', columns, ignore, *kargs, **kwargs )
+    events = load_root_tree( files, 'event' )
+
+    if 'eventID' not in jets.columns:
+        raise ValueError('Error: no eventID branch in training tree - was it written with --output flat?')
+
+    events = events.drop_duplicates( subset='eventID' )
+    return jets.merge( events, on='eventID', how='left', suffixes=('', '_event') )
+
+## loads one table ( 'training' or 'event' ) written by process_geant
+## --output npy ( a directory ) or --output npz ( a .npz archive ) as a
+## dict of numpy arrays keyed by column name - see output_schema in
+## jetfinding/event.hh for the layout. The .npy files are memory mapped,
+## so only the columns that are used are ever read; .npz members are
+## read in full on access. Needs neither ROOT nor root_numpy
+def load_numpy(path, table='training', mmap_mode='r'):
+    if path.endswith('.npz'):
+        archive = np.load(path)
+        prefix = table + '/'
+        return dict( (key[len(prefix):], archive[key]) for key in archive.files if key.startswith(prefix) )
+
+    directory = os.path.join(path, table)
+    return dict( (name[:-4], np.load(os.path.join(directory, name), mmap_mode=mmap_mode))
+                 for name in sorted(os.listdir(directory)) if name.endswith('.npy') )
+
+## the numpy equivalent of load_flat_tree: the one dimensional columns
+## of a jet table ( 'training', or with --partition, 'validation' or
+## 'test' ) of each path in a DataFrame, with the event columns joined on
+## through eventID. The fixed width constituent arrays ( *const_* ) are
+## left out - use load_numpy for those
+def load_numpy_frame(paths, table='training'):
+    from pandas import DataFrame, concat
+
+    if not isinstance(paths, list):
+        paths = [paths]
+
+    frames = []
+    for path in paths:
+        jets = load_numpy( path, table )
+        events = load_numpy( path, 'event' )
+        jets = DataFrame( dict( (key, value) for key, value in jets.items() if value.ndim == 1 ) )
+        events = DataFrame( dict( events ) ).drop_duplicates( subset='eventID' )
+        frames.append( jets.merge( events, on='eventID', how='left', suffixes=('', '_event') ) )
+    return concat( frames, ignore_index=True )
+
+## true if process_geant --partition wrote the partition ( 'validation'
+## or 'test' ) to path - a ROOT file, a npy directory or a npz archive.
+## The train partition is always the 'training' tree or table
+def has_partition(path, partition):
+    if path.endswith('.npz'):
+        return any( key.startswith(partition + '/') for key in np.load(path).files )
+    if os.path.isdir(path):
+        return os.path.isdir( os.path.join(path, partition) )
+    from root_numpy import list_trees
+    return partition in list_trees(path)
+
 def train_forest( X_train, y_train ):
   param_grid = [ {'n_estimators': [3, 6, 10, 12, 15, 30], 'max_features' : [1, 3, 10, 20 ]},
                 {'bootstrap': [False], 'n_estimators': [3, 6, 10, 12, 15, 30], 'max_features': [1, 3, 10, 20] } ]
@@ -161,6 +222,7 @@ def train_forest( X_train, y_train ):
 
 ''' builds a TTree of results and writes them to a TFile '''
 def write_to_file( df, tree_name="result_tree", file_name="tmp.root" ):
+    import ROOT
     out_file = ROOT.TFile( 'test.root', 'recreate' )
     tree = ROOT.TTree( tree_name, 'trained model output' )
 
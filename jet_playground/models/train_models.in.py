@@ -31,6 +31,7 @@ import train_forest as forest
 import train_tree as tree
 import train_kn as knn
 import readTree as rt
+import export_model as em
 import transforms
 
 def main( args ):
@@ -64,11 +65,21 @@ def main( args ):
 
 
 
-      ## check if the files all have the same jetfinding options, if not, discard
-      files = rt.validateFiles( files )
+      ## numpy output ( --output npy/npz ) is loaded without ROOT
+      numpy_input = files[0].endswith('.npz') or os.path.isdir( files[0] )
+      if not numpy_input:
+        ## check if the files all have the same jetfinding options, if not, discard
+        files = rt.validateFiles( files )
 
-      ## reading trees into pandas dataframes
-      jet_data = rt.load_root_tree( files, tree="training" )
+      ## reading trees into pandas dataframes - a partitioned production
+      ## ( process_geant --partition ) already holds out its test events
+      def load_table( table ):
+        if numpy_input:
+          return rt.load_numpy_frame( files, table=table )
+        return rt.load_root_tree( files, tree=table )
+
+      partitioned = all( rt.has_partition( f, "test" ) for f in files )
+      jet_data = load_table( "training" )
 
       ## showing the statistics on the raw data
       jet_data.info()
@@ -83,14 +94,21 @@ def main( args ):
       pt_bins = tools.split_by_bin( jet_data, pt_column_name, n_pt_bins, pt_bin_min, pt_bin_max )
       pt_scaled, excess_data = tools.recombine_bins_equal_entries( pt_bins, random_state=rndm_state )
       
-      ## split into train & test data, to do so we need an index
-      pt_scaled['index'] = [ i for i in range(1,pt_scaled.shape[0]+1) ]
-      
-      ## split by hashing the index, which keeps the training set equavalent
-      ## between runs, as long as the dataframe has only been appended to
-      ## and not shuffled
-      test_ratio = 0.2
-      train_data, test_data = tools.split_train_test_by_id(pt_scaled, test_ratio, "index" )
+      if partitioned:
+        ## the partitions were assigned by event when the data was
+        ## produced, so the test set is the same in every run
+        train_data = pt_scaled
+        test_bins = tools.split_by_bin( load_table( "test" ), pt_column_name, n_pt_bins, pt_bin_min, pt_bin_max )
+        test_data, excess_test = tools.recombine_bins_equal_entries( test_bins, random_state=rndm_state )
+      else:
+        ## split into train & test data, to do so we need an index
+        pt_scaled['index'] = [ i for i in range(1,pt_scaled.shape[0]+1) ]
+        
+        ## split by hashing the index, which keeps the training set equavalent
+        ## between runs, as long as the dataframe has only been appended to
+        ## and not shuffled
+        test_ratio = 0.2
+        train_data, test_data = tools.split_train_test_by_id(pt_scaled, test_ratio, "index" )
 
       ## split out the data we want to build models with, and labels
       input_columns = [ "pt", "eta", "phi", "ncharge", "charge_frac", "area" ]
@@ -119,6 +137,8 @@ def main( args ):
           linear_predictions = np.array(best_linear_model.predict( X_test_prepared )).squeeze()
           tools.compare_model_to_geant( y_test['reco_pt'], geant=X_test['pt'], model=linear_predictions, model_name="Linear" )
           df_out['linear_pt'] = linear_predictions
+          if args.export is not None:
+            em.export_model( best_linear_model, os.path.join( args.export, 'linear.model' ), input_columns, poly=polynomial_transform )
       
       # ensemble methods
       if use_forest:
@@ -131,6 +151,8 @@ def main( args ):
           forest_predictions = np.array(best_forest.predict(X_test_prepared)).squeeze()
           tools.compare_model_to_geant( y_test['reco_pt'], geant=X_test['pt'], model=forest_predictions, model_name="Forest" )
           df_out['forest_pt'] = forest_predictions
+          if args.export is not None:
+            em.export_model( best_forest, os.path.join( args.export, 'forest.model' ), input_columns, poly=polynomial_transform )
 
       # decision tree models
       if use_tree:
@@ -139,6 +161,8 @@ def main( args ):
           tree_predictions = np.array(best_tree_model.predict( X_test_prepared )).squeeze()
           tools.compare_model_to_geant( y_test['reco_pt'], geant=X_test['pt'], model=tree_predictions, model_name="Decision Tree" )
           df_out['tree_pt'] = tree_predictions
+          if args.export is not None:
+            em.export_model( best_tree_model, os.path.join( args.export, 'tree.model' ), input_columns, poly=polynomial_transform )
 
       # KNN models
       if use_knn:
@@ -161,5 +185,6 @@ if __name__ == "__main__":
       parser.add_argument('--knn', type=bool, help=' train KNN regressor' )
       parser.add_argument('--poly', type=int, help=' create polynomials to order poly from all features')
       parser.add_argument('--maxjobs',type=int, help=' max number of parallel jobs to run')
+      parser.add_argument('--export', type=str, help=' directory to export the trained linear, forest & tree models to, for apply_model')
       args = parser.parse_args()
       main( args )
@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+
+# plans & runs a sharded production on the local machine - each shard
+# is a separate process_geant process, exactly as it would run on a
+# grid node, and the shard output is merged once they all finish
+#
+# usage: run_shards_local.sh n_shards [file_list] [probe_entries] [process_geant options...]
+# ( shell variables are written without braces, cmake substitutes those )
+
+set -e
+
+n_shards=4
+file_list=${CMAKE_BINARY_DIR}/settings/wsu_grid_geant.list
+probe=200
+if [ $# -gt 0 ]; then n_shards=$1; shift; fi
+if [ $# -gt 0 ]; then file_list=$1; shift; fi
+if [ $# -gt 0 ]; then probe=$1; shift; fi
+
+manifest=${CMAKE_BINARY_DIR}/manifest
+bin=${CMAKE_BINARY_DIR}/bin/jetfinding
+
+$bin/plan_shards $file_list $n_shards $manifest $probe
+
+pids=""
+for (( shard=0; shard<n_shards; shard++ )); do
+  $bin/process_geant --manifest $manifest --shard $shard "$@" \
+    > ${CMAKE_BINARY_DIR}/log/shard_$shard.log 2>&1 &
+  pids="$pids $!"
+done
+
+failed=0
+for pid in $pids; do
+  wait $pid || failed=1
+done
+if [ $failed -ne 0 ]; then
+  echo "a shard failed - see ${CMAKE_BINARY_DIR}/log/shard_*.log"
+  exit 1
+fi
+
+$bin/merge_shards $manifest
@@ -0,0 +1,83 @@
+// validates the small_n_clusterer against fastjet: random events of up
+// to 100 particles are clustered by both with kt, anti-kt and C/A for
+// several radii, and the sorted inclusive jets have to agree. Returns
+// non-zero if any event disagrees
+
+#include "small_n_clusterer.hh"
+
+#include "fastjet/PseudoJet.hh"
+#include "fastjet/JetDefinition.hh"
+#include "fastjet/ClusterSequence.hh"
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <iostream>
+
+/** true if the two jet lists ( sorted by pt ) are the same jets */
+bool same_jets( const std::vector<fastjet::PseudoJet>& a, const std::vector<fastjet::PseudoJet>& b ) {
+  if ( a.size() != b.size() ) return false;
+  for ( unsigned i = 0; i < a.size(); ++i ) {
+    double tolerance = 1e-9 * ( 1.0 + a[i].pt() );
+    if ( std::fabs( a[i].pt() - b[i].pt() ) > tolerance ) return false;
+    if ( std::fabs( a[i].rap() - b[i].rap() ) > 1e-9 ) return false;
+    if ( std::fabs( a[i].delta_phi_to( b[i] ) ) > 1e-9 ) return false;
+    if ( a[i].constituents().size() != b[i].constituents().size() ) return false;
+  }
+  return true;
+}
+
+int main() {
+
+  const unsigned n_events = 2000;
+  const fastjet::JetAlgorithm algorithms[3] = { fastjet::kt_algorithm, fastjet::antikt_algorithm,
+                                                fastjet::cambridge_algorithm };
+  const double radii[4] = { 0.2, 0.4, 0.7, 1.0 };
+
+  std::mt19937 rng( 1 );
+  std::uniform_real_distribution<double> uniform( 0.0, 1.0 );
+  std::uniform_int_distribution<int> multiplicity( 1, 100 );
+
+  small_n_clusterer clusterer;
+  std::vector<fastjet::PseudoJet> particles, jets;
+  unsigned n_tested = 0, n_failed = 0;
+
+  for ( unsigned event = 0; event < n_events; ++event ) {
+    // a soft background, with a collimated core so that there are real jets
+    particles.clear();
+    int n = multiplicity( rng );
+    for ( int i = 0; i < n; ++i ) {
+      double pt = 0.2 + std::exp( 3.0 * uniform( rng ) ) - 1.0;
+      double eta = i < 6 ? 0.1 * uniform( rng ) : 2.0 * uniform( rng ) - 1.0;
+      double phi = i < 6 ? 0.3 * uniform( rng ) : 2.0 * M_PI * uniform( rng );
+      fastjet::PseudoJet particle;
+      particle.reset_PtYPhiM( pt, eta, phi, 0.13957 );
+      particles.push_back( particle );
+    }
+
+    for ( unsigned a = 0; a < 3; ++a ) {
+      for ( unsigned r = 0; r < 4; ++r ) {
+        fastjet::JetDefinition jet_def( algorithms[a], radii[r] );
+
+        fastjet::ClusterSequence sequence( particles, jet_def );
+        std::vector<fastjet::PseudoJet> reference = fastjet::sorted_by_pt( sequence.inclusive_jets() );
+
+        clusterer.cluster( jet_def, particles, jets );
+        jets = fastjet::sorted_by_pt( jets );
+
+        ++n_tested;
+        if ( !same_jets( reference, jets ) ) {
+          if ( n_failed < 10 )
+            std::cerr << "mismatch: event " << event << " " << jet_def.description() << " - fastjet "
+                      << reference.size() << " jets, small_n_clusterer " << jets.size() << std::endl;
+          ++n_failed;
+        }
+      }
+    }
+  }
+
+  std::cout << "small_n_clusterer: " << n_tested - n_failed << " / " << n_tested
+            << " clusterings agree with fastjet" << std::endl;
+
+  return n_failed == 0 ? 0 : 1;
+}